@@ -0,0 +1,577 @@
+// GBBenchmark.cpp : Measures emulation throughput over the bundled ROMs, headless and unthrottled.
+//
+
+#include "Audio_Ring.h"
+#include "Command_Line.h"
+#include "Emulator.h"
+#include "Lockstep_Engine.h"
+#include "ROM_Image.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <initializer_list>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+#ifndef GB_ROM_DIRECTORY
+#define GB_ROM_DIRECTORY "."
+#endif
+
+const uint32_t AUDIO_SAMPLE_RATE = 48000;
+const std::size_t AUDIO_RING_FRAMES = 8192;
+
+struct Benchmark_Result
+{
+    std::string rom_path;
+    std::string title;
+    uint32_t frames = 0;
+    uint64_t cycles = 0;
+    uint64_t instructions = 0;
+    double seconds = 0;
+    uint32_t frame_checksum = 0;
+    uint64_t peak_rss_kb = 0;
+
+    // Lockstep runs only. Seconds and the counts above then cover all lanes together.
+    uint32_t lanes = 0;
+    double independent_seconds = 0;
+    double lockstep_share = 0;
+    bool identical = false;
+
+    // Fork runs only.
+    bool fork = false;
+    double fork_ns = 0;
+    double save_load_ns = 0;
+};
+
+// Peak resident set of the whole process so far, in KB.
+uint64_t Peak_RSS_KB()
+{
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    return GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)) ? counters.PeakWorkingSetSize / 1024 : 0;
+#else
+    rusage usage;
+    return getrusage(RUSAGE_SELF, &usage) == 0 ? static_cast<uint64_t>(usage.ru_maxrss) : 0;
+#endif
+}
+
+// Runs a fresh emulator for the given number of frames, keeping the fastest of several runs.
+// Without input every run executes exactly the same instructions, so only the time varies.
+// With audio the APU synthesizes at 48 kHz into a ring that is drained after every frame, as the SDL callback would.
+bool Run_Benchmark(const std::string& rom_path, uint32_t frames, uint32_t repeats, bool jit, bool audio, uint32_t run_ahead, bool render, Benchmark_Result& result)
+{
+    auto rom = ROM_Image::Open(rom_path);
+    if (!rom)
+    {
+        return false;
+    }
+
+    result.rom_path = rom_path;
+    result.frames = frames;
+    for (uint32_t run = 0; run < repeats; run++)
+    {
+        Emulator emulator(rom);
+#ifdef GB_JIT_SUPPORTED
+        emulator.cpu.Enable_JIT(jit);
+#endif
+
+        emulator.Set_Run_Ahead(run_ahead);
+        emulator.ppu.Set_Rendering(render);
+
+        Audio_Ring samples(AUDIO_RING_FRAMES);
+        std::vector<int16_t> drained(AUDIO_RING_FRAMES * 2);
+        if (audio)
+        {
+            emulator.apu.Publish_Audio(&samples, AUDIO_SAMPLE_RATE);
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        for (uint32_t frame = 0; frame < frames; frame++)
+        {
+            emulator.Run_Frame();
+            samples.Read(drained.data(), drained.size());
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        if (run == 0 || seconds < result.seconds)
+        {
+            result.seconds = seconds;
+        }
+        result.title = emulator.Title();
+        result.cycles = emulator.cpu.Cycles();
+        result.instructions = emulator.cpu.Instructions();
+        result.frame_checksum = emulator.ppu.Checksum();
+    }
+
+    result.peak_rss_kb = Peak_RSS_KB();
+    return true;
+}
+
+// Every lane presses its own pseudo-random buttons, changing every 8 frames, so the lanes go their own ways.
+uint8_t Lane_Buttons(uint32_t lane, uint32_t frame)
+{
+    uint32_t hash = (lane + 1) * 2654435761u ^ (frame / 8) * 40503u;
+    hash ^= hash >> 13;
+    hash *= 0x5bd1e995;
+    hash ^= hash >> 15;
+    return (hash & 3) == 0 ? static_cast<uint8_t>(hash >> 8) : 0;
+}
+
+// A 64 KB MBC1 cartridge whose lanes disagree on banks, which none of the bundled ROMs make them do. Holding A maps
+// bank 1, otherwise bank 2, and then the same bank 0 code calls 0x4000, where each bank leaves its own mark at 0xC000.
+std::shared_ptr<const ROM_Image> Bank_Divergence_ROM()
+{
+    std::string rom(4 * ROM_Image::BANK_SIZE, '\0');
+    auto put = [&rom](std::size_t offset, std::initializer_list<uint8_t> bytes)
+    {
+        for (uint8_t byte : bytes)
+        {
+            rom[offset++] = static_cast<char>(byte);
+        }
+    };
+
+    put(0x100, { 0x00, 0xC3, 0x50, 0x01 }); // NOP, JP 0150
+    put(0x147, { 0x01, 0x01 }); // MBC1, 64 KB
+    put(0x150, {
+        0x3E, 0x10, 0xE0, 0x00, // LD A,10, LDH (00),A: select the action buttons
+        0xF0, 0x00, 0xE6, 0x01, 0x3C, // LDH A,(00), AND 01, INC A: bank 1 with A held, else 2
+        0xEA, 0x00, 0x20, // LD (2000),A
+        0xCD, 0x00, 0x40, // CALL 4000
+        0x18, 0xFE }); // JR 015F
+    for (uint8_t bank : { 1, 2 })
+    {
+        put(bank * ROM_Image::BANK_SIZE, { 0x3E, static_cast<uint8_t>(bank * 0x11), 0xEA, 0x00, 0xC0, 0xC9 }); // LD A,11*bank, LD (C000),A, RET
+    }
+
+    std::istringstream stream(rom);
+    return ROM_Image::From_Stream(stream);
+}
+
+// Every lane of the bank divergence cartridge has to end as an independent emulator given its buttons would.
+template<std::size_t LANES>
+bool Check_Lockstep_Banks()
+{
+    auto rom = Bank_Divergence_ROM();
+    Lockstep_Engine<LANES> engine(rom);
+    for (uint32_t lane = 0; lane < LANES; lane++)
+    {
+        engine.Lane(lane).Set_Buttons(lane & 1 ? Joypad::A : 0);
+    }
+    engine.Run_Frames(2);
+
+    std::vector<uint8_t> expected;
+    std::vector<uint8_t> actual;
+    for (uint32_t lane = 0; lane < LANES; lane++)
+    {
+        Emulator emulator(rom);
+        emulator.Set_Buttons(lane & 1 ? Joypad::A : 0);
+        emulator.Run_Frames(2);
+        emulator.Save_State(expected);
+        engine.Lane(lane).Save_State(actual);
+        if (actual != expected)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Runs the lanes in a Lockstep_Engine, then the same lanes as independent emulators given the same buttons, and
+// checks every lane ends in the same state both ways, and that the bank divergence cartridge does too. Each side
+// keeps the fastest of its runs.
+template<std::size_t LANES>
+void Run_Lockstep(const std::shared_ptr<const ROM_Image>& rom, uint32_t frames, uint32_t repeats, bool render, Benchmark_Result& result)
+{
+    std::vector<std::vector<uint8_t>> lockstep_states(LANES);
+    for (uint32_t run = 0; run < repeats; run++)
+    {
+        auto engine = std::make_unique<Lockstep_Engine<LANES>>(rom);
+        for (uint32_t lane = 0; lane < LANES; lane++)
+        {
+            engine->Lane(lane).ppu.Set_Rendering(render);
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        for (uint32_t frame = 0; frame < frames; frame++)
+        {
+            for (uint32_t lane = 0; lane < LANES; lane++)
+            {
+                engine->Lane(lane).Set_Buttons(Lane_Buttons(lane, frame));
+            }
+            engine->Run_Frame();
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        if (run == 0 || seconds < result.seconds)
+        {
+            result.seconds = seconds;
+        }
+
+        result.title = engine->Lane(0).Title();
+        result.cycles = 0;
+        result.instructions = 0;
+        for (uint32_t lane = 0; lane < LANES; lane++)
+        {
+            result.cycles += engine->Lane(lane).cpu.Cycles();
+            result.instructions += engine->Lane(lane).cpu.Instructions();
+            engine->Lane(lane).Save_State(lockstep_states[lane]);
+        }
+        result.frame_checksum = engine->Lane(0).ppu.Checksum();
+        result.lockstep_share = double(engine->Lockstep_Instructions()) / std::max<uint64_t>(result.instructions, 1);
+    }
+
+    std::vector<uint8_t> state;
+    result.identical = Check_Lockstep_Banks<LANES>();
+    for (uint32_t run = 0; run < repeats; run++)
+    {
+        double seconds = 0;
+        for (uint32_t lane = 0; lane < LANES; lane++)
+        {
+            Emulator emulator(rom);
+            emulator.ppu.Set_Rendering(render);
+
+            auto start = std::chrono::steady_clock::now();
+            for (uint32_t frame = 0; frame < frames; frame++)
+            {
+                emulator.Set_Buttons(Lane_Buttons(lane, frame));
+                emulator.Run_Frame();
+            }
+            seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+            emulator.Save_State(state);
+            result.identical = result.identical && state == lockstep_states[lane];
+        }
+
+        if (run == 0 || seconds < result.independent_seconds)
+        {
+            result.independent_seconds = seconds;
+        }
+    }
+}
+
+bool Run_Lockstep_Benchmark(const std::string& rom_path, uint32_t frames, uint32_t repeats, uint32_t lanes, bool render, Benchmark_Result& result)
+{
+    auto rom = ROM_Image::Open(rom_path);
+    if (!rom)
+    {
+        return false;
+    }
+
+    result.rom_path = rom_path;
+    result.frames = frames;
+    result.lanes = lanes;
+    switch (lanes)
+    {
+    case 8: Run_Lockstep<8>(rom, frames, repeats, render, result); break;
+    case 16: Run_Lockstep<16>(rom, frames, repeats, render, result); break;
+    default: Run_Lockstep<32>(rom, frames, repeats, render, result); break;
+    }
+
+    result.peak_rss_kb = Peak_RSS_KB();
+    return true;
+}
+
+// After every frame of a root emulator a child is forked from it and runs a frame of its own, as a search would.
+// The forks are timed against saving the root's state and loading it into another child, and both children must
+// come out in the same state. The root runs with rendering off, the fastest of the repeats is kept.
+bool Run_Fork_Benchmark(const std::string& rom_path, uint32_t frames, uint32_t repeats, Benchmark_Result& result)
+{
+    auto rom = ROM_Image::Open(rom_path);
+    if (!rom)
+    {
+        return false;
+    }
+
+    result.rom_path = rom_path;
+    result.frames = frames;
+    result.fork = true;
+    result.identical = true;
+    std::vector<uint8_t> state;
+    std::vector<uint8_t> loaded_state;
+    for (uint32_t run = 0; run < repeats; run++)
+    {
+        Emulator root(rom);
+        Emulator forked(rom);
+        Emulator loaded(rom);
+        for (auto* emulator : { &root, &forked, &loaded })
+        {
+            emulator->ppu.Set_Rendering(false);
+        }
+
+        double fork_seconds = 0;
+        double save_load_seconds = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (uint32_t frame = 0; frame < frames; frame++)
+        {
+            root.Set_Buttons(Lane_Buttons(0, frame));
+            root.Run_Frame();
+
+            auto fork_start = std::chrono::steady_clock::now();
+            root.Fork_Into(forked);
+            auto fork_end = std::chrono::steady_clock::now();
+            root.Save_State(state);
+            loaded.Load_State(state);
+            auto load_end = std::chrono::steady_clock::now();
+            fork_seconds += std::chrono::duration<double>(fork_end - fork_start).count();
+            save_load_seconds += std::chrono::duration<double>(load_end - fork_end).count();
+
+            forked.Save_State(state);
+            loaded.Save_State(loaded_state);
+            result.identical = result.identical && state == loaded_state;
+
+            forked.Set_Buttons(Lane_Buttons(1, frame));
+            forked.Run_Frame();
+            loaded.Set_Buttons(Lane_Buttons(1, frame));
+            loaded.Run_Frame();
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        if (run == 0 || fork_seconds * 1e9 / frames < result.fork_ns)
+        {
+            result.fork_ns = fork_seconds * 1e9 / frames;
+            result.save_load_ns = save_load_seconds * 1e9 / frames;
+            result.seconds = seconds;
+        }
+        result.title = root.Title();
+        result.cycles = root.cpu.Cycles();
+        result.instructions = root.cpu.Instructions();
+        result.frame_checksum = root.ppu.Checksum();
+    }
+
+    result.peak_rss_kb = Peak_RSS_KB();
+    return true;
+}
+
+std::string Json_String(const std::string& text)
+{
+    std::ostringstream out;
+    out << '"';
+    for (char c : text)
+    {
+        if (c == '"' || c == '\\')
+        {
+            out << '\\' << c;
+        }
+        else if (static_cast<unsigned char>(c) < 0x20)
+        {
+            out << ' ';
+        }
+        else
+        {
+            out << c;
+        }
+    }
+    out << '"';
+    return out.str();
+}
+
+// Frames per second summed over every lane, so lockstep and single runs compare directly.
+double Instance_FPS(const Benchmark_Result& result, double seconds)
+{
+    return double(result.frames) * std::max<uint32_t>(result.lanes, 1) / seconds;
+}
+
+void Write_Json(std::ostream& out, const std::vector<Benchmark_Result>& results, uint32_t frames, uint32_t repeats, bool jit, bool audio, uint32_t run_ahead, bool render, uint32_t lockstep, bool fork)
+{
+    out << "{\n  \"version\": 1,\n  \"frames\": " << frames << ",\n  \"repeats\": " << repeats << ",\n  \"jit\": " << (jit ? "true" : "false")
+        << ",\n  \"audio\": " << (audio ? "true" : "false") << ",\n  \"run_ahead\": " << run_ahead
+        << ",\n  \"render\": " << (render ? "true" : "false") << ",\n  \"lockstep\": " << lockstep
+        << ",\n  \"fork\": " << (fork ? "true" : "false")
+        << ",\n  \"peak_rss_kb\": " << Peak_RSS_KB() << ",\n  \"results\": [";
+    for (std::size_t i = 0; i < results.size(); i++)
+    {
+        const auto& result = results[i];
+        out << (i ? "," : "") << "\n    {"
+            << "\"rom\": " << Json_String(result.rom_path)
+            << ", \"title\": " << Json_String(result.title)
+            << ", \"frames\": " << result.frames
+            << ", \"cycles\": " << result.cycles
+            << ", \"instructions\": " << result.instructions
+            << ", \"seconds\": " << result.seconds
+            << ", \"emulated_mhz\": " << result.cycles / result.seconds / 1000000.0
+            << ", \"fps\": " << Instance_FPS(result, result.seconds)
+            << ", \"ns_per_instruction\": " << result.seconds * 1e9 / std::max<uint64_t>(result.instructions, 1)
+            << ", \"peak_rss_kb\": " << result.peak_rss_kb
+            << ", \"frame_checksum\": " << result.frame_checksum;
+        if (result.lanes)
+        {
+            out << ", \"lanes\": " << result.lanes
+                << ", \"independent_fps\": " << Instance_FPS(result, result.independent_seconds)
+                << ", \"speedup\": " << result.independent_seconds / result.seconds
+                << ", \"lockstep_share\": " << result.lockstep_share
+                << ", \"identical\": " << (result.identical ? "true" : "false");
+        }
+        if (result.fork)
+        {
+            out << ", \"fork_ns\": " << result.fork_ns
+                << ", \"save_load_ns\": " << result.save_load_ns
+                << ", \"identical\": " << (result.identical ? "true" : "false");
+        }
+        out << "}";
+    }
+    out << "\n  ]\n}\n";
+}
+
+int main(int argc, char* argv[])
+{
+    const char* usage = "GBBenchmark [--frames N] [--repeat N] [--jit] [--audio] [--run-ahead N] [--no-render] [--lockstep 8|16|32] [--fork] [--json FILE] [rom ...]";
+    uint32_t frames = 3600;
+    uint32_t repeats = 3;
+    bool jit = false;
+    bool audio = false;
+    uint32_t run_ahead = 0;
+    bool render = true;
+    uint32_t lockstep = 0;
+    bool fork = false;
+    std::string json_path;
+    std::vector<std::string> roms;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--frames" && has_value)
+        {
+            if (!Parse_Number(arg, argv[++i], frames, usage))
+            {
+                return 1;
+            }
+        }
+        else if (arg == "--repeat" && has_value)
+        {
+            if (!Parse_Number(arg, argv[++i], repeats, usage))
+            {
+                return 1;
+            }
+            repeats = std::max<uint32_t>(repeats, 1);
+        }
+        else if (arg == "--jit")
+        {
+            jit = true;
+        }
+        else if (arg == "--audio")
+        {
+            audio = true;
+        }
+        else if (arg == "--run-ahead" && has_value)
+        {
+            if (!Parse_Number(arg, argv[++i], run_ahead, usage))
+            {
+                return 1;
+            }
+        }
+        else if (arg == "--no-render")
+        {
+            render = false;
+        }
+        else if (arg == "--lockstep" && has_value)
+        {
+            if (!Parse_Number(arg, argv[++i], lockstep, usage))
+            {
+                return 1;
+            }
+        }
+        else if (arg == "--fork")
+        {
+            fork = true;
+        }
+        else if (arg == "--json" && has_value)
+        {
+            json_path = argv[++i];
+        }
+        else
+        {
+            roms.push_back(arg);
+        }
+    }
+
+    if (roms.empty())
+    {
+        for (const char* name : { "tetris.gb", "drmario.gb", "red.gb", "snake.gb" })
+        {
+            roms.push_back(std::string(GB_ROM_DIRECTORY) + "/" + name);
+        }
+    }
+
+#ifndef GB_JIT_SUPPORTED
+    if (jit)
+    {
+        std::cout << "The recompiler is only available on x86-64." << std::endl;
+        return 1;
+    }
+#endif
+
+    if (lockstep && lockstep != 8 && lockstep != 16 && lockstep != 32)
+    {
+        std::cout << "Lockstep runs 8, 16 or 32 lanes." << std::endl;
+        return 1;
+    }
+
+    if ((lockstep || fork) && (jit || audio || run_ahead))
+    {
+        std::cout << "Lockstep and fork runs use the interpreter, without audio or run-ahead." << std::endl;
+        return 1;
+    }
+
+    if (lockstep && fork)
+    {
+        std::cout << "Lockstep and fork runs are measured separately." << std::endl;
+        return 1;
+    }
+
+    std::vector<Benchmark_Result> results;
+    for (const auto& rom : roms)
+    {
+        Benchmark_Result result;
+        bool read = lockstep ? Run_Lockstep_Benchmark(rom, frames, repeats, lockstep, render, result)
+            : fork ? Run_Fork_Benchmark(rom, frames, repeats, result)
+            : Run_Benchmark(rom, frames, repeats, jit, audio, run_ahead, render, result);
+        if (!read)
+        {
+            std::cout << "Can't read " << rom << std::endl;
+            return 1;
+        }
+
+        std::cout << result.title << ": " << Instance_FPS(result, result.seconds) << " fps, "
+            << result.cycles / result.seconds / 1000000.0 << " emulated MHz, "
+            << result.seconds * 1e9 / std::max<uint64_t>(result.instructions, 1) << " ns/instruction, "
+            << "peak RSS " << result.peak_rss_kb << " KB" << std::endl;
+        if (lockstep)
+        {
+            std::cout << "  " << lockstep << " lanes: " << Instance_FPS(result, result.independent_seconds) << " fps independent, "
+                << result.independent_seconds / result.seconds << "x speedup, "
+                << result.lockstep_share * 100 << "% of instructions in lockstep, "
+                << (result.identical ? "identical" : "DIFFERENT") << " final states" << std::endl;
+        }
+        if (fork)
+        {
+            std::cout << "  fork " << result.fork_ns << " ns, save and load " << result.save_load_ns << " ns, "
+                << (result.identical ? "identical" : "DIFFERENT") << " states" << std::endl;
+        }
+        results.push_back(result);
+    }
+
+    if (json_path == "-")
+    {
+        Write_Json(std::cout, results, frames, repeats, jit, audio, run_ahead, render, lockstep, fork);
+    }
+    else if (!json_path.empty())
+    {
+        std::ofstream json(json_path);
+        Write_Json(json, results, frames, repeats, jit, audio, run_ahead, render, lockstep, fork);
+    }
+
+    return 0;
+}
@@ -0,0 +1,641 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "Audio_Ring.h"
+#include "Band_Limited_Buffer.h"
+#include "CPU.h"
+#include "Memory.h"
+#include "Save_State.h"
+#include "Scheduler.h"
+
+// The four sound channels: two square waves (the first with a frequency sweep), a 32 step wave and noise.
+// Like the timer it is brought up to date only when a register is touched or samples are wanted. While samples
+// are published every change of a channel's output becomes a band-limited step, otherwise only the length,
+// sweep and envelope counters the CPU can observe through NR52 are kept.
+class APU
+{
+public:
+	APU(Memory& memory, Scheduler& scheduler) : _memory(memory), _scheduler(scheduler)
+	{
+		for (uint16_t address = NR10; address <= WAVE_END; address++)
+		{
+			_memory.Set_IO_Handler(address, this, &APU::Read_Register, &APU::Write_Register);
+		}
+
+		// Post boot ROM state: the start up chime has played out on the first channel.
+		const std::array<uint8_t, 0x17> boot = {
+			0x80, 0xBF, 0xF3, 0xC1, 0x87, 0xFF, 0x3F, 0x00, 0xFF, 0xBF, 0x7F, 0xFF,
+			0x9F, 0xFF, 0xBF, 0xFF, 0xFF, 0x00, 0x00, 0xBF, 0x77, 0xF3, 0xF1 };
+		std::copy(boot.begin(), boot.end(), _registers.begin());
+		_power = true;
+		_channels[0].enabled = true;
+		_channels[0].dac = true;
+		_channels[0].frequency = 0x7C1;
+	}
+
+	APU(const APU&) = delete;
+	APU& operator=(const APU&) = delete;
+
+	// Starts synthesizing into the ring at the given sample rate. Null stops, and headless runs never start.
+	void Publish_Audio(Audio_Ring* ring, uint32_t sample_rate)
+	{
+		Sync();
+		_ring = ring;
+		if (!ring)
+		{
+			return;
+		}
+
+		_left = std::make_unique<Band_Limited_Buffer>(double(CPU::CYCLES_PER_SECOND), sample_rate, MAX_BUFFER_CYCLES);
+		_right = std::make_unique<Band_Limited_Buffer>(double(CPU::CYCLES_PER_SECOND), sample_rate, MAX_BUFFER_CYCLES);
+		_samples.resize(_left->Samples_For(MAX_BUFFER_CYCLES) * 2);
+		_buffer_start = _cycle;
+		_outputs = {};
+		Update_Outputs();
+	}
+
+	// Pauses synthesis for frames that will be rolled back, keeping the ring. By the time it is unmuted the state
+	// must have been loaded back to where muting began, synthesis carries on from there.
+	void Set_Muted(bool muted)
+	{
+		if (_muted && !muted && _ring)
+		{
+			_buffer_start = _cycle;
+		}
+		_muted = muted;
+	}
+
+	// Hands everything synthesized up to now to the ring.
+	void Flush()
+	{
+		if (Synthesizing())
+		{
+			Sync();
+			End_Buffer();
+		}
+	}
+
+	// The synthesis buffers are not part of the state, they carry on from whatever was playing.
+	void Save_State(State_Writer& writer)
+	{
+		writer.Write(_registers);
+		writer.Write(_power);
+		writer.Write(_cycle);
+		writer.Write(_next_sequencer);
+		writer.Write(_sequencer_step);
+		for (const auto& channel : _channels)
+		{
+			writer.Write(channel.enabled);
+			writer.Write(channel.dac);
+			writer.Write(channel.length_enabled);
+			writer.Write(channel.length);
+			writer.Write(channel.frequency);
+			writer.Write(channel.next_edge);
+			writer.Write(channel.step);
+			writer.Write(channel.volume);
+			writer.Write(channel.envelope_timer);
+		}
+		writer.Write(_sweep_enabled);
+		writer.Write(_sweep_timer);
+		writer.Write(_shadow_frequency);
+		writer.Write(_lfsr);
+	}
+
+	void Load_State(State_Reader& reader)
+	{
+		if (Synthesizing())
+		{
+			End_Buffer();
+		}
+
+		reader.Read(_registers);
+		reader.Read(_power);
+		reader.Read(_cycle);
+		reader.Read(_next_sequencer);
+		reader.Read(_sequencer_step);
+		for (auto& channel : _channels)
+		{
+			reader.Read(channel.enabled);
+			reader.Read(channel.dac);
+			reader.Read(channel.length_enabled);
+			reader.Read(channel.length);
+			reader.Read(channel.frequency);
+			reader.Read(channel.next_edge);
+			reader.Read(channel.step);
+			reader.Read(channel.volume);
+			reader.Read(channel.envelope_timer);
+		}
+		reader.Read(_sweep_enabled);
+		reader.Read(_sweep_timer);
+		reader.Read(_shadow_frequency);
+		reader.Read(_lfsr);
+
+		if (Synthesizing())
+		{
+			_buffer_start = _cycle;
+			Update_Outputs();
+		}
+	}
+
+	// What Save_State keeps, straight from another instance, with the sound around it handled as Load_State does.
+	void Copy_State(const APU& other)
+	{
+		if (Synthesizing())
+		{
+			End_Buffer();
+		}
+
+		_registers = other._registers;
+		_power = other._power;
+		_cycle = other._cycle;
+		_next_sequencer = other._next_sequencer;
+		_sequencer_step = other._sequencer_step;
+		_channels = other._channels;
+		_sweep_enabled = other._sweep_enabled;
+		_sweep_timer = other._sweep_timer;
+		_shadow_frequency = other._shadow_frequency;
+		_lfsr = other._lfsr;
+
+		if (Synthesizing())
+		{
+			_buffer_start = _cycle;
+			Update_Outputs();
+		}
+	}
+
+private:
+	const static uint16_t NR10 = 0xFF10;
+	const static uint16_t NR50 = 0xFF24;
+	const static uint16_t NR51 = 0xFF25;
+	const static uint16_t NR52 = 0xFF26;
+	const static uint16_t WAVE_START = 0xFF30;
+	const static uint16_t WAVE_END = 0xFF3F;
+
+	const static int CHANNELS = 4;
+	const static int SQUARE_1 = 0;
+	const static int WAVE = 2;
+	const static int NOISE = 3;
+
+	// The frame sequencer clocks lengths, the sweep and envelopes at 512 Hz.
+	static constexpr uint64_t SEQUENCER_PERIOD = CPU::CYCLES_PER_SECOND / 512;
+
+	// About 30 ms. A longer stretch without a Flush is split so the synthesis buffers stay small.
+	static constexpr uint64_t MAX_BUFFER_CYCLES = 1 << 17;
+
+	// All four channels at full volume on both master levels come to 480, this brings that near full scale.
+	const static int32_t GAIN = 64;
+
+	struct Channel
+	{
+		bool enabled = false;
+		bool dac = false;
+		bool length_enabled = false;
+		uint16_t length = 0;
+		uint16_t frequency = 0;
+		uint64_t next_edge = 0; // Only advanced while synthesizing.
+		uint8_t step = 0;
+		uint8_t volume = 0;
+		uint8_t envelope_timer = 0;
+	};
+
+	struct Output
+	{
+		int32_t left = 0;
+		int32_t right = 0;
+	};
+
+	bool Synthesizing() const
+	{
+		return _ring && !_muted;
+	}
+
+	uint8_t& Register(uint16_t address)
+	{
+		return _registers[address - NR10];
+	}
+
+	// NRx0 to NRx4 of a channel.
+	uint8_t Channel_Register(int index, int offset) const
+	{
+		return _registers[index * 5 + offset];
+	}
+
+	// Cycles between steps of the waveform.
+	uint64_t Period(int index) const
+	{
+		const uint8_t divisors[8] = { 8, 16, 32, 48, 64, 80, 96, 112 };
+		switch (index)
+		{
+		case NOISE:
+		{
+			uint8_t nr43 = Channel_Register(NOISE, 3);
+			return uint64_t(divisors[nr43 & 7]) << (nr43 >> 4);
+		}
+		case WAVE:
+			return (2048 - _channels[index].frequency) * 2;
+		default:
+			return (2048 - _channels[index].frequency) * 4;
+		}
+	}
+
+	// The channel's digital output, 0 to 15.
+	int32_t Amplitude(int index) const
+	{
+		const uint8_t duties[4] = { 0x80, 0x81, 0xE1, 0x7E };
+		const auto& channel = _channels[index];
+		if (!channel.enabled)
+		{
+			return 0;
+		}
+
+		switch (index)
+		{
+		case WAVE:
+		{
+			const uint8_t shifts[4] = { 4, 0, 1, 2 };
+			uint8_t sample = _registers[WAVE_START - NR10 + (channel.step >> 1)];
+			sample = channel.step & 1 ? sample & 0x0F : sample >> 4;
+			return sample >> shifts[(Channel_Register(WAVE, 2) >> 5) & 3];
+		}
+		case NOISE:
+			return _lfsr & 1 ? 0 : channel.volume;
+		default:
+			return (duties[Channel_Register(index, 1) >> 6] >> channel.step) & 1 ? channel.volume : 0;
+		}
+	}
+
+	// Catches up to the present cycle, one frame sequencer step at a time.
+	void Sync()
+	{
+		uint64_t now = _scheduler.Now();
+		while (_cycle < now)
+		{
+			uint64_t next = std::min(now, _next_sequencer);
+			bool synthesizing = Synthesizing();
+			if (synthesizing)
+			{
+				next = std::min(next, _buffer_start + MAX_BUFFER_CYCLES);
+				for (int index = 0; index < CHANNELS; index++)
+				{
+					Run_Channel(index, next);
+				}
+			}
+
+			_cycle = next;
+			if (_cycle == _next_sequencer)
+			{
+				_next_sequencer += SEQUENCER_PERIOD;
+				Step_Sequencer();
+			}
+			if (synthesizing && _cycle - _buffer_start == MAX_BUFFER_CYCLES)
+			{
+				End_Buffer();
+			}
+		}
+	}
+
+	// Steps the waveform through every edge before the given cycle.
+	void Run_Channel(int index, uint64_t to)
+	{
+		auto& channel = _channels[index];
+		if (!channel.enabled || (index == NOISE && (Channel_Register(NOISE, 3) >> 4) >= 14))
+		{
+			return;
+		}
+
+		// An edge left behind while synthesis was off restarts the waveform timer from here.
+		uint64_t period = Period(index);
+		channel.next_edge = std::max(channel.next_edge, _cycle);
+		while (channel.next_edge < to)
+		{
+			if (index == NOISE)
+			{
+				uint16_t bit = (_lfsr ^ (_lfsr >> 1)) & 1;
+				_lfsr = (_lfsr >> 1) | (bit << 14);
+				if (Channel_Register(NOISE, 3) & 0x08)
+				{
+					_lfsr = (_lfsr & ~0x40) | (bit << 6);
+				}
+			}
+			else
+			{
+				channel.step = (channel.step + 1) & (index == WAVE ? 31 : 7);
+			}
+
+			Set_Output(index, channel.next_edge, Amplitude(index));
+			channel.next_edge += period;
+		}
+	}
+
+	// Pans and scales the channel by NR51 and NR50 and adds a step wherever that changes its contribution.
+	void Set_Output(int index, uint64_t cycle, int32_t amplitude)
+	{
+		uint8_t nr50 = Register(NR50);
+		uint8_t nr51 = Register(NR51);
+		Output output;
+		output.left = nr51 & (0x10 << index) ? amplitude * (((nr50 >> 4) & 7) + 1) : 0;
+		output.right = nr51 & (0x01 << index) ? amplitude * ((nr50 & 7) + 1) : 0;
+
+		auto& current = _outputs[index];
+		if (output.left != current.left)
+		{
+			_left->Add_Delta(cycle - _buffer_start, output.left - current.left);
+		}
+		if (output.right != current.right)
+		{
+			_right->Add_Delta(cycle - _buffer_start, output.right - current.right);
+		}
+		current = output;
+	}
+
+	// After anything but a waveform step changes what the channels put out.
+	void Update_Outputs()
+	{
+		for (int index = 0; index < CHANNELS; index++)
+		{
+			Set_Output(index, _cycle, Amplitude(index));
+		}
+	}
+
+	void End_Buffer()
+	{
+		uint64_t cycles = _cycle - _buffer_start;
+		std::size_t count = _left->End_Frame(cycles, _samples.data(), 2, GAIN);
+		_right->End_Frame(cycles, _samples.data() + 1, 2, GAIN);
+		_ring->Write(_samples.data(), count * 2);
+		_buffer_start = _cycle;
+	}
+
+	void Step_Sequencer()
+	{
+		if (!_power)
+		{
+			return;
+		}
+
+		uint8_t step = _sequencer_step;
+		_sequencer_step = (step + 1) & 7;
+		if (!(step & 1))
+		{
+			Clock_Lengths();
+		}
+		if (step == 2 || step == 6)
+		{
+			Clock_Sweep();
+		}
+		if (step == 7)
+		{
+			Clock_Envelopes();
+		}
+
+		if (Synthesizing())
+		{
+			Update_Outputs();
+		}
+	}
+
+	void Clock_Lengths()
+	{
+		for (auto& channel : _channels)
+		{
+			if (channel.length_enabled && channel.length && --channel.length == 0)
+			{
+				channel.enabled = false;
+			}
+		}
+	}
+
+	void Clock_Sweep()
+	{
+		if (--_sweep_timer)
+		{
+			return;
+		}
+
+		uint8_t period = (Channel_Register(SQUARE_1, 0) >> 4) & 7;
+		_sweep_timer = period ? period : 8;
+		if (!_sweep_enabled || !period)
+		{
+			return;
+		}
+
+		uint16_t frequency = Sweep_Frequency();
+		if (frequency <= 2047 && (Channel_Register(SQUARE_1, 0) & 7))
+		{
+			_shadow_frequency = frequency;
+			_channels[SQUARE_1].frequency = frequency;
+			_registers[3] = frequency & 0xFF;
+			_registers[4] = (_registers[4] & ~7) | (frequency >> 8);
+			Sweep_Frequency();
+		}
+	}
+
+	// The next swept frequency. Going past 2047 silences the channel.
+	uint16_t Sweep_Frequency()
+	{
+		uint8_t nr10 = Channel_Register(SQUARE_1, 0);
+		uint16_t delta = _shadow_frequency >> (nr10 & 7);
+		uint16_t frequency = nr10 & 0x08 ? _shadow_frequency - delta : _shadow_frequency + delta;
+		if (frequency > 2047)
+		{
+			_channels[SQUARE_1].enabled = false;
+		}
+
+		return frequency;
+	}
+
+	void Clock_Envelopes()
+	{
+		for (int index : { 0, 1, NOISE })
+		{
+			auto& channel = _channels[index];
+			uint8_t envelope = Channel_Register(index, 2);
+			if (!(envelope & 7) || (channel.envelope_timer && --channel.envelope_timer))
+			{
+				continue;
+			}
+
+			channel.envelope_timer = envelope & 7;
+			if (envelope & 0x08 ? channel.volume < 15 : channel.volume > 0)
+			{
+				channel.volume += envelope & 0x08 ? 1 : -1;
+			}
+		}
+	}
+
+	void Trigger(int index)
+	{
+		auto& channel = _channels[index];
+		channel.enabled = channel.dac;
+		if (!channel.length)
+		{
+			channel.length = index == WAVE ? 256 : 64;
+		}
+		channel.next_edge = _cycle + Period(index);
+
+		if (index == WAVE)
+		{
+			channel.step = 0;
+		}
+		else
+		{
+			channel.volume = Channel_Register(index, 2) >> 4;
+			channel.envelope_timer = Channel_Register(index, 2) & 7;
+		}
+
+		if (index == NOISE)
+		{
+			_lfsr = 0x7FFF;
+		}
+		else if (index == SQUARE_1)
+		{
+			uint8_t nr10 = Channel_Register(SQUARE_1, 0);
+			uint8_t period = (nr10 >> 4) & 7;
+			_shadow_frequency = channel.frequency;
+			_sweep_timer = period ? period : 8;
+			_sweep_enabled = period || (nr10 & 7);
+			if (nr10 & 7)
+			{
+				Sweep_Frequency();
+			}
+		}
+	}
+
+	// offset is 0 to 4 for NRx0 to NRx4.
+	void Write_Channel(int index, int offset, uint8_t value)
+	{
+		auto& channel = _channels[index];
+		switch (offset)
+		{
+		case 0:
+			if (index == WAVE)
+			{
+				channel.dac = value & 0x80;
+				channel.enabled &= channel.dac;
+			}
+			break;
+		case 1:
+			channel.length = index == WAVE ? 256 - value : 64 - (value & 0x3F);
+			break;
+		case 2:
+			if (index != WAVE)
+			{
+				channel.dac = value & 0xF8;
+				channel.enabled &= channel.dac;
+			}
+			break;
+		case 3:
+			if (index != NOISE)
+			{
+				channel.frequency = (channel.frequency & 0x700) | value;
+			}
+			break;
+		case 4:
+			channel.length_enabled = value & 0x40;
+			if (index != NOISE)
+			{
+				channel.frequency = (channel.frequency & 0xFF) | ((value & 7) << 8);
+			}
+			if (value & 0x80)
+			{
+				Trigger(index);
+			}
+			break;
+		}
+	}
+
+	static uint8_t Read_Register(void* context, uint16_t address)
+	{
+		// Bits that read back as 1: unused bits, write only registers and the gaps between registers.
+		const uint8_t masks[0x20] = {
+			0x80, 0x3F, 0x00, 0xFF, 0xBF, 0xFF, 0x3F, 0x00, 0xFF, 0xBF, 0x7F, 0xFF, 0x9F, 0xFF, 0xBF, 0xFF,
+			0xFF, 0x00, 0x00, 0xBF, 0x00, 0x00, 0x70, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF };
+
+		auto* apu = static_cast<APU*>(context);
+		if (address >= WAVE_START)
+		{
+			return apu->Register(address);
+		}
+		if (address != NR52)
+		{
+			return apu->Register(address) | masks[address - NR10];
+		}
+
+		apu->Sync();
+		uint8_t status = apu->_power ? 0x80 : 0x00;
+		for (int index = 0; index < CHANNELS; index++)
+		{
+			status |= apu->_channels[index].enabled ? 1 << index : 0;
+		}
+		return status | masks[address - NR10];
+	}
+
+	// While the power is off only NR52 and wave RAM can be written.
+	static void Write_Register(void* context, uint16_t address, uint8_t value)
+	{
+		auto* apu = static_cast<APU*>(context);
+		apu->Sync();
+		if (address >= WAVE_START)
+		{
+			apu->Register(address) = value;
+		}
+		else if (address == NR52)
+		{
+			bool power = value & 0x80;
+			if (!power && apu->_power)
+			{
+				std::fill(apu->_registers.begin(), apu->_registers.begin() + (NR52 - NR10), 0);
+				for (auto& channel : apu->_channels)
+				{
+					channel = { .next_edge = channel.next_edge };
+				}
+			}
+			else if (power && !apu->_power)
+			{
+				apu->_sequencer_step = 0;
+			}
+			apu->_power = power;
+		}
+		else if (apu->_power)
+		{
+			apu->Register(address) = value;
+			if (address < NR50)
+			{
+				apu->Write_Channel((address - NR10) / 5, (address - NR10) % 5, value);
+			}
+		}
+
+		if (apu->Synthesizing())
+		{
+			apu->Update_Outputs();
+		}
+	}
+
+	Memory& _memory;
+	Scheduler& _scheduler;
+
+	// NR10 to NR52, the unused addresses after it and wave RAM, as last written.
+	std::array<uint8_t, WAVE_END - NR10 + 1> _registers = {};
+	bool _power = false;
+	uint64_t _cycle = 0;
+	uint64_t _next_sequencer = SEQUENCER_PERIOD;
+	uint8_t _sequencer_step = 0;
+	std::array<Channel, CHANNELS> _channels;
+	bool _sweep_enabled = false;
+	uint8_t _sweep_timer = 8;
+	uint16_t _shadow_frequency = 0;
+	uint16_t _lfsr = 0x7FFF;
+
+	Audio_Ring* _ring = nullptr;
+	bool _muted = false;
+	std::unique_ptr<Band_Limited_Buffer> _left;
+	std::unique_ptr<Band_Limited_Buffer> _right;
+	std::vector<int16_t> _samples;
+	uint64_t _buffer_start = 0;
+	std::array<Output, CHANNELS> _outputs = {};
+};
@@ -0,0 +1,95 @@
+#pragma once
+
+#include "Audio_Ring.h"
+
+#include <cstdint>
+#include <iostream>
+
+#include <SDL.h>
+#undef main
+
+// Plays the APU's samples through SDL. The callback runs on SDL's audio thread and only ever reads the ring,
+// so a late emulator costs a moment of held sound and neither side ever waits for the other.
+class Audio_Device
+{
+public:
+    // About 170 ms of sound at 48 kHz.
+    static const std::size_t RING_FRAMES = 8192;
+
+    Audio_Device(Audio_Ring& ring) : ring(ring) {}
+
+    Audio_Device(const Audio_Device&) = delete;
+    Audio_Device& operator=(const Audio_Device&) = delete;
+
+    ~Audio_Device()
+    {
+        if (device)
+        {
+            SDL_CloseAudioDevice(device);
+            SDL_QuitSubSystem(SDL_INIT_AUDIO);
+        }
+    }
+
+    // False if there is no usable audio device, the emulator then runs silent.
+    bool Initialize(int sampleRate = 48000)
+    {
+        if (SDL_InitSubSystem(SDL_INIT_AUDIO) < 0)
+        {
+            std::cout << "Failed to initialize audio: " << SDL_GetError() << std::endl;
+            return false;
+        }
+
+        SDL_AudioSpec desired = {};
+        desired.freq = sampleRate;
+        desired.format = AUDIO_S16SYS;
+        desired.channels = 2;
+        desired.samples = 512;
+        desired.callback = &Audio_Device::fillBuffer;
+        desired.userdata = this;
+
+        SDL_AudioSpec obtained;
+        device = SDL_OpenAudioDevice(nullptr, 0, &desired, &obtained, SDL_AUDIO_ALLOW_FREQUENCY_CHANGE);
+        if (!device)
+        {
+            std::cout << "Failed to open audio device: " << SDL_GetError() << std::endl;
+            SDL_QuitSubSystem(SDL_INIT_AUDIO);
+            return false;
+        }
+
+        rate = obtained.freq;
+        SDL_PauseAudioDevice(device, 0);
+        return true;
+    }
+
+    // The rate the device actually runs at, which the APU must synthesize for.
+    uint32_t Sample_Rate()
+    {
+        return rate;
+    }
+
+private:
+    Audio_Ring& ring;
+    SDL_AudioDeviceID device = 0;
+    uint32_t rate = 0;
+    int16_t last[2] = {};
+
+    // An underrun holds the last sample instead of dropping to zero, which would click.
+    static void SDLCALL fillBuffer(void* userdata, Uint8* stream, int length)
+    {
+        auto* self = static_cast<Audio_Device*>(userdata);
+        auto* samples = reinterpret_cast<int16_t*>(stream);
+        std::size_t count = length / sizeof(int16_t);
+        std::size_t read = self->ring.Read(samples, count);
+        if (read)
+        {
+            self->last[0] = samples[read - 2];
+            self->last[1] = samples[read - 1];
+        }
+
+        for (std::size_t i = read; i + 1 < count; i += 2)
+        {
+            samples[i] = self->last[0];
+            samples[i + 1] = self->last[1];
+        }
+    }
+};
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+// Interleaved stereo samples from the emulation thread to the audio callback. Single producer, single consumer
+// and wait free on both sides: a full ring drops the newest samples instead of holding up emulation, and an empty
+// one returns short so the callback can fill in silence.
+class Audio_Ring
+{
+public:
+	// capacity is in stereo frames and is rounded up to a power of two.
+	explicit Audio_Ring(std::size_t capacity)
+	{
+		std::size_t size = 2;
+		while (size < capacity * 2)
+		{
+			size <<= 1;
+		}
+		_samples.resize(size);
+		_mask = size - 1;
+	}
+
+	Audio_Ring(const Audio_Ring&) = delete;
+	Audio_Ring& operator=(const Audio_Ring&) = delete;
+
+	// Producer side. count is in samples and should be even. Returns how many were taken.
+	std::size_t Write(const int16_t* samples, std::size_t count)
+	{
+		uint64_t head = _head.load(std::memory_order_relaxed);
+		uint64_t tail = _tail.load(std::memory_order_acquire);
+		std::size_t room = _samples.size() - static_cast<std::size_t>(head - tail);
+		std::size_t written = std::min(count, room) & ~std::size_t(1);
+		for (std::size_t i = 0; i < written; i++)
+		{
+			_samples[(head + i) & _mask] = samples[i];
+		}
+
+		_head.store(head + written, std::memory_order_release);
+		_dropped.store(_dropped.load(std::memory_order_relaxed) + (count - written), std::memory_order_relaxed);
+		return written;
+	}
+
+	// Consumer side. Returns how many samples were available, up to count.
+	std::size_t Read(int16_t* samples, std::size_t count)
+	{
+		uint64_t tail = _tail.load(std::memory_order_relaxed);
+		uint64_t head = _head.load(std::memory_order_acquire);
+		std::size_t read = std::min<std::size_t>(count, static_cast<std::size_t>(head - tail)) & ~std::size_t(1);
+		for (std::size_t i = 0; i < read; i++)
+		{
+			samples[i] = _samples[(tail + i) & _mask];
+		}
+
+		_tail.store(tail + read, std::memory_order_release);
+		return read;
+	}
+
+	// Samples waiting to be read, as of some moment during the call.
+	std::size_t Available() const
+	{
+		uint64_t tail = _tail.load(std::memory_order_acquire);
+		return static_cast<std::size_t>(_head.load(std::memory_order_acquire) - tail);
+	}
+
+	// Samples thrown away because the consumer fell behind.
+	uint64_t Dropped() const
+	{
+		return _dropped.load(std::memory_order_relaxed);
+	}
+
+private:
+	std::vector<int16_t> _samples;
+	std::size_t _mask = 0;
+
+	// Each index lives on its own cache line so the two threads don't fight over one.
+	alignas(64) std::atomic<uint64_t> _head = 0;
+	std::atomic<uint64_t> _dropped = 0;
+	alignas(64) std::atomic<uint64_t> _tail = 0;
+};
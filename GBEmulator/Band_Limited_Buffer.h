@@ -0,0 +1,132 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// Resamples a signal given as amplitude steps at exact clock times. Each step is added as a band-limited
+// (windowed sinc) step at its fractional output position, so square waves come out without aliasing, and a
+// frame's samples are produced in one pass by integrating the accumulated differences.
+class Band_Limited_Buffer
+{
+public:
+	// Kernel taps per step and the sub-sample positions the kernel is precomputed for.
+	const static int WIDTH = 16;
+	const static int PHASE_BITS = 5;
+	const static int PHASES = 1 << PHASE_BITS;
+
+	// max_clocks is the longest span End_Frame may be given.
+	Band_Limited_Buffer(double clock_rate, double sample_rate, uint64_t max_clocks)
+		: _factor(static_cast<uint64_t>(sample_rate / clock_rate * FIXED_ONE + 0.5))
+	{
+		_buffer.resize(static_cast<std::size_t>((max_clocks * _factor >> FIXED_BITS) + WIDTH + 2));
+		Build_Kernel();
+	}
+
+	// Adds an amplitude change of delta at the given clock, counted from the start of the current frame.
+	void Add_Delta(uint64_t clock, int32_t delta)
+	{
+		uint64_t position = _offset + clock * _factor;
+		const int32_t* kernel = _kernel[(position >> (FIXED_BITS - PHASE_BITS)) & (PHASES - 1)].data();
+		int32_t* out = &_buffer[static_cast<std::size_t>(position >> FIXED_BITS)];
+		for (int i = 0; i < WIDTH; i++)
+		{
+			out[i] += kernel[i] * delta;
+		}
+	}
+
+	// Ends the frame after the given number of clocks and writes its samples, every stride'th element of out,
+	// scaled by gain. Returns the number of samples, which out must have room for (see Samples_For).
+	std::size_t End_Frame(uint64_t clocks, int16_t* out, std::size_t stride, int32_t gain)
+	{
+		uint64_t end = _offset + clocks * _factor;
+		std::size_t count = static_cast<std::size_t>(end >> FIXED_BITS);
+		_offset = end & (FIXED_ONE - 1);
+
+		// The running sum rebuilds the signal from its differences, and subtracting a slowly following average
+		// removes the DC offset the way the Game Boy's output capacitor does.
+		int32_t integrator = _integrator;
+		int32_t average = _average;
+		for (std::size_t i = 0; i < count; i++)
+		{
+			integrator += _buffer[i];
+			average += (integrator - average) >> HIGH_PASS_SHIFT;
+			int64_t sample = (int64_t(integrator - average) * gain) >> KERNEL_BITS;
+			out[i * stride] = static_cast<int16_t>(std::clamp<int64_t>(sample, -32768, 32767));
+		}
+		_integrator = integrator;
+		_average = average;
+
+		// Steps near the end of the frame spill into the next one.
+		if (count)
+		{
+			std::memmove(_buffer.data(), _buffer.data() + count, (WIDTH + 1) * sizeof(int32_t));
+			std::fill(_buffer.begin() + WIDTH + 1, _buffer.begin() + count + WIDTH + 1, 0);
+		}
+		return count;
+	}
+
+	// An upper bound on the samples End_Frame produces for the given number of clocks.
+	std::size_t Samples_For(uint64_t clocks) const
+	{
+		return static_cast<std::size_t>(((FIXED_ONE - 1) + clocks * _factor) >> FIXED_BITS);
+	}
+
+	// Drops everything pending and settles the output at silence.
+	void Clear()
+	{
+		std::fill(_buffer.begin(), _buffer.end(), 0);
+		_offset = 0;
+		_integrator = 0;
+		_average = 0;
+	}
+
+private:
+	// Output positions are 32.32 fixed point samples.
+	const static int FIXED_BITS = 32;
+	const static uint64_t FIXED_ONE = uint64_t(1) << FIXED_BITS;
+
+	// Each phase of the kernel sums to exactly 1 << KERNEL_BITS, so a step always integrates to its full height.
+	const static int KERNEL_BITS = 14;
+	const static int HIGH_PASS_SHIFT = 9;
+
+	// Blackman windowed sinc with its cutoff a little under the output Nyquist frequency.
+	void Build_Kernel()
+	{
+		const double pi = 3.14159265358979323846;
+		const double cutoff = 0.9;
+		for (int phase = 0; phase < PHASES; phase++)
+		{
+			std::array<double, WIDTH> taps;
+			double sum = 0;
+			for (int i = 0; i < WIDTH; i++)
+			{
+				double x = i - (WIDTH / 2 - 1) - double(phase) / PHASES;
+				double sinc = x == 0 ? 1.0 : std::sin(pi * cutoff * x) / (pi * cutoff * x);
+				double w = (x + WIDTH / 2) / WIDTH;
+				double window = 0.42 - 0.5 * std::cos(2 * pi * w) + 0.08 * std::cos(4 * pi * w);
+				taps[i] = sinc * window;
+				sum += taps[i];
+			}
+
+			// Rounding error goes into the centre tap.
+			int32_t total = 0;
+			for (int i = 0; i < WIDTH; i++)
+			{
+				_kernel[phase][i] = static_cast<int32_t>(std::lround(taps[i] / sum * (1 << KERNEL_BITS)));
+				total += _kernel[phase][i];
+			}
+			_kernel[phase][WIDTH / 2 - 1] += (1 << KERNEL_BITS) - total;
+		}
+	}
+
+	uint64_t _factor;
+	uint64_t _offset = 0;
+	int32_t _integrator = 0;
+	int32_t _average = 0;
+	std::vector<int32_t> _buffer;
+	std::array<std::array<int32_t, WIDTH>, PHASES> _kernel;
+};
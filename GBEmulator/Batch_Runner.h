@@ -0,0 +1,233 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Emulator.h"
+#include "ROM_Analysis.h"
+#include "ROM_Image.h"
+#include "Thread_Pool.h"
+#include "Trace.h"
+
+struct Batch_Job
+{
+	std::string rom_path;
+	uint32_t frames = 0;
+	uint64_t cycles = 0; // Run for this many cycles instead when non-zero.
+	bool jit = false;
+	uint32_t rewind_frames = 0; // Rewind this far at the end and replay, checking the replay lands on the same state.
+	std::string save_path; // Battery backed RAM is kept in this file when set.
+	std::string profile_path; // Profile to <path>.folded and <path>.txt when set, GB_PROFILER builds only.
+	std::string trace_path; // Record every instruction to this file when set.
+	std::shared_ptr<const Movie> movie; // Input played back from power on, when set.
+	std::string code_cache; // Directory of ROM analyses. Known blocks are decoded up front and new ones saved, when set.
+};
+
+struct Batch_Result
+{
+	std::string rom_path;
+	std::string title;
+	uint64_t cycles = 0;
+	uint64_t instructions = 0;
+	uint16_t pc = 0;
+	uint32_t checksum = 0;
+	uint32_t frame_checksum = 0;
+	bool rewind_ok = true;
+	std::size_t rewind_bytes = 0;
+	bool battery = false;
+	uint64_t trace_records = 0;
+	bool trace_ok = true;
+	std::vector<uint32_t> rom_blocks; // Keys of the ROM blocks reached, with a code cache.
+	double seconds = 0;
+};
+
+// Runs many independent headless emulators across a work-stealing thread pool.
+class Batch_Runner
+{
+public:
+	explicit Batch_Runner(std::size_t threads = 0) : _pool(threads) {}
+
+	std::size_t Thread_Count() const { return _pool.Thread_Count(); }
+
+	std::vector<Batch_Result> Run(const std::vector<Batch_Job>& jobs)
+	{
+		// Map each cartridge once up front, every instance of it then shares the one read-only image.
+		std::map<std::string, std::shared_ptr<const ROM_Image>> roms;
+		for (const auto& job : jobs)
+		{
+			if (roms.find(job.rom_path) == roms.end())
+			{
+				roms[job.rom_path] = ROM_Image::Open(job.rom_path);
+			}
+		}
+
+		// Likewise each cartridge's analysis, read or made once and then shared.
+		std::map<std::string, Code_Cache> code_caches;
+		for (const auto& job : jobs)
+		{
+			const auto& rom = roms.at(job.rom_path);
+			if (!job.code_cache.empty() && rom && code_caches.find(job.rom_path) == code_caches.end())
+			{
+				auto& cache = code_caches[job.rom_path];
+				cache.directory = job.code_cache;
+				cache.analysis = ROM_Analysis::Open(job.code_cache, *rom);
+				cache.block_starts = cache.analysis->Block_Starts();
+			}
+		}
+
+		std::vector<Batch_Result> results(jobs.size());
+		for (std::size_t i = 0; i < jobs.size(); i++)
+		{
+			auto cache = code_caches.find(jobs[i].rom_path);
+			const std::vector<uint32_t>* block_starts = cache == code_caches.end() || jobs[i].code_cache.empty() ? nullptr : &cache->second.block_starts;
+			_pool.Submit([&, i, block_starts]
+			{
+				results[i] = Run_Job(jobs[i], roms.at(jobs[i].rom_path), block_starts);
+			});
+		}
+		_pool.Wait();
+
+		// Blocks the analysis didn't know of become seeds, so the next batch decodes them up front too.
+		for (const auto& [rom_path, cache] : code_caches)
+		{
+			std::vector<uint32_t> reached;
+			for (const auto& result : results)
+			{
+				if (result.rom_path == rom_path)
+				{
+					reached.insert(reached.end(), result.rom_blocks.begin(), result.rom_blocks.end());
+				}
+			}
+
+			const auto& rom = *roms.at(rom_path);
+			if (auto updated = cache.analysis->With_Seeds(rom, reached))
+			{
+				updated->Save(ROM_Analysis::Cache_Path(cache.directory, rom));
+			}
+		}
+
+		return results;
+	}
+
+private:
+	struct Code_Cache
+	{
+		std::string directory;
+		std::unique_ptr<ROM_Analysis> analysis;
+		std::vector<uint32_t> block_starts;
+	};
+
+	static Batch_Result Run_Job(const Batch_Job& job, const std::shared_ptr<const ROM_Image>& rom, const std::vector<uint32_t>* block_starts)
+	{
+		auto start = std::chrono::steady_clock::now();
+
+		Batch_Result result;
+		result.rom_path = job.rom_path;
+		if (!rom)
+		{
+			result.title = "(unreadable)";
+			return result;
+		}
+
+		// A movie holds button presses for one cartridge only, on any other it would play nonsense.
+		if (job.movie && job.movie->ROM_Hash() != rom->Hash())
+		{
+			result.title = "(movie is of another cartridge)";
+			return result;
+		}
+
+		auto emulator = std::make_unique<Emulator>(rom);
+#ifdef GB_JIT_SUPPORTED
+		emulator->cpu.Enable_JIT(job.jit);
+#endif
+		if (block_starts)
+		{
+			emulator->cpu.Prewarm(*block_starts);
+		}
+		if (!job.save_path.empty())
+		{
+			result.battery = emulator->Enable_Battery(job.save_path);
+		}
+		if (job.movie)
+		{
+			emulator->Play_Movie(job.movie.get());
+		}
+
+		std::unique_ptr<Trace_Writer> tracer;
+		if (!job.trace_path.empty())
+		{
+			tracer = Trace_Writer::Open(job.trace_path);
+			result.trace_ok = tracer != nullptr;
+			emulator->cpu.Set_Tracer(tracer.get());
+		}
+#ifdef GB_PROFILER
+		Profiler profiler;
+		if (!job.profile_path.empty())
+		{
+			emulator->cpu.Set_Profiler(&profiler);
+		}
+#endif
+
+		if (job.cycles > 0)
+		{
+			emulator->Run_Cycles(job.cycles);
+		}
+		else if (job.rewind_frames > 0)
+		{
+			emulator->Enable_Rewind(static_cast<uint32_t>(job.rewind_frames / Emulator::FRAMES_PER_SECOND) + 1);
+			emulator->Run_Frames(job.frames);
+			result.rewind_bytes = emulator->Rewind_History()->Bytes();
+
+			std::vector<uint8_t> expected;
+			emulator->Save_State(expected);
+			uint32_t rewound = emulator->Rewind(job.rewind_frames);
+			emulator->Run_Frames(rewound);
+
+			std::vector<uint8_t> replayed;
+			emulator->Save_State(replayed);
+			result.rewind_ok = replayed == expected;
+		}
+		else
+		{
+			emulator->Run_Frames(job.frames);
+		}
+
+		result.title = emulator->Title();
+		if (tracer)
+		{
+			emulator->cpu.Set_Tracer(nullptr);
+			result.trace_records = tracer->Count();
+			tracer.reset();
+		}
+#ifdef GB_PROFILER
+		if (!job.profile_path.empty())
+		{
+			std::ofstream folded(job.profile_path + ".folded");
+			profiler.Write_Collapsed(folded, job.rom_path);
+			std::ofstream report(job.profile_path + ".txt");
+			report << result.title << "\n\n";
+			profiler.Write_Opcode_Report(report);
+			report << "\n";
+			profiler.Write_Site_Report(report);
+		}
+#endif
+		result.cycles = emulator->cpu.Cycles();
+		result.instructions = emulator->cpu.Instructions();
+		result.pc = emulator->registers.PC();
+		result.checksum = emulator->memory.Checksum();
+		result.frame_checksum = emulator->ppu.Checksum();
+		if (block_starts)
+		{
+			result.rom_blocks = emulator->cpu.ROM_Block_Keys();
+		}
+		result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		return result;
+	}
+
+	Thread_Pool _pool;
+};
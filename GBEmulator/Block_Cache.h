@@ -0,0 +1,122 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+// Pre-decoded straight line runs of instructions, keyed by ROM bank and PC.
+template<typename Instruction>
+class Block_Cache
+{
+public:
+	struct Block
+	{
+		uint32_t key;
+		std::vector<Instruction> instructions;
+		uint32_t executions = 0;
+		const void* native = nullptr; // Set by the recompiler once the block is hot.
+		uint8_t idle_tries = 0; // Set by the CPU on loops that may be waiting for an event.
+	};
+
+	static uint32_t Key(uint16_t bank, uint16_t pc)
+	{
+		return (static_cast<uint32_t>(bank) << 16) | pc;
+	}
+
+	Block* Find(uint32_t key)
+	{
+		auto& slot = _recent[Recent_Index(key)];
+		if (slot && slot->key == key)
+		{
+			return slot;
+		}
+
+		auto it = _blocks.find(key);
+		if (it == _blocks.end())
+		{
+			return nullptr;
+		}
+
+		slot = it->second.get();
+		return slot;
+	}
+
+	// Pages are only tracked for blocks in RAM, ROM blocks live until the cache is cleared.
+	Block* Insert(uint32_t key, std::vector<Instruction> instructions, uint8_t first_page, uint8_t last_page, bool track_pages)
+	{
+		auto& block = _blocks[key];
+		block = std::make_unique<Block>(Block{ key, std::move(instructions) });
+		_recent[Recent_Index(key)] = block.get();
+
+		if (track_pages)
+		{
+			for (uint32_t page = first_page; page <= last_page; page++)
+			{
+				_page_blocks[page].push_back(key);
+			}
+		}
+
+		return block.get();
+	}
+
+	// Drops every block that was decoded from the page.
+	void Invalidate_Page(uint8_t page)
+	{
+		for (auto key : _page_blocks[page])
+		{
+			auto it = _blocks.find(key);
+			if (it == _blocks.end())
+			{
+				continue;
+			}
+
+			auto& slot = _recent[Recent_Index(key)];
+			if (slot == it->second.get())
+			{
+				slot = nullptr;
+			}
+
+			_blocks.erase(it);
+		}
+
+		_page_blocks[page].clear();
+	}
+
+	void Clear()
+	{
+		_blocks.clear();
+		_recent.fill(nullptr);
+		for (auto& keys : _page_blocks)
+		{
+			keys.clear();
+		}
+	}
+
+	std::size_t Size() const
+	{
+		return _blocks.size();
+	}
+
+	template<typename Visit>
+	void For_Each(Visit visit) const
+	{
+		for (const auto& entry : _blocks)
+		{
+			visit(*entry.second);
+		}
+	}
+
+private:
+	const static std::size_t RECENT_SIZE = 4096;
+
+	static std::size_t Recent_Index(uint32_t key)
+	{
+		return (key ^ (key >> 12)) & (RECENT_SIZE - 1);
+	}
+
+	std::unordered_map<uint32_t, std::unique_ptr<Block>> _blocks;
+	std::array<Block*, RECENT_SIZE> _recent = {};
+	std::array<std::vector<uint32_t>, 256> _page_blocks;
+};
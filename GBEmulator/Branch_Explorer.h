@@ -0,0 +1,104 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include "Emulator.h"
+#include "PPU.h"
+#include "ROM_Image.h"
+#include "Thread_Pool.h"
+
+// One line of play from a common starting state: the buttons held for each frame it runs.
+struct Branch
+{
+	std::vector<uint8_t> buttons;
+};
+
+struct Branch_Result
+{
+	std::vector<uint8_t> state; // Save state at the end of the branch, when asked for.
+	PPU::Frame frame = {}; // The last frame drawn, when asked for. Needs a branch of at least one frame.
+	uint64_t cycles = 0;
+};
+
+// Runs many branches from one emulator across a work-stealing thread pool, for searches over inputs. Every branch
+// runs in a child forked from the root, and children are kept from call to call, so each fork only copies the RAM
+// pages the root or that child has written since they last met.
+class Branch_Explorer
+{
+public:
+	explicit Branch_Explorer(std::shared_ptr<const ROM_Image> rom, std::size_t threads = 0) : _rom(std::move(rom)), _pool(threads) {}
+
+	std::size_t Thread_Count() const { return _pool.Thread_Count(); }
+
+	// root must be running the explorer's cartridge. It is only read, and must not be run until this returns.
+	// Frames are only drawn when asked for.
+	std::vector<Branch_Result> Explore(Emulator& root, const std::vector<Branch>& branches, bool states, bool frames)
+	{
+		// Sealed here, once, so the forks on the workers only read the root.
+		root.memory.Seal();
+
+		std::vector<Branch_Result> results(branches.size());
+		for (std::size_t i = 0; i < branches.size(); i++)
+		{
+			_pool.Submit([&, i]
+			{
+				Run_Branch(root, branches[i], states, frames, results[i]);
+			});
+		}
+		_pool.Wait();
+
+		return results;
+	}
+
+private:
+	void Run_Branch(Emulator& root, const Branch& branch, bool states, bool frames, Branch_Result& result)
+	{
+		std::unique_ptr<Emulator> child = Take_Child();
+		root.Fork_Into(*child);
+		child->ppu.Set_Rendering(frames);
+		for (uint8_t buttons : branch.buttons)
+		{
+			child->Set_Buttons(buttons);
+			child->Run_Frame();
+		}
+
+		if (states)
+		{
+			child->Save_State(result.state);
+		}
+		if (frames)
+		{
+			result.frame = child->ppu.Framebuffer();
+		}
+		result.cycles = child->cpu.Cycles();
+
+		std::lock_guard<std::mutex> lock(_children_mutex);
+		_children.push_back(std::move(child));
+	}
+
+	std::unique_ptr<Emulator> Take_Child()
+	{
+		{
+			std::lock_guard<std::mutex> lock(_children_mutex);
+			if (!_children.empty())
+			{
+				auto child = std::move(_children.back());
+				_children.pop_back();
+				return child;
+			}
+		}
+
+		return std::make_unique<Emulator>(_rom);
+	}
+
+	std::shared_ptr<const ROM_Image> _rom;
+	std::mutex _children_mutex;
+	std::vector<std::unique_ptr<Emulator>> _children;
+
+	// Declared last, so the workers are joined before the children they use are destroyed.
+	Thread_Pool _pool;
+};
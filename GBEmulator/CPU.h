@@ -1,11 +1,25 @@
 #pragma once
 
+#include <algorithm>
+#include <array>
+#include <chrono>
 #include <cstdint>
 #include <exception>
 #include <iostream>
+#include <memory>
+#include <utility>
+#include <vector>
 
+#include "Block_Cache.h"
 #include "Memory.h"
+#include "Opcodes.h"
+#ifdef GB_PROFILER
+#include "Profiler.h"
+#endif
 #include "Registers.h"
+#include "ROM_Image.h"
+#include "Trace.h"
+#include "X64_Assembler.h"
 
 class CPU
 {
@@ -15,97 +29,76 @@ public:
 	uint8_t And(uint8_t a, uint8_t b)
 	{
 		uint8_t r = a & b;
-		registers.Zero(r == 0);
-		registers.Negative(false);
-		registers.Carry(false);
-		registers.Half_Carry(true);
-		return a & b;
+		registers.Flags_From_And(r);
+		return r;
 	}
 
 	uint8_t Or(uint8_t a, uint8_t b)
 	{
 		uint8_t r = a | b;
-		registers.Zero(registers.A() == 0);
-		registers.Negative(false);
-		registers.Half_Carry(false);
-		registers.Carry(false);
+		registers.Flags_From_Or(r);
 		return r;
 	}
 
 	uint8_t Xor(uint8_t a, uint8_t b)
 	{
 		uint8_t r = a ^ b;
-		registers.Zero(registers.A() == 0);
-		registers.Half_Carry(false);
-		registers.Carry(false);
-		registers.Negative(false);
+		registers.Flags_From_Or(r);
 		return r;
 	}
 
 	void Compare(uint8_t a, uint8_t b)
 	{
-		registers.Zero(a == b);
-		registers.Negative(true);
-		registers.Carry(a < b);
-		registers.Half_Carry((a & 0xF) < (b & 0xF));
+		registers.Flags_From_Sub(a, b, 0);
 	}
 
 	uint8_t Adc(uint8_t a, uint8_t b)
 	{
-		b += registers.Carry() ? 1 : 0;
-		return Add(a, b);
+		return Add(a, b, registers.Carry() ? 1 : 0);
 	}
 
-	uint8_t Add(uint8_t a, uint8_t b)
+	uint8_t Add(uint8_t a, uint8_t b, uint8_t carry = 0)
 	{
-		uint8_t r = a + b;
-		uint16_t c = (static_cast<uint16_t>(a) + static_cast<uint16_t>(b)) & 0xFF00;
-		uint8_t hc = ((a & 0xF) + (b & 0xF)) & 0xF0;
-		registers.Zero(r == 0);
-		registers.Negative(false);
-		registers.Carry(c > 0);
-		registers.Half_Carry(hc > 0);
-		return r;
+		registers.Flags_From_Add(a, b, carry);
+		return a + b + carry;
 	}
 
-	uint16_t Add(uint16_t a, uint8_t b)
+	// ADD SP,i8 and LD HL,SP+i8, the flags come from the unsigned low byte addition.
+	uint16_t Add(uint16_t a, int8_t b)
 	{
-		uint16_t c = ((a & 0xFF) + b) & 0xFF00;
-		uint16_t hc = ((a & 0xF) + (b & 0xF)) & 0xF0;
+		uint8_t u = static_cast<uint8_t>(b);
 		registers.Zero(false);
 		registers.Negative(false);
-		registers.Carry(c > 0);
-		registers.Half_Carry(hc > 0);
+		registers.Carry((a & 0xFF) + u > 0xFF);
+		registers.Half_Carry((a & 0xF) + (u & 0xF) > 0xF);
 		return a + b;
 	}
 
 	uint16_t Add(uint16_t a, uint16_t b)
 	{
-		uint32_t c = (static_cast<uint32_t>(a) + static_cast<uint32_t>(b)) & 0xFFFF0000;
-		uint16_t hc = ((a & 0xFFF) + (b & 0xFFF)) & 0xF000;
+		uint32_t r = static_cast<uint32_t>(a) + static_cast<uint32_t>(b);
 		// Zero not modified.
 		registers.Negative(false);
-		registers.Carry(c > 0);
-		registers.Half_Carry(hc > 0);
-		return a + b;
+		registers.Carry(r > 0xFFFF);
+		registers.Half_Carry((a & 0xFFF) + (b & 0xFFF) > 0xFFF);
+		return static_cast<uint16_t>(r);
 	}
 
-	uint8_t Sub(uint8_t a, uint8_t b)
+	uint8_t Sbc(uint8_t a, uint8_t b)
 	{
-		uint8_t r = a - b;
-		registers.Zero(r == 0);
-		registers.Negative(true);
-		registers.Carry(a > b);
-		registers.Half_Carry((a & 0xF) > (b & 0xF));
-		return r;
+		return Sub(a, b, registers.Carry() ? 1 : 0);
+	}
+
+	uint8_t Sub(uint8_t a, uint8_t b, uint8_t carry = 0)
+	{
+		registers.Flags_From_Sub(a, b, carry);
+		return a - b - carry;
 	}
 
 	uint8_t Decrement(uint8_t r)
 	{
 		r--;
-		registers.Zero(r == 0);
-		registers.Negative(true);
-		registers.Half_Carry((r & 0xF) == 0xF);
+		registers.Flags_From_Decrement(r);
 		return r;
 	}
 
@@ -119,9 +112,7 @@ public:
 	uint8_t Increment(uint8_t r)
 	{
 		r++;
-		registers.Zero(r == 0);
-		registers.Negative(false);
-		registers.Half_Carry((r & 0xF) == 0x0);
+		registers.Flags_From_Increment(r);
 		return r;
 	}
 
@@ -132,405 +123,1198 @@ public:
 		return r;
 	}
 
-	void Update(double delta_ms)
+	// Shared by the CB rotates and shifts, Y is the operation from bits 3-5 of the CB opcode.
+	template<uint8_t Y>
+	uint8_t Shift(uint8_t v)
 	{
-		int cycles_to_complete = (delta_ms / 1000) * CYCLES_PER_SECOND;
+		uint8_t r;
+		bool carry;
+		if constexpr (Y == 0) { r = (v << 1) | (v >> 7); carry = v & 0x80; }                          // RLC
+		else if constexpr (Y == 1) { r = (v >> 1) | (v << 7); carry = v & 0x01; }                     // RRC
+		else if constexpr (Y == 2) { r = (v << 1) | (registers.Carry() ? 1 : 0); carry = v & 0x80; }  // RL
+		else if constexpr (Y == 3) { r = (v >> 1) | (registers.Carry() ? 0x80 : 0); carry = v & 0x01; } // RR
+		else if constexpr (Y == 4) { r = v << 1; carry = v & 0x80; }                                   // SLA
+		else if constexpr (Y == 5) { r = (v >> 1) | (v & 0x80); carry = v & 0x01; }                   // SRA
+		else if constexpr (Y == 6) { r = (v << 4) | (v >> 4); carry = false; }                         // SWAP
+		else { r = v >> 1; carry = v & 0x01; }                                                         // SRL
 
-		while (cycles_to_complete > 0)
+		registers.F((r == 0 ? 0x80 : 0) | (carry ? 0x10 : 0));
+		return r;
+	}
+
+	void Bit(uint8_t bit, uint8_t v)
+	{
+		registers.Zero((v & (1 << bit)) == 0);
+		registers.Negative(false);
+		registers.Half_Carry(true);
+	}
+
+	uint8_t Daa(uint8_t a)
+	{
+		bool carry = registers.Carry();
+		if (!registers.Negative())
 		{
-			if (cycles_to_complete > CYCLES_PER_SECOND * 10)
+			if (carry || a > 0x99)
 			{
-
+				a += 0x60;
+				carry = true;
 			}
-			bool jump = false;
-			uint8_t time = 0;
-			uint16_t pc = registers.PC();
-			uint8_t opcode = memory.Read8(pc);
-			switch (opcode)
+			if (registers.Half_Carry() || (a & 0x0F) > 0x09)
 			{
-			case 0x00: // NOOP
-			case 0x7F: // LD A, A
-			case 0x40: // LD B, B
-			case 0x49: // LD C, C
-			case 0x52: // LD D, D
-			case 0x5B: // LD E, E
-			case 0x64: // LD H, H
-			case 0x6D: // LD L, L
-				time = 4;
-				break;
-			case 0x01: // LD u16->BC
-				time = 12;
-				registers.BC(memory.Read16(pc + 1));
-				break;
-			case 0x02: // LD (BC)->A
-				time = 8;
-				registers.A(memory.Read8(registers.BC(), false));
-				break;
-			case 0x03: // INC BC
-				time = 8;
-				registers.BC(Increment(registers.BC()));
-				break;
-			case 0x05: // DEC B
-				time = 4;
-				registers.B(Decrement(registers.B()));
-				break;
-			case 0x06: // LD B, u8
-				time = 8;
-				registers.B(memory.Read8(pc + 1));
-				break;
-			case 0x08: // LD SP->(u16)
-				time = 20;
-				memory.Write16(memory.Read16(pc + 1), registers.SP());
-				break;
-			case 0x0B: // DEC BC
-				time = 8;
-				registers.BC(Decrement(registers.BC()));
-				break;
-			case 0x0C: // INC C
-				time = 4;
-				registers.C(Increment(registers.C()));
-				break;
-			case 0x0D: // DEC C
-				time = 4;
-				registers.C(Decrement(registers.C()));
-				break;
-			case 0x0E:
-				time = 8;
-				registers.C(memory.Read8(pc + 1));
-				break;
-			case 0x11: // LD DE
-				time = 12;
-				registers.DE(memory.Read16(pc + 1));
-				break;
-			case 0x1A: // LD (DE)->A
-				time = 8;
-				registers.A(memory.Read8(registers.DE(), false));
-				break;
-			case 0x18: // JP n
-				time = 12;
-				jump = true;
-				registers.PC(registers.PC() + memory.Read8(pc + 1) + 2);
-				break;
-			case 0x19: // ADD DE -> HL
-				time = 8;
-				registers.HL(Add(registers.HL(), registers.DE()));
-				break;
-			case 0x20: // JP NZ n
-				if (!registers.Zero())
-				{
-					time = 12;
-					jump = true;
-					registers.PC(registers.PC() + memory.Readi8(pc + 1) + 2);
-				}
-				else
-				{
-					time = 8;
-					memory.Readi8(pc + 1); // throw away read.
-				}
-				break;
-			case 0x21: // LD HL
-				time = 12;
-				registers.HL(memory.Read16(pc + 1));
-				break;
-			case 0x28: // JP Z,n
-				if (registers.Zero())
-				{
-					time = 12;
-					jump = true;
-					registers.PC(registers.PC() + memory.Read8(pc + 1));
-				}
-				else
-				{
-					time = 8;
-					memory.Read8(pc + 1); // throw away read.
-				}
-				break;
-			case 0x2A: // (HL)->A, HL++
-				time = 8;
-				registers.A(memory.Read8(registers.HL(), false));
-				registers.HL(registers.HL() + 1);
-				break;
-			case 0x31: // LD SP
-				time = 12;
-				registers.SP(memory.Read16(pc + 1));
-				break;
-			case 0x36: // LD u8->(HL)
-				time = 12;
-				memory.Write8(registers.HL(), memory.Read8(pc + 1));
-				break;
-			case 0x3E: // LD A
-				time = 8;
-				registers.A(memory.Read8(pc + 1));
-				break;
-			case 0x32: // Store A->(HL); HL--
-				time = 8;
-				memory.Write8(registers.HL(), registers.A());
-				registers.HL(registers.HL() - 1);
-				break;
-			case 0x42: // LD D->B
-				time = 4;
-				registers.B(registers.D());
-				break;
-			case 0x46: // LD (HL)->B
-				time = 8;
-				registers.B(memory.Read8(registers.HL(), false));
-				break;
-			case 0x70: // LD B->(HL)
-				time = 8;
-				memory.Write8(registers.HL(), registers.B());
-				break;
-			case 0x71: // LD C->(HL)
-				time = 8;
-				memory.Write8(registers.HL(), registers.C());
-				break;
-			case 0x72: // LD D->(HL)
-				time = 8;
-				memory.Write8(registers.HL(), registers.D());
-				break;
-			case 0x73: // LD E->(HL)
-				time = 8;
-				memory.Write8(registers.HL(), registers.E());
-				break;
-			case 0x74: // LD H->(HL)
-				time = 8;
-				memory.Write8(registers.HL(), registers.H());
-				break;
-			case 0x75: // LD L->(HL)
-				time = 8;
-				memory.Write8(registers.HL(), registers.L());
-				break;
-			case 0x77: // LD A->(HL)
-				time = 8;
-				memory.Write8(registers.HL(), registers.A());
-				break;
-			case 0x78: // LD B->A
-				time = 4;
-				registers.A(registers.B());
-				break;
-			case 0x79: // LD C->A
-				time = 4;
-				registers.A(registers.C());
-				break;
-			case 0x7A: // LD D->A
-				time = 4;
-				registers.A(registers.D());
-				break;
-			case 0x7B: // LD E->A
-				time = 4;
-				registers.A(registers.E());
-				break;
-			case 0x7C: // LD H->A
-				time = 4;
-				registers.A(registers.H());
-				break;
-			case 0x7D: // LD L->A
-				time = 4;
-				registers.A(registers.L());
-				break;
-			case 0x7E: // LD (HL)->A
-				time = 8;
-				registers.A(memory.Read8(registers.HL(), false));
-				break;
-			case 0x80: // ADD B->A
-				time = 4;
-				registers.A(Add(registers.A(), registers.B()));
-				break;
-			case 0x81: // ADD C->A
-				time = 4;
-				registers.A(Add(registers.A(), registers.C()));
-				break;
-			case 0x82: // ADD D->A
-				time = 4;
-				registers.A(Add(registers.A(), registers.D()));
-				break;
-			case 0x83: // ADD E->A
-				time = 4;
-				registers.A(Add(registers.A(), registers.E()));
-				break;
-			case 0x84: // ADD H->A
-				time = 4;
-				registers.A(Add(registers.A(), registers.H()));
-				break;
-			case 0x85: // ADD L->A
-				time = 4;
-				registers.A(Add(registers.A(), registers.L()));
-				break;
-			case 0x86: // ADD (HL)->A
-				time = 8;
-				registers.A(Add(registers.A(), memory.Read8(registers.HL(), false)));
-				break;
-			case 0x87: // ADD A->A
-				time = 4;
-				registers.A(Add(registers.A(), registers.A()));
-				break;
-			case 0x88: // ADC B->A
-				time = 4;
-				registers.A(Adc(registers.A(), registers.B()));
-				break;
-			case 0x89: // ADC C->A
-				time = 4;
-				registers.A(Adc(registers.A(), registers.C()));
-				break;
-			case 0x8A: // ADC D->A
-				time = 4;
-				registers.A(Adc(registers.A(), registers.D()));
-				break;
-			case 0x8B: // ADC E->A
-				time = 4;
-				registers.A(Adc(registers.A(), registers.E()));
-				break;
-			case 0x8C: // ADC H->A
-				time = 4;
-				registers.A(Adc(registers.A(), registers.H()));
-				break;
-			case 0x8D: // ADC L->A
-				time = 4;
-				registers.A(Adc(registers.A(), registers.L()));
-				break;
-			case 0x8E: // ADC (HL)->A
-				time = 8;
-				registers.A(Adc(registers.A(), memory.Read8(registers.HL(), false)));
-				break;
-			case 0x8F: // ADC A->A
-				time = 4;
-				registers.A(Adc(registers.A(), registers.A()));
-				break;
-			case 0x95: // SUB A, L
-				time = 4;
-				registers.A(Sub(registers.A(), registers.L()));
-				break;
-			case 0xA7: // AND A,A
-				time = 4;
-				registers.A(And(registers.A(), registers.A()));
-				break;
-			case 0xAF: // XOR A
-				time = 4;
-				registers.A(Xor(registers.A(), registers.A()));
-				break;
-			case 0xB1: // OR A, C
-				time = 4;
-				registers.A(Or(registers.A(), registers.C()));
-				break;
-			case 0xC0: // RET NZ
-				if (!registers.Zero())
-				{
-					time = 20;
-					registers.PC(memory.Read16(registers.SP(), false) + 1);
-					registers.SP(registers.SP() + 2);
-					jump = true;
-				}
-				else
-				{
-					time = 8;
-				}
-				break;
-			case 0xC1: // POP BC
-				time = 12;
-				registers.BC(memory.Read16(registers.SP(), false));
-				registers.SP(registers.SP() + 1);
-				break;
-			case 0xC3: // JP
-				time = 16;
-				jump = true;
-				registers.PC(memory.Read16(pc + 1));
-				break;
-			case 0xC5: // PUSH BC
-				time = 16;
-				registers.SP(registers.SP() - 2);
-				memory.Write16(registers.SP(), registers.BC());
-				break;
-			case 0xC9: // RET
-				time = 16;
-				jump = true;
-				registers.PC(memory.Read16(registers.SP(), false) + 1);
-				registers.SP(registers.SP() + 2);
-				break;
-			case 0xCC: // CALL Z
-				if (registers.Zero())
-				{
-					time = 24;
-					jump = true;
-					registers.SP(registers.SP() - 2);
-					memory.Write16(registers.SP(), registers.PC());
-					registers.PC(memory.Read16(pc + 1));
-				}
-				else
+				a += 0x06;
+			}
+		}
+		else
+		{
+			a -= carry ? 0x60 : 0;
+			a -= registers.Half_Carry() ? 0x06 : 0;
+		}
+
+		registers.Zero(a == 0);
+		registers.Half_Carry(false);
+		registers.Carry(carry);
+		return a;
+	}
+
+	// Runs at least the given number of cycles and returns how many were actually run.
+	uint64_t Run(int cycles)
+	{
+		int cycles_to_complete = cycles;
+		uint64_t cycles_run = 0;
+
+		while (cycles_to_complete > 0)
+		{
+			uint32_t time = Run_Block(cycles_to_complete);
+			cycles_to_complete -= time;
+			cycles_run += time;
+
+			// Kept current after every block so Clock() is right for anything that reads it mid slice.
+			_cycles += time;
+			_block_offset = 0;
+		}
+
+		return cycles_run;
+	}
+
+	// Services a pending interrupt or executes a single instruction, returning the cycles it took.
+	uint8_t Step()
+	{
+		uint8_t time = Check_Interrupts();
+		if (time)
+		{
+			return time;
+		}
+
+		return Execute_Instruction();
+	}
+
+	// Like Step, but runs a whole cached block at a time, stopping early once the budget is spent.
+	uint32_t Run_Block(int budget)
+	{
+		uint8_t interrupt_time = Check_Interrupts();
+		if (interrupt_time)
+		{
+			// Nothing can wake a halted CPU before the budget runs out, so skip straight to its end.
+			if (_halted || _locked)
+			{
+				uint32_t idle_time = std::max<uint32_t>(interrupt_time, (budget + 3) & ~3);
+#ifdef GB_PROFILER
+				if (_profiler)
 				{
-					time = 12;
-					memory.Read16(pc + 1); // Throw away read.
+					_profiler->Record_Idle(idle_time);
 				}
-				break;
-			case 0xCD: // Call
-				time = 24;
-				jump = true;
-				registers.SP(registers.SP() - 2);
-				memory.Write16(registers.SP(), registers.PC());
-				registers.PC(memory.Read16(pc + 1));
-				break;
-			case 0xD0: // RET NC
-				if (!registers.Carry())
+#endif
+				return idle_time;
+			}
+#ifdef GB_PROFILER
+			if (_profiler)
+			{
+				_profiler->Record_Interrupt(interrupt_time);
+			}
+#endif
+			return interrupt_time;
+		}
+
+		auto* block = Get_Block(registers.PC());
+		if (!block)
+		{
+			if (_tracer)
+			{
+				uint16_t pc = registers.PC();
+				Trace_Instruction(memory.Read8(pc), memory.Read8(pc + 1));
+			}
+			return Execute_Instruction();
+		}
+
+#ifdef GB_PROFILER
+		if (_profiler)
+		{
+			return Run_Profiled_Block(*block, budget);
+		}
+#endif
+
+		if (block->idle_tries && _ime_delay == 0 && !_tracer && !memory.Code_Changed())
+		{
+			return Run_Idle_Loop(*block, budget);
+		}
+
+#ifdef GB_JIT_SUPPORTED
+		if (_jit_enabled && _ime_delay == 0 && !_tracer)
+		{
+			const auto* native = Get_Native_Block(*block);
+			if (native && native->max_cycles <= static_cast<uint32_t>(budget))
+			{
+				return Run_Native_Block(*block, *native);
+			}
+		}
+#endif
+
+		return _tracer ? Interpret_Block<false, true>(*block, budget) : Interpret_Block<false, false>(*block, budget);
+	}
+
+	// Records every instruction to the writer until set back to null. Recompiled blocks are not used meanwhile.
+	void Set_Tracer(Trace_Writer* tracer) { _tracer = tracer; }
+
+	// Decodes the ROM blocks with these keys ahead of reaching them, each from its own bank whatever is mapped now.
+	// Blocks that run on into the next block are followed. A block that would read past its half of the address space,
+	// into a bank that can't be known, is left to be decoded when it is reached.
+	void Prewarm(const std::vector<uint32_t>& keys)
+	{
+		const ROM_Image& rom = *memory.Shared_ROM();
+		for (uint32_t key : keys)
+		{
+			uint16_t bank = key >> 16;
+			uint16_t pc = static_cast<uint16_t>(key);
+			while (bank < rom.Bank_Count() && pc < 0x8000 && !_blocks.Find(Block_Cache<Decoded_Instruction>::Key(bank, pc)))
+			{
+				const uint8_t* data = rom.Data() + bank * ROM_Image::BANK_SIZE;
+				std::vector<Decoded_Instruction> instructions;
+				uint16_t end = Decode_Instructions(pc, [data](uint16_t address) { return data[address & (ROM_Image::BANK_SIZE - 1)]; }, instructions);
+				if ((pc ^ static_cast<uint16_t>(end - 1)) & ROM_Image::BANK_SIZE)
 				{
-					time = 20;
-					registers.PC(memory.Read16(registers.SP(), false) + 1);
-					registers.SP(registers.SP() + 2);
-					jump = true;
+					break;
 				}
-				else
+
+				bool continues = !Ends_Block(instructions.back().opcode);
+				Insert_Block(Block_Cache<Decoded_Instruction>::Key(bank, pc), pc, std::move(instructions), pc >> 8, static_cast<uint16_t>(end - 1) >> 8, false);
+				if (!continues || ((pc ^ end) & ROM_Image::BANK_SIZE))
 				{
-					time = 8;
+					break;
 				}
-				break;
-			case 0xE0: // LD A->(FF00 + u8)
-				time = 12;
-				memory.Write8(memory.Read8(pc + 1) + 0xFF00, registers.A());
-				break;
-			case 0xE2: // LD A->(FF00 + C)
-				time = 8;
-				memory.Write8(registers.C() + 0xFF00, registers.A());
-				break;
-			case 0xE8: // ADD SP,u8
-				time = 16;
-				registers.SP(Add(registers.SP(), memory.Read8(pc + 1)));
-				break;
-			case 0xEA: // LD A
-				time = 16;
-				memory.Write8(memory.Read16(pc + 1), registers.A());
-				break;
-			case 0xF0: // LD (0xFF00 + u8)->A
-				time = 12;
-				registers.A(memory.Read8(0xFF00 + memory.Read8(pc + 1), false));
-				break;
-			case 0xFA: // LD (u16)->A
-				time = 16;
-				registers.A(memory.Read8(memory.Read16(pc + 1), false));
-				break;
-			case 0xF3:
-				time = 4;
-				// TODO: Disable interupts
-				break;
-			case 0xFE: // CP A,n
-				time = 8;
-				Compare(registers.A(), memory.Read8(pc + 1));
-				break;
-			default:
-				std::cout << "Missing Instruction: " << std::hex << opcode << std::endl;
-				std::terminate();
-				break;
+				pc = end;
 			}
+		}
+	}
 
-			// If we didn't jump somewhere then move the program counter.
-			if (!jump)
+	// The keys of every block decoded from ROM so far, for Prewarm next time.
+	std::vector<uint32_t> ROM_Block_Keys()
+	{
+		std::vector<uint32_t> keys;
+		_blocks.For_Each([&keys](const Block& block)
+		{
+			if ((block.key & 0xFFFF) < 0x8000)
 			{
-				registers.PC(registers.PC() + memory.Read_Count());
+				keys.push_back(block.key);
 			}
+		});
+		return keys;
+	}
 
-			memory.Reset_Read_Count();
-			cycles_to_complete -= time;
-		}
+#ifdef GB_PROFILER
+	// Profiling attributes cycles to each instruction, so recompiled blocks are not used while it is attached.
+	void Set_Profiler(Profiler* profiler) { _profiler = profiler; }
+	Profiler* Get_Profiler() { return _profiler; }
+#endif
+
+#ifdef GB_JIT_SUPPORTED
+	// Opt in to recompiling hot ROM blocks into x86-64, blocks in RAM or touching IO stay interpreted.
+	void Enable_JIT(bool enable) { _jit_enabled = enable; }
+	bool JIT_Enabled() { return _jit_enabled; }
+#endif
+
+	void Save_State(State_Writer& writer)
+	{
+		writer.Write(_cycles);
+		writer.Write(_instructions);
+		writer.Write(_ime);
+		writer.Write(_ime_delay);
+		writer.Write(_halted);
+		writer.Write(_locked);
+	}
+
+	// Call after Memory::Load_State, so blocks decoded from the old RAM contents are dropped here.
+	void Load_State(State_Reader& reader)
+	{
+		reader.Read(_cycles);
+		reader.Read(_instructions);
+		reader.Read(_ime);
+		reader.Read(_ime_delay);
+		reader.Read(_halted);
+		reader.Read(_locked);
+		_block_offset = 0;
+
+		memory.Take_Written_Code_Pages([this](uint8_t page) { _blocks.Invalidate_Page(page); });
+	}
+
+	// What Save_State keeps, straight from another instance, then as Load_State. Memory has to be copied first.
+	void Copy_State(const CPU& other)
+	{
+		_cycles = other._cycles;
+		_instructions = other._instructions;
+		_ime = other._ime;
+		_ime_delay = other._ime_delay;
+		_halted = other._halted;
+		_locked = other._locked;
+		_block_offset = 0;
+
+		memory.Take_Written_Code_Pages([this](uint8_t page) { _blocks.Invalidate_Page(page); });
+	}
+
+	uint64_t Cycles() { return _cycles; }
+
+	// The cycle the current instruction started on. Only the block's last instruction can branch,
+	// so the offset of every instruction into its block is known when it is decoded.
+	uint64_t Clock() const { return _cycles + _block_offset; }
+	uint64_t Instructions() { return _instructions; }
+	bool Halted() { return _halted; }
+	bool Locked() { return _locked; }
+
+	// True when the next Step is an ordinary instruction: the CPU is awake, no interrupt is about to be taken and no
+	// EI is waiting to take effect.
+	bool Next_Step_Is_Instruction()
+	{
+		return !_halted && !_locked && _ime_delay == 0 && !(_ime && (memory.IO(Memory::IO_Type::IF) & memory.Interrupt_Enable() & 0x1F));
+	}
+
+	// Accounts for instructions executed on this CPU's behalf, through the registers and memory, by Lockstep_Engine.
+	void Retire(uint64_t cycles, uint64_t instructions)
+	{
+		_cycles += cycles;
+		_instructions += instructions;
 	}
 
-private:
 	const static uint32_t CYCLES_PER_SECOND = 4194304;
-	Memory& memory;
-	Registers &registers;
-};
\ No newline at end of file
+
+private:
+	using Handler = uint8_t (CPU::*)(uint16_t operand);
+	using CB_Handler = uint8_t (CPU::*)();
+
+	struct Dispatch_Entry
+	{
+		Handler handler;
+		uint8_t length;
+	};
+
+	struct Decoded_Instruction
+	{
+		Handler handler;
+		uint16_t operand;
+		uint16_t next_pc;
+		uint16_t cycles_before;
+		uint8_t opcode;
+	};
+
+	using Block = Block_Cache<Decoded_Instruction>::Block;
+
+	const static std::size_t MAX_BLOCK_LENGTH = 32;
+
+	// Passes in a row a candidate idle loop may change something before it is run like any other block.
+	const static uint8_t IDLE_LOOP_TRIES = 8;
+
+	// Returns the cycles spent when an interrupt is taken or the CPU is idle, otherwise 0.
+	uint8_t Check_Interrupts()
+	{
+		uint8_t pending = memory.IO(Memory::IO_Type::IF) & memory.Interrupt_Enable() & 0x1F;
+		if (pending)
+		{
+			_halted = false;
+			if (_ime)
+			{
+				return Service_Interrupt(pending);
+			}
+		}
+
+		if (_halted || _locked)
+		{
+			return 4;
+		}
+
+		return 0;
+	}
+
+	uint8_t Execute_Instruction()
+	{
+		uint16_t pc = registers.PC();
+		const auto& entry = DISPATCH[memory.Read8(pc)];
+
+		registers.PC(pc + entry.length);
+		uint8_t time = (this->*entry.handler)(Read_Operand(pc, entry.length));
+
+		// EI takes effect after the instruction following it.
+		if (_ime_delay > 0 && --_ime_delay == 0)
+		{
+			_ime = true;
+		}
+
+		_instructions++;
+		return time;
+	}
+
+	uint16_t Read_Operand(uint16_t pc, uint8_t length)
+	{
+		if (length == 2)
+		{
+			return memory.Read8(pc + 1);
+		}
+		else if (length == 3)
+		{
+			return memory.Read16(pc + 1);
+		}
+
+		return 0;
+	}
+
+	Block* Get_Block(uint16_t pc)
+	{
+		// Echo RAM, OAM and IO are never worth caching.
+		if (pc >= 0xE000 && pc < 0xFF80)
+		{
+			return nullptr;
+		}
+
+		uint32_t key = Block_Cache<Decoded_Instruction>::Key(pc < 0x8000 ? memory.ROM_Bank(pc) : 0, pc);
+		if (auto* block = _blocks.Find(key))
+		{
+			return block;
+		}
+
+		return Decode_Block(key, pc);
+	}
+
+	Block* Decode_Block(uint32_t key, uint16_t pc)
+	{
+		std::vector<Decoded_Instruction> instructions;
+		uint16_t address = Decode_Instructions(pc, [this](uint16_t address) { return memory.Read8(address); }, instructions);
+
+		uint8_t first_page = pc >> 8;
+		uint8_t last_page = static_cast<uint16_t>(address - 1) >> 8;
+		bool in_ram = pc >= 0x8000;
+		if (in_ram)
+		{
+			for (uint32_t page = first_page; page <= last_page; page++)
+			{
+				memory.Watch_Code_Page(page);
+			}
+		}
+
+		return Insert_Block(key, pc, std::move(instructions), first_page, last_page, in_ram);
+	}
+
+	// Decodes until a control flow instruction, the length limit, or the end of the starting page, and returns the
+	// address after the last instruction.
+	template<typename Read>
+	static uint16_t Decode_Instructions(uint16_t pc, Read read, std::vector<Decoded_Instruction>& instructions)
+	{
+		uint16_t address = pc;
+		uint16_t cycles = 0;
+		while (true)
+		{
+			uint8_t opcode = read(address);
+			const auto& entry = DISPATCH[opcode];
+			uint16_t operand = entry.length == 3 ? read(address + 1) | (read(address + 2) << 8) : entry.length == 2 ? read(address + 1) : 0;
+			address += entry.length;
+			instructions.push_back({ entry.handler, operand, address, cycles, opcode });
+			cycles += opcode == 0xCB ? CB_OPCODES[operand & 0xFF].cycles : OPCODES[opcode].cycles;
+
+			if (Ends_Block(opcode) || instructions.size() >= MAX_BLOCK_LENGTH || (address >> 8) != (pc >> 8))
+			{
+				return address;
+			}
+		}
+	}
+
+	Block* Insert_Block(uint32_t key, uint16_t pc, std::vector<Decoded_Instruction> instructions, uint8_t first_page, uint8_t last_page, bool in_ram)
+	{
+		bool idle_loop = Is_Idle_Loop(pc, instructions);
+		auto* block = _blocks.Insert(key, std::move(instructions), first_page, last_page, in_ram);
+		block->idle_tries = idle_loop ? IDLE_LOOP_TRIES : 0;
+		return block;
+	}
+
+	// A block that jumps back to its own start and otherwise only changes registers, such as a loop polling LY.
+	static bool Is_Idle_Loop(uint16_t pc, const std::vector<Decoded_Instruction>& instructions)
+	{
+		const auto& jump = instructions.back();
+		uint16_t target;
+		switch (jump.opcode)
+		{
+		case 0x18: case 0x20: case 0x28: case 0x30: case 0x38: // JR
+			target = jump.next_pc + static_cast<int8_t>(jump.operand);
+			break;
+		case 0xC2: case 0xC3: case 0xCA: case 0xD2: case 0xDA: // JP
+			target = jump.operand;
+			break;
+		default:
+			return false;
+		}
+
+		return target == pc && std::all_of(instructions.begin(), instructions.end() - 1, [](const Decoded_Instruction& instruction)
+		{
+			return Changes_Only_Registers(instruction.opcode, static_cast<uint8_t>(instruction.operand));
+		});
+	}
+
+	// Runs one pass of a candidate idle loop. When the pass read nothing unsteady and left the registers as it found
+	// them, every pass after it would do the same until an event fires, and events only fire between slices. So the
+	// whole passes left in the budget are skipped, and the one it ends in is still run to stop where it always would.
+	uint32_t Run_Idle_Loop(Block& block, int budget)
+	{
+		auto before = Idle_Loop_State();
+		uint32_t unsteady_reads = memory.Unsteady_Reads();
+		uint32_t time = Interpret_Block<false, false>(block, budget);
+
+		if (_ime && (memory.IO(Memory::IO_Type::IF) & memory.Interrupt_Enable() & 0x1F))
+		{
+			return time;
+		}
+
+		if (registers.PC() != static_cast<uint16_t>(block.key) || Idle_Loop_State() != before || memory.Unsteady_Reads() != unsteady_reads)
+		{
+			block.idle_tries--;
+			return time;
+		}
+
+		block.idle_tries = IDLE_LOOP_TRIES;
+		if (static_cast<int>(time) < budget)
+		{
+			uint32_t passes = (budget - time - 1) / time;
+			time += passes * time;
+			_instructions += passes * block.instructions.size();
+		}
+
+		return time;
+	}
+
+	std::array<uint16_t, 5> Idle_Loop_State()
+	{
+		return { static_cast<uint16_t>((registers.A() << 8) | registers.F()), registers.BC(), registers.DE(), registers.HL(), registers.SP() };
+	}
+
+	// The interpreter's inner loop. The profiled version only exists when GB_PROFILER is defined.
+	template<bool PROFILED, bool TRACED>
+	uint32_t Interpret_Block(const Block& block, int budget)
+	{
+		uint32_t time = 0;
+		for (const auto& instruction : block.instructions)
+		{
+			_block_offset = instruction.cycles_before;
+			if constexpr (TRACED)
+			{
+				Trace_Instruction(instruction.opcode, static_cast<uint8_t>(instruction.operand));
+			}
+#ifdef GB_PROFILER
+			if constexpr (PROFILED)
+			{
+				uint32_t site = (block.key & 0xFFFF0000) | registers.PC();
+				registers.PC(instruction.next_pc);
+				uint32_t instruction_time = (this->*instruction.handler)(instruction.operand);
+				_profiler->Record(site, Profiler::Opcode_Index(instruction.opcode, instruction.operand), instruction_time);
+				time += instruction_time;
+			}
+			else
+#endif
+			{
+				registers.PC(instruction.next_pc);
+				time += (this->*instruction.handler)(instruction.operand);
+			}
+			_instructions++;
+
+			if (_ime_delay > 0 && --_ime_delay == 0)
+			{
+				_ime = true;
+			}
+
+			// The rest of the block may have just been overwritten.
+			if (memory.Code_Changed())
+			{
+				memory.Take_Written_Code_Pages([this](uint8_t page) { _blocks.Invalidate_Page(page); });
+				break;
+			}
+
+			// Stop at the budget, or early when the block itself raised or enabled an interrupt.
+			if (static_cast<int>(time) >= budget || (_ime && (memory.IO(Memory::IO_Type::IF) & memory.Interrupt_Enable() & 0x1F)))
+			{
+				break;
+			}
+		}
+
+		return time;
+	}
+
+	// Called with PC still on the instruction, before it runs.
+	void Trace_Instruction(uint8_t opcode, uint8_t operand)
+	{
+		uint16_t pc = registers.PC();
+		_tracer->Record({
+			Clock(), pc < 0x8000 ? memory.ROM_Bank(pc) : uint16_t(0), pc, registers.SP(), opcode, operand,
+			registers.A(), registers.F(), registers.B(), registers.C(), registers.D(), registers.E(), registers.H(), registers.L()
+		});
+	}
+
+#ifdef GB_PROFILER
+	// Only every HOST_SAMPLE_PERIOD-th block pays for reading the host clock.
+	uint32_t Run_Profiled_Block(const Block& block, int budget)
+	{
+		if (!_profiler->Sample_Host())
+		{
+			return _tracer ? Interpret_Block<true, true>(block, budget) : Interpret_Block<true, false>(block, budget);
+		}
+
+		auto start = std::chrono::steady_clock::now();
+		uint32_t time = _tracer ? Interpret_Block<true, true>(block, budget) : Interpret_Block<true, false>(block, budget);
+		auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start);
+		_profiler->Record_Host(block.key, static_cast<uint64_t>(elapsed.count()));
+		return time;
+	}
+
+	Profiler* _profiler = nullptr;
+#endif
+
+	Trace_Writer* _tracer = nullptr;
+
+	// Mirrors the checks Run_Block makes between instructions.
+	bool Should_Stop_Block()
+	{
+		return memory.Code_Changed() || (_ime && (memory.IO(Memory::IO_Type::IF) & memory.Interrupt_Enable() & 0x1F));
+	}
+
+#ifdef GB_JIT_SUPPORTED
+	struct Native_Block
+	{
+		X64_Assembler::Function code;
+		uint32_t max_cycles;
+	};
+
+	const static uint32_t JIT_THRESHOLD = 8;
+
+	// Generated code calls back into the interpreter through these for anything it doesn't inline.
+	// The argument carries the operand in the low half and the instruction's index in the block in the high half.
+	template<uint8_t OP>
+	static uint32_t Thunk(void* context, uint32_t argument)
+	{
+		auto* cpu = static_cast<CPU*>(context);
+		cpu->_block_offset = cpu->_native_block->instructions[argument >> 16].cycles_before;
+		uint32_t time = (cpu->*DISPATCH[OP].handler)(static_cast<uint16_t>(argument));
+		if (cpu->Should_Stop_Block())
+		{
+			cpu->_native_stop_index = argument >> 16;
+			return time | X64_Assembler::STOP_BIT;
+		}
+
+		return time;
+	}
+
+	template<std::size_t... I>
+	static constexpr std::array<X64_Assembler::Thunk, 256> Make_Thunks(std::index_sequence<I...>)
+	{
+		return { { &CPU::Thunk<I>... } };
+	}
+
+	const Native_Block* Get_Native_Block(Block& block)
+	{
+		if (!block.native && ++block.executions >= JIT_THRESHOLD)
+		{
+			block.native = Compile_Block(block);
+		}
+
+		return block.native == &NOT_COMPILABLE ? nullptr : static_cast<const Native_Block*>(block.native);
+	}
+
+	static bool Touches_IO(const Decoded_Instruction& instruction)
+	{
+		switch (instruction.opcode)
+		{
+		case 0xE0: case 0xE2: case 0xF0: case 0xF2: // LDH
+			return true;
+		case 0x08: case 0xEA: case 0xFA: // Absolute addressing
+			return instruction.operand >= 0xFF00;
+		default:
+			return false;
+		}
+	}
+
+	const void* Compile_Block(const Block& block)
+	{
+		// Code in RAM can be rewritten under us and IO needs exact ordering, leave both to the interpreter.
+		uint16_t start = block.instructions.front().next_pc - OPCODES[block.instructions.front().opcode].length;
+		if (start >= 0x8000)
+		{
+			return &NOT_COMPILABLE;
+		}
+
+		uint32_t max_cycles = 0;
+		for (const auto& instruction : block.instructions)
+		{
+			if (Touches_IO(instruction))
+			{
+				return &NOT_COMPILABLE;
+			}
+
+			max_cycles += instruction.opcode == 0xCB ? CB_OPCODES[instruction.operand & 0xFF].cycles : OPCODES[instruction.opcode].cycles_taken;
+		}
+
+		const uint8_t pc = static_cast<uint8_t>(Registers::Offset_PC());
+		_assembler.Begin();
+		for (std::size_t i = 0; i < block.instructions.size(); i++)
+		{
+			const auto& instruction = block.instructions[i];
+			if (!Emit_Inline(instruction))
+			{
+				// Handlers that branch or look at the PC need it to point past the instruction.
+				_assembler.Store16(pc, instruction.next_pc);
+				_assembler.Call(THUNKS[instruction.opcode], instruction.operand | static_cast<uint32_t>(i << 16));
+			}
+		}
+
+		const auto& last = block.instructions.back();
+		if (!Ends_Block(last.opcode))
+		{
+			_assembler.Store16(pc, last.next_pc);
+		}
+
+		auto code = _assembler.Finish(_executable_memory);
+		if (!code)
+		{
+			return &NOT_COMPILABLE;
+		}
+
+		_native_blocks.push_back(std::make_unique<Native_Block>(Native_Block{ code, max_cycles }));
+		return _native_blocks.back().get();
+	}
+
+	// Register moves, immediate loads, 16 bit INC/DEC and unconditional jumps don't touch flags or memory,
+	// so they are written straight into the register file.
+	bool Emit_Inline(const Decoded_Instruction& instruction)
+	{
+		uint8_t op = instruction.opcode;
+		uint8_t x = op >> 6;
+		uint8_t y = (op >> 3) & 7;
+		uint8_t z = op & 7;
+
+		if (op == 0x00) // NOP
+		{
+		}
+		else if (x == 1 && y != 6 && z != 6) // LD r,r
+		{
+			_assembler.Move8(R8_Offset(y), R8_Offset(z));
+		}
+		else if (x == 0 && z == 6 && y != 6) // LD r,u8
+		{
+			_assembler.Store8(R8_Offset(y), static_cast<uint8_t>(instruction.operand));
+		}
+		else if (x == 0 && z == 1 && (y & 1) == 0) // LD rr,u16
+		{
+			_assembler.Store16(R16_Offset(y >> 1), instruction.operand);
+		}
+		else if (x == 0 && z == 3) // INC/DEC rr
+		{
+			if ((y & 1) == 0)
+			{
+				_assembler.Increment16(R16_Offset(y >> 1));
+			}
+			else
+			{
+				_assembler.Decrement16(R16_Offset(y >> 1));
+			}
+		}
+		else if (op == 0xF9) // LD SP,HL
+		{
+			_assembler.Move16(R16_Offset(3), R16_Offset(2));
+		}
+		else if (op == 0xC3) // JP u16
+		{
+			_assembler.Store16(static_cast<uint8_t>(Registers::Offset_PC()), instruction.operand);
+		}
+		else if (op == 0x18) // JR i8
+		{
+			_assembler.Store16(static_cast<uint8_t>(Registers::Offset_PC()), instruction.next_pc + static_cast<int8_t>(instruction.operand));
+		}
+		else
+		{
+			return false;
+		}
+
+		_assembler.Add_Cycles(OPCODES[op].cycles);
+		return true;
+	}
+
+	static uint8_t R8_Offset(uint8_t r)
+	{
+		switch (r)
+		{
+		case 0: return static_cast<uint8_t>(Registers::Offset_BC() + 1);
+		case 1: return static_cast<uint8_t>(Registers::Offset_BC());
+		case 2: return static_cast<uint8_t>(Registers::Offset_DE() + 1);
+		case 3: return static_cast<uint8_t>(Registers::Offset_DE());
+		case 4: return static_cast<uint8_t>(Registers::Offset_HL() + 1);
+		case 5: return static_cast<uint8_t>(Registers::Offset_HL());
+		default: return static_cast<uint8_t>(Registers::Offset_A());
+		}
+	}
+
+	static uint8_t R16_Offset(uint8_t p)
+	{
+		switch (p)
+		{
+		case 0: return static_cast<uint8_t>(Registers::Offset_BC());
+		case 1: return static_cast<uint8_t>(Registers::Offset_DE());
+		case 2: return static_cast<uint8_t>(Registers::Offset_HL());
+		default: return static_cast<uint8_t>(Registers::Offset_SP());
+		}
+	}
+
+	uint32_t Run_Native_Block(const Block& block, const Native_Block& native)
+	{
+		_native_block = &block;
+		uint32_t time = native.code(this, &registers);
+
+		if (time & X64_Assembler::STOP_BIT)
+		{
+			time &= ~X64_Assembler::STOP_BIT;
+			_instructions += _native_stop_index + 1;
+		}
+		else
+		{
+			_instructions += block.instructions.size();
+		}
+
+		// Only an EI at the end of the block can have set the delay.
+		if (_ime_delay > 0 && --_ime_delay == 0)
+		{
+			_ime = true;
+		}
+
+		if (memory.Code_Changed())
+		{
+			memory.Take_Written_Code_Pages([this](uint8_t page) { _blocks.Invalidate_Page(page); });
+		}
+
+		return time;
+	}
+
+	static const std::array<X64_Assembler::Thunk, 256> THUNKS;
+	static inline const Native_Block NOT_COMPILABLE = { nullptr, 0 };
+
+	bool _jit_enabled = false;
+	uint32_t _native_stop_index = 0;
+	const Block* _native_block = nullptr;
+	X64_Assembler _assembler;
+	Executable_Memory _executable_memory;
+	std::vector<std::unique_ptr<Native_Block>> _native_blocks;
+#endif
+
+	uint8_t Service_Interrupt(uint8_t pending)
+	{
+		uint8_t index = 0;
+		while ((pending & (1 << index)) == 0)
+		{
+			index++;
+		}
+
+		memory.IO(Memory::IO_Type::IF) &= ~(1 << index);
+		_ime = false;
+		_ime_delay = 0;
+		Push(registers.PC());
+		registers.PC(0x40 + index * 8);
+		return 20;
+	}
+
+	void Push(uint16_t v)
+	{
+		registers.SP(registers.SP() - 2);
+		memory.Write16(registers.SP(), v);
+	}
+
+	uint16_t Pop()
+	{
+		uint16_t v = memory.Read16(registers.SP());
+		registers.SP(registers.SP() + 2);
+		return v;
+	}
+
+	// B, C, D, E, H, L, (HL), A
+	template<uint8_t R>
+	uint8_t Read_R8()
+	{
+		if constexpr (R == 0) return registers.B();
+		else if constexpr (R == 1) return registers.C();
+		else if constexpr (R == 2) return registers.D();
+		else if constexpr (R == 3) return registers.E();
+		else if constexpr (R == 4) return registers.H();
+		else if constexpr (R == 5) return registers.L();
+		else if constexpr (R == 6) return memory.Read8(registers.HL());
+		else return registers.A();
+	}
+
+	template<uint8_t R>
+	void Write_R8(uint8_t v)
+	{
+		if constexpr (R == 0) registers.B(v);
+		else if constexpr (R == 1) registers.C(v);
+		else if constexpr (R == 2) registers.D(v);
+		else if constexpr (R == 3) registers.E(v);
+		else if constexpr (R == 4) registers.H(v);
+		else if constexpr (R == 5) registers.L(v);
+		else if constexpr (R == 6) memory.Write8(registers.HL(), v);
+		else registers.A(v);
+	}
+
+	// BC, DE, HL, SP
+	template<uint8_t P>
+	uint16_t Read_R16()
+	{
+		if constexpr (P == 0) return registers.BC();
+		else if constexpr (P == 1) return registers.DE();
+		else if constexpr (P == 2) return registers.HL();
+		else return registers.SP();
+	}
+
+	template<uint8_t P>
+	void Write_R16(uint16_t v)
+	{
+		if constexpr (P == 0) registers.BC(v);
+		else if constexpr (P == 1) registers.DE(v);
+		else if constexpr (P == 2) registers.HL(v);
+		else registers.SP(v);
+	}
+
+	// NZ, Z, NC, C
+	template<uint8_t C>
+	bool Condition()
+	{
+		if constexpr (C == 0) return !registers.Zero();
+		else if constexpr (C == 1) return registers.Zero();
+		else if constexpr (C == 2) return !registers.Carry();
+		else return registers.Carry();
+	}
+
+	// ADD, ADC, SUB, SBC, AND, XOR, OR, CP into A.
+	template<uint8_t Y>
+	void Alu(uint8_t v)
+	{
+		uint8_t a = registers.A();
+		if constexpr (Y == 0) registers.A(Add(a, v));
+		else if constexpr (Y == 1) registers.A(Adc(a, v));
+		else if constexpr (Y == 2) registers.A(Sub(a, v));
+		else if constexpr (Y == 3) registers.A(Sbc(a, v));
+		else if constexpr (Y == 4) registers.A(And(a, v));
+		else if constexpr (Y == 5) registers.A(Xor(a, v));
+		else if constexpr (Y == 6) registers.A(Or(a, v));
+		else Compare(a, v);
+	}
+
+	// Opcodes are decoded from their x/y/z/p/q bit fields at compile time, so each instantiation is one straight line handler.
+	template<uint8_t OP>
+	uint8_t Execute(uint16_t operand)
+	{
+		constexpr uint8_t x = OP >> 6;
+		constexpr uint8_t y = (OP >> 3) & 7;
+		constexpr uint8_t z = OP & 7;
+		constexpr uint8_t p = y >> 1;
+		constexpr uint8_t q = y & 1;
+		bool taken = false;
+
+		if constexpr (OP == 0xD3 || OP == 0xDB || OP == 0xDD || OP == 0xE3 || OP == 0xE4 || OP == 0xEB || OP == 0xEC || OP == 0xED || OP == 0xF4 || OP == 0xFC || OP == 0xFD) // ILLEGAL
+		{
+			// Undefined opcodes hang the real CPU.
+			_locked = true;
+		}
+		else if constexpr (OP == 0x00) // NOP
+		{
+		}
+		else if constexpr (OP == 0x08) // LD (u16),SP
+		{
+			memory.Write16(operand, registers.SP());
+		}
+		else if constexpr (OP == 0x10) // STOP
+		{
+			// Treated as HALT until there is joypad wake up.
+			_halted = true;
+		}
+		else if constexpr (OP == 0x18) // JR i8
+		{
+			registers.PC(registers.PC() + static_cast<int8_t>(operand));
+		}
+		else if constexpr (x == 0 && z == 0) // JR cc,i8
+		{
+			if (Condition<y - 4>())
+			{
+				taken = true;
+				registers.PC(registers.PC() + static_cast<int8_t>(operand));
+			}
+		}
+		else if constexpr (x == 0 && z == 1 && q == 0) // LD rr,u16
+		{
+			Write_R16<p>(operand);
+		}
+		else if constexpr (x == 0 && z == 1) // ADD HL,rr
+		{
+			registers.HL(Add(registers.HL(), Read_R16<p>()));
+		}
+		else if constexpr (x == 0 && z == 2) // LD (BC)/(DE)/(HL+)/(HL-) <-> A
+		{
+			uint16_t address = p == 0 ? registers.BC() : p == 1 ? registers.DE() : registers.HL();
+			if constexpr (q == 0)
+			{
+				memory.Write8(address, registers.A());
+			}
+			else
+			{
+				registers.A(memory.Read8(address));
+			}
+
+			if constexpr (p == 2)
+			{
+				registers.HL(address + 1);
+			}
+			else if constexpr (p == 3)
+			{
+				registers.HL(address - 1);
+			}
+		}
+		else if constexpr (x == 0 && z == 3) // INC/DEC rr
+		{
+			Write_R16<p>(q == 0 ? Increment(Read_R16<p>()) : Decrement(Read_R16<p>()));
+		}
+		else if constexpr (x == 0 && z == 4) // INC r
+		{
+			Write_R8<y>(Increment(Read_R8<y>()));
+		}
+		else if constexpr (x == 0 && z == 5) // DEC r
+		{
+			Write_R8<y>(Decrement(Read_R8<y>()));
+		}
+		else if constexpr (x == 0 && z == 6) // LD r,u8
+		{
+			Write_R8<y>(static_cast<uint8_t>(operand));
+		}
+		else if constexpr (x == 0 && y < 4) // RLCA, RRCA, RLA, RRA
+		{
+			registers.A(Shift<y>(registers.A()));
+			registers.Zero(false);
+		}
+		else if constexpr (OP == 0x27) // DAA
+		{
+			registers.A(Daa(registers.A()));
+		}
+		else if constexpr (OP == 0x2F) // CPL
+		{
+			registers.A(~registers.A());
+			registers.Negative(true);
+			registers.Half_Carry(true);
+		}
+		else if constexpr (OP == 0x37 || OP == 0x3F) // SCF, CCF
+		{
+			registers.Negative(false);
+			registers.Half_Carry(false);
+			registers.Carry(OP == 0x37 ? true : !registers.Carry());
+		}
+		else if constexpr (OP == 0x76) // HALT
+		{
+			_halted = true;
+		}
+		else if constexpr (x == 1) // LD r,r
+		{
+			Write_R8<y>(Read_R8<z>());
+		}
+		else if constexpr (x == 2) // ALU A,r
+		{
+			Alu<y>(Read_R8<z>());
+		}
+		else if constexpr (x == 3 && z == 0 && y < 4) // RET cc
+		{
+			if (Condition<y>())
+			{
+				taken = true;
+				registers.PC(Pop());
+			}
+		}
+		else if constexpr (OP == 0xE0) // LD (FF00+u8),A
+		{
+			memory.Write8(0xFF00 + operand, registers.A());
+		}
+		else if constexpr (OP == 0xE8) // ADD SP,i8
+		{
+			registers.SP(Add(registers.SP(), static_cast<int8_t>(operand)));
+		}
+		else if constexpr (OP == 0xF0) // LD A,(FF00+u8)
+		{
+			registers.A(memory.Read8(0xFF00 + operand));
+		}
+		else if constexpr (OP == 0xF8) // LD HL,SP+i8
+		{
+			registers.HL(Add(registers.SP(), static_cast<int8_t>(operand)));
+		}
+		else if constexpr (x == 3 && z == 1 && q == 0) // POP rr
+		{
+			if constexpr (p == 3)
+			{
+				registers.AF(Pop());
+			}
+			else
+			{
+				Write_R16<p>(Pop());
+			}
+		}
+		else if constexpr (OP == 0xC9 || OP == 0xD9) // RET, RETI
+		{
+			registers.PC(Pop());
+			if constexpr (OP == 0xD9)
+			{
+				_ime = true;
+			}
+		}
+		else if constexpr (OP == 0xE9) // JP HL
+		{
+			registers.PC(registers.HL());
+		}
+		else if constexpr (OP == 0xF9) // LD SP,HL
+		{
+			registers.SP(registers.HL());
+		}
+		else if constexpr (x == 3 && z == 2 && y < 4) // JP cc,u16
+		{
+			if (Condition<y>())
+			{
+				taken = true;
+				registers.PC(operand);
+			}
+		}
+		else if constexpr (OP == 0xE2) // LD (FF00+C),A
+		{
+			memory.Write8(0xFF00 + registers.C(), registers.A());
+		}
+		else if constexpr (OP == 0xEA) // LD (u16),A
+		{
+			memory.Write8(operand, registers.A());
+		}
+		else if constexpr (OP == 0xF2) // LD A,(FF00+C)
+		{
+			registers.A(memory.Read8(0xFF00 + registers.C()));
+		}
+		else if constexpr (OP == 0xFA) // LD A,(u16)
+		{
+			registers.A(memory.Read8(operand));
+		}
+		else if constexpr (OP == 0xC3) // JP u16
+		{
+			registers.PC(operand);
+		}
+		else if constexpr (OP == 0xCB) // PREFIX CB
+		{
+			return (this->*CB_DISPATCH[operand & 0xFF])();
+		}
+		else if constexpr (OP == 0xF3) // DI
+		{
+			_ime = false;
+			_ime_delay = 0;
+		}
+		else if constexpr (OP == 0xFB) // EI
+		{
+			_ime_delay = 2;
+		}
+		else if constexpr (x == 3 && z == 4) // CALL cc,u16
+		{
+			if (Condition<y>())
+			{
+				taken = true;
+				Push(registers.PC());
+				registers.PC(operand);
+			}
+		}
+		else if constexpr (x == 3 && z == 5 && q == 0) // PUSH rr
+		{
+			Push(p == 3 ? registers.AF() : Read_R16<p>());
+		}
+		else if constexpr (OP == 0xCD) // CALL u16
+		{
+			Push(registers.PC());
+			registers.PC(operand);
+		}
+		else if constexpr (x == 3 && z == 6) // ALU A,u8
+		{
+			Alu<y>(static_cast<uint8_t>(operand));
+		}
+		else // RST
+		{
+			static_assert(x == 3 && z == 7, "Opcode not decoded");
+			Push(registers.PC());
+			registers.PC(y * 8);
+		}
+
+		return taken ? OPCODES[OP].cycles_taken : OPCODES[OP].cycles;
+	}
+
+	template<uint8_t OP>
+	uint8_t Execute_CB()
+	{
+		constexpr uint8_t x = OP >> 6;
+		constexpr uint8_t y = (OP >> 3) & 7;
+		constexpr uint8_t z = OP & 7;
+
+		if constexpr (x == 0) // Rotates and shifts
+		{
+			Write_R8<z>(Shift<y>(Read_R8<z>()));
+		}
+		else if constexpr (x == 1) // BIT
+		{
+			Bit(y, Read_R8<z>());
+		}
+		else if constexpr (x == 2) // RES
+		{
+			Write_R8<z>(Read_R8<z>() & ~(1 << y));
+		}
+		else // SET
+		{
+			Write_R8<z>(Read_R8<z>() | (1 << y));
+		}
+
+		return CB_OPCODES[OP].cycles;
+	}
+
+	template<std::size_t... I>
+	static constexpr std::array<Dispatch_Entry, 256> Make_Dispatch(std::index_sequence<I...>)
+	{
+		return { { Dispatch_Entry{ &CPU::Execute<I>, OPCODES[I].length }... } };
+	}
+
+	template<std::size_t... I>
+	static constexpr std::array<CB_Handler, 256> Make_CB_Dispatch(std::index_sequence<I...>)
+	{
+		return { { &CPU::Execute_CB<I>... } };
+	}
+
+	static const std::array<Dispatch_Entry, 256> DISPATCH;
+	static const std::array<CB_Handler, 256> CB_DISPATCH;
+
+	Memory& memory;
+	Registers &registers;
+
+	uint64_t _cycles = 0;
+	uint16_t _block_offset = 0;
+	uint64_t _instructions = 0;
+
+	Block_Cache<Decoded_Instruction> _blocks;
+
+	bool _ime = false;
+	uint8_t _ime_delay = 0;
+	bool _halted = false;
+	bool _locked = false;
+};
+
+inline constexpr std::array<CPU::Dispatch_Entry, 256> CPU::DISPATCH = CPU::Make_Dispatch(std::make_index_sequence<256>{});
+inline constexpr std::array<CPU::CB_Handler, 256> CPU::CB_DISPATCH = CPU::Make_CB_Dispatch(std::make_index_sequence<256>{});
+
+#ifdef GB_JIT_SUPPORTED
+inline constexpr std::array<X64_Assembler::Thunk, 256> CPU::THUNKS = CPU::Make_Thunks(std::make_index_sequence<256>{});
+#endif
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cctype>
+#include <iostream>
+#include <limits>
+#include <stdexcept>
+#include <string>
+
+// Reads an option's value as a whole decimal number that fits in value. Anything else prints what was wrong and the
+// usage line and returns false, for the tool to return 1 rather than let std::stoul throw out of main.
+template<typename T>
+bool Parse_Number(const std::string& option, const char* text, T& value, const char* usage)
+{
+	std::size_t length = 0;
+	unsigned long long number = 0;
+	try
+	{
+		number = std::stoull(text, &length);
+	}
+	catch (const std::logic_error&) // std::invalid_argument or std::out_of_range.
+	{
+		length = 0;
+	}
+
+	// std::stoull also takes leading spaces, a sign and trailing junk.
+	if (length && std::isdigit(static_cast<unsigned char>(text[0])) && text[length] == '\0' && number <= std::numeric_limits<T>::max())
+	{
+		value = static_cast<T>(number);
+		return true;
+	}
+
+	std::cout << "Not a number for " << option << ": " << text << std::endl;
+	std::cout << "Usage: " << usage << std::endl;
+	return false;
+}
@@ -1,44 +1,92 @@
 #pragma once
 
-#include "Memory.h"
+#include "Joypad.h"
+#include "PPU.h"
+#include "Triple_Buffer.h"
+
+#include <atomic>
+#include <cstdint>
+#include <exception>
+#include <iostream>
 
 #include <SDL.h>
 #undef main
 
+// Owns the window. Events are handled and frames presented on the thread that called Initialize, as SDL requires,
+// and that thread does nothing else: the emulator runs on its own thread, so a vsync stall never holds it up. It
+// publishes frames through the triple buffer and reads the joypad state published here when the game reads it.
 class Display
 {
 public:
-	Display(Memory& memory) : memory(memory) {}
+    Display(Triple_Buffer<PPU::Frame>& frames) : frames(frames) {}
+
+    Display(const Display&) = delete;
+    Display& operator=(const Display&) = delete;
+
+    ~Display()
+    {
+        if (app.texture)
+        {
+            SDL_DestroyTexture(app.texture);
+        }
+
+        if (app.renderer)
+        {
+            SDL_DestroyRenderer(app.renderer);
+        }
 
-	void Initialize()
-	{
+        if (app.window)
+        {
+            SDL_DestroyWindow(app.window);
+            SDL_Quit();
+        }
+    }
+
+    void Initialize()
+    {
         initSDL();
-	}
+    }
 
-	void Update()
-	{
-        prepareScene();
+    // Presents the latest frame and handles events, call in a loop on the thread that called Initialize. With vsync
+    // presenting paces the loop, without it the loop waits briefly for events when there is no new frame.
+    void Update()
+    {
+        bool fresh = presentFrame();
+        doInput(fresh || vsync ? 0 : 1);
+    }
 
-        doInput();
+    bool Running()
+    {
+        return !quit;
+    }
+
+    // Joypad::Set_Buttons bits for the keys held, updated as each key event arrives.
+    const std::atomic<uint8_t>& Buttons()
+    {
+        return buttons;
+    }
 
-        presentScene();
-	}
 private:
-	Memory& memory;
+    Triple_Buffer<PPU::Frame>& frames;
 
     struct App
     {
-        SDL_Renderer* renderer;
-        SDL_Window* window;
+        SDL_Renderer* renderer = nullptr;
+        SDL_Window* window = nullptr;
+        SDL_Texture* texture = nullptr;
     };
 
     App app;
+    bool vsync = false;
+    std::atomic<bool> quit = false;
+    std::atomic<uint8_t> buttons = 0;
+
+    // Shade 0 to 3, lightest first.
+    static constexpr uint32_t PALETTE[4] = { 0xFFE0F8D0, 0xFF88C070, 0xFF346856, 0xFF081820 };
 
     void initSDL()
     {
-        int rendererFlags, windowFlags;
-
-        rendererFlags = SDL_RENDERER_ACCELERATED;
+        int windowFlags;
 
         windowFlags = 0;
 
@@ -48,7 +96,7 @@ private:
             std::terminate();
         }
 
-        app.window = SDL_CreateWindow("Shooter 01", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, 160, 144, windowFlags);
+        app.window = SDL_CreateWindow("GBEmulator", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, PPU::WIDTH, PPU::HEIGHT, windowFlags);
 
         if (!app.window)
         {
@@ -58,41 +106,114 @@ private:
 
         SDL_SetHint(SDL_HINT_RENDER_SCALE_QUALITY, "linear");
 
-        app.renderer = SDL_CreateRenderer(app.window, -1, rendererFlags);
+        app.renderer = SDL_CreateRenderer(app.window, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
 
         if (!app.renderer)
         {
             std::cout << "Failed to create renderer: " << SDL_GetError() << std::endl;
             std::terminate();
         }
+
+        app.texture = SDL_CreateTexture(app.renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING, PPU::WIDTH, PPU::HEIGHT);
+
+        if (!app.texture)
+        {
+            std::cout << "Failed to create texture: " << SDL_GetError() << std::endl;
+            std::terminate();
+        }
+
+        SDL_RendererInfo info;
+        vsync = SDL_GetRendererInfo(app.renderer, &info) == 0 && (info.flags & SDL_RENDERER_PRESENTVSYNC);
     }
 
-    void doInput()
+    // Uploads a new frame if the emulator has published one. With vsync every refresh is presented, without it only
+    // new frames are. Returns whether there was a new frame.
+    bool presentFrame()
     {
-        SDL_Event event;
+        bool fresh = frames.Acquire();
+        if (fresh)
+        {
+            uploadFrame(frames.Read_Buffer());
+        }
 
-        while (SDL_PollEvent(&event))
+        if (fresh || vsync)
         {
-            switch (event.type)
-            {
-            case SDL_QUIT:
-                std::terminate();
-                break;
+            SDL_RenderCopy(app.renderer, app.texture, nullptr, nullptr);
+            SDL_RenderPresent(app.renderer);
+        }
 
-            default:
-                break;
+        return fresh;
+    }
+
+    // Converts shades straight into the locked texture memory.
+    void uploadFrame(const PPU::Frame& frame)
+    {
+        void* pixels;
+        int pitch;
+        if (SDL_LockTexture(app.texture, nullptr, &pixels, &pitch) != 0)
+        {
+            return;
+        }
+
+        for (uint32_t y = 0; y < PPU::HEIGHT; y++)
+        {
+            auto* row = reinterpret_cast<uint32_t*>(static_cast<uint8_t*>(pixels) + y * pitch);
+            const uint8_t* shades = frame.data() + y * PPU::WIDTH;
+            for (uint32_t x = 0; x < PPU::WIDTH; x++)
+            {
+                row[x] = PALETTE[shades[x]];
             }
         }
+
+        SDL_UnlockTexture(app.texture);
     }
 
-    void prepareScene()
+    // Arrows, Z and X for A and B, Enter for Start and Backspace for Select.
+    static uint8_t buttonFor(SDL_Keycode key)
     {
-        SDL_SetRenderDrawColor(app.renderer, 96, 128, 255, 255);
-        SDL_RenderClear(app.renderer);
+        switch (key)
+        {
+        case SDLK_RIGHT: return Joypad::RIGHT;
+        case SDLK_LEFT: return Joypad::LEFT;
+        case SDLK_UP: return Joypad::UP;
+        case SDLK_DOWN: return Joypad::DOWN;
+        case SDLK_z: return Joypad::A;
+        case SDLK_x: return Joypad::B;
+        case SDLK_BACKSPACE: return Joypad::SELECT;
+        case SDLK_RETURN: return Joypad::START;
+        default: return 0;
+        }
     }
 
-    void presentScene()
+    // Handles the events waiting, or waits up to timeout milliseconds for the first one.
+    void doInput(int timeout)
     {
-        SDL_RenderPresent(app.renderer);
+        SDL_Event event;
+
+        if (!(timeout ? SDL_WaitEventTimeout(&event, timeout) : SDL_PollEvent(&event)))
+        {
+            return;
+        }
+
+        do
+        {
+            switch (event.type)
+            {
+            case SDL_QUIT:
+                quit = true;
+                break;
+
+            case SDL_KEYDOWN:
+                buttons.fetch_or(buttonFor(event.key.keysym.sym), std::memory_order_relaxed);
+                break;
+
+            case SDL_KEYUP:
+                buttons.fetch_and(~buttonFor(event.key.keysym.sym), std::memory_order_relaxed);
+                break;
+
+            default:
+                break;
+            }
+        } while (SDL_PollEvent(&event));
     }
-};
\ No newline at end of file
+};
@@ -0,0 +1,419 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <cstdint>
+#include <istream>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include "APU.h"
+#include "CPU.h"
+#include "Joypad.h"
+#include "MBC.h"
+#include "Memory.h"
+#include "Movie.h"
+#include "PPU.h"
+#include "Registers.h"
+#include "Rewind.h"
+#include "Save_RAM.h"
+#include "Save_State.h"
+#include "Scheduler.h"
+#include "Timer.h"
+
+// One complete Game Boy: memory, registers, CPU, cartridge, timer, PPU, joypad and APU, with no dependency on SDL.
+// The CPU runs straight to the next scheduled event, then the event fires.
+class Emulator
+{
+public:
+	const static uint32_t CYCLES_PER_FRAME = 70224;
+	static constexpr double FRAMES_PER_SECOND = double(CPU::CYCLES_PER_SECOND) / CYCLES_PER_FRAME;
+
+	Emulator(std::istream& rom) : Emulator(ROM_Image::From_Stream(rom)) {}
+
+	Emulator(std::shared_ptr<const ROM_Image> rom)
+		: memory(std::move(rom)),
+		cpu(memory, registers),
+		scheduler(&cpu, [](const void* cpu) { return static_cast<const CPU*>(cpu)->Clock(); }),
+		mbc(memory, scheduler),
+		timer(memory, scheduler),
+		ppu(memory, scheduler),
+		joypad(memory),
+		apu(memory, scheduler)
+	{
+		registers.PC(0x100);
+	}
+
+	Emulator(const Emulator&) = delete;
+	Emulator& operator=(const Emulator&) = delete;
+
+	// Runs up to the given absolute cycle. The last instruction may overshoot it, the overshoot counts toward the next call.
+	void Run_Until(uint64_t cycle)
+	{
+		_target_cycle = std::max(_target_cycle, cycle);
+		while (cpu.Cycles() < _target_cycle)
+		{
+			uint64_t slice_end = std::min(_target_cycle, scheduler.Next_Cycle());
+			if (slice_end > cpu.Cycles())
+			{
+				cpu.Run(static_cast<int>(std::min<uint64_t>(slice_end - cpu.Cycles(), CYCLES_PER_FRAME)));
+			}
+			scheduler.Run_Due();
+		}
+
+		Finish_Run();
+	}
+
+	void Run_Cycles(uint64_t cycles)
+	{
+		Run_Until(_target_cycle + cycles);
+	}
+
+	// One LCD frame worth of cycles. When throttled this sleeps to hold the real Game Boy rate of about 59.7 frames a second.
+	void Run_Frame()
+	{
+		Take_Input();
+		if (_run_ahead)
+		{
+			Run_Ahead();
+		}
+		else
+		{
+			Run_Cycles(CYCLES_PER_FRAME);
+		}
+		Finish_Frame();
+	}
+
+	// Run_Frame split around its CPU loop, for drivers that run the CPU themselves (see Lockstep_Engine). Begin_Frame
+	// returns the cycle to run to, which the driver must reach the way Run_Until does, by running the CPU up to
+	// min(target, scheduler.Next_Cycle()) and then firing what is due, before calling End_Frame. No run-ahead.
+	uint64_t Begin_Frame()
+	{
+		Take_Input();
+		_target_cycle += CYCLES_PER_FRAME;
+		return _target_cycle;
+	}
+
+	void End_Frame()
+	{
+		Finish_Run();
+		Finish_Frame();
+	}
+
+	void Run_Frames(uint32_t frames)
+	{
+		for (uint32_t i = 0; i < frames; i++)
+		{
+			Run_Frame();
+		}
+	}
+
+	void Set_Throttled(bool throttled)
+	{
+		_throttled = throttled;
+		_pace_frames = 0;
+	}
+
+	bool Throttled() { return _throttled; }
+
+	// Takes effect from the next frame. Ignored while a movie is playing.
+	void Set_Buttons(uint8_t buttons)
+	{
+		if (!_movie_playback)
+		{
+			joypad.Set_Buttons(buttons);
+		}
+	}
+
+	// Shows the frame this many frames ahead of the real one, as if input had been read that much earlier. Every
+	// frame then costs frames + 1 frames of emulation, all but one without drawing. Zero turns run-ahead off.
+	void Set_Run_Ahead(uint32_t frames)
+	{
+		_run_ahead = frames;
+	}
+
+	// Buttons published by an input thread. The joypad reads them whenever the game reads P1, except while a movie
+	// is playing or recording, when they are only sampled at the start of each frame. Null disconnects.
+	void Set_Live_Input(const std::atomic<uint8_t>* buttons)
+	{
+		_live_input = buttons;
+		Connect_Input();
+	}
+
+	// Drives the joypad from the movie, starting with its first frame on the next Run_Frame. Null stops playback.
+	void Play_Movie(const Movie* movie)
+	{
+		_movie_playback = movie;
+		_movie_start = _frame;
+		Connect_Input();
+	}
+
+	// Appends every frame's buttons to the movie from the next Run_Frame on. Null stops recording.
+	void Record_Movie(Movie* movie)
+	{
+		_movie_recording = movie;
+		_movie_start = _frame;
+		Connect_Input();
+	}
+
+	// Frames run since power on.
+	uint64_t Frame() const { return _frame; }
+
+	// Snapshots everything but the cartridge ROM into state, reusing its storage.
+	void Save_State(std::vector<uint8_t>& state)
+	{
+		State_Writer writer(state);
+		writer.Write(SAVE_STATE_MAGIC);
+		writer.Write(SAVE_STATE_VERSION);
+		writer.Write(uint32_t(0)); // Patched with the total size below.
+		writer.Write(_target_cycle);
+		writer.Write(_frame);
+		registers.Save_State(writer);
+		memory.Save_State(writer);
+		mbc.Save_State(writer);
+		cpu.Save_State(writer);
+		scheduler.Save_State(writer);
+		timer.Save_State(writer);
+		ppu.Save_State(writer);
+		joypad.Save_State(writer);
+		apu.Save_State(writer);
+
+		uint32_t size = static_cast<uint32_t>(state.size());
+		std::memcpy(state.data() + 8, &size, sizeof(size));
+	}
+
+	// Returns false, leaving the emulator untouched, if state is not a complete snapshot of this version.
+	bool Load_State(const std::vector<uint8_t>& state)
+	{
+		State_Reader header(state.data(), state.size());
+		if (header.Read<uint32_t>() != SAVE_STATE_MAGIC || header.Read<uint32_t>() != SAVE_STATE_VERSION || header.Read<uint32_t>() != state.size())
+		{
+			return false;
+		}
+
+		State_Reader reader(state.data() + 12, state.size() - 12);
+		reader.Read(_target_cycle);
+		reader.Read(_frame);
+		registers.Load_State(reader);
+		memory.Load_State(reader);
+		mbc.Load_State(reader);
+		cpu.Load_State(reader);
+		scheduler.Load_State(reader);
+		timer.Load_State(reader);
+		ppu.Load_State(reader);
+		joypad.Load_State(reader);
+		apu.Load_State(reader);
+		return reader.Ok() && reader.At_End();
+	}
+
+	// Makes child, an emulator of the same cartridge, an exact copy of this one, as loading this one's save state would.
+	// RAM is copy-on-write a 256-byte page at a time: both sides catch their first write to each page from here on,
+	// and only pages that differ are copied, so forking again into a child used before costs about a page copy per
+	// page either side has written since. The child keeps its own input, rewind and throttling settings, and should
+	// not have a battery. This seals the parent's memory first; a sealed parent is only read, so it can fork into
+	// several children on different threads at once as long as it is not run meanwhile.
+	void Fork_Into(Emulator& child)
+	{
+		memory.Seal();
+		child.Load_Fork(*this);
+	}
+
+	// Fork_Into a new emulator, which costs a full copy of RAM plus building the emulator.
+	std::unique_ptr<Emulator> Fork()
+	{
+		auto child = std::make_unique<Emulator>(memory.Shared_ROM());
+		Fork_Into(*child);
+		return child;
+	}
+
+	// Keeps a snapshot of every frame Run_Frame completes, for up to the given number of seconds. Zero turns rewind off.
+	// Over two minutes of the bundled ROMs a frame costs 30-95 bytes on average, 6-21 MB an hour, with single frames
+	// up to 2 KB where a game redraws a screen.
+	void Enable_Rewind(uint32_t seconds)
+	{
+		_rewind = seconds ? std::make_unique<Rewind_Buffer>(static_cast<std::size_t>(seconds * FRAMES_PER_SECOND)) : nullptr;
+	}
+
+	// Goes back the given number of frames, or as far as the history reaches. Returns the number of frames actually rewound.
+	uint32_t Rewind(uint32_t frames)
+	{
+		if (!_rewind)
+		{
+			return 0;
+		}
+
+		uint32_t rewound = 0;
+		while (rewound < frames && _rewind->Step_Back(_rewind_scratch))
+		{
+			rewound++;
+		}
+
+		if (rewound)
+		{
+			Load_State(_rewind_scratch);
+		}
+		return rewound;
+	}
+
+	const Rewind_Buffer* Rewind_History() const { return _rewind.get(); }
+
+	// Keeps battery backed cartridge RAM in the given file, loading what is already there. False if the cartridge
+	// has no battery or the file can't be opened.
+	bool Enable_Battery(const std::string& path)
+	{
+		_battery = nullptr;
+		if (!mbc.Has_Battery() || mbc.RAM().empty())
+		{
+			return false;
+		}
+
+		_battery = Save_RAM::Open(path, mbc.RAM().data(), mbc.RAM().size());
+		memory.Forget_Fork_Versions();
+		return _battery != nullptr;
+	}
+
+	std::string Title() { return memory.Get_Title(); }
+
+	Memory memory;
+	Registers registers;
+	CPU cpu;
+	Scheduler scheduler;
+	MBC mbc;
+	Timer timer;
+	PPU ppu;
+	Joypad joypad;
+	APU apu;
+
+private:
+	using Clock = std::chrono::steady_clock;
+
+	// More than this far behind real time (a debugger pause, a slow host) and pacing restarts instead of racing to catch up.
+	const static uint32_t MAX_FRAMES_BEHIND = 15;
+
+	// The real frame runs with its sound but undrawn, then the state is saved and the following frames run with the
+	// same input, silent and with only the last one drawn and published. Loading the state puts the real timeline back.
+	void Run_Ahead()
+	{
+		ppu.Set_Rendering(false);
+		Run_Cycles(CYCLES_PER_FRAME);
+		Save_State(_run_ahead_state);
+
+		// Battery RAM written in hidden frames never happened, so it must not reach the save file either.
+		_speculating = true;
+		apu.Set_Muted(true);
+		for (uint32_t i = 1; i <= _run_ahead; i++)
+		{
+			ppu.Set_Rendering(i == _run_ahead);
+			Run_Cycles(CYCLES_PER_FRAME);
+		}
+
+		Load_State(_run_ahead_state);
+		apu.Set_Muted(false);
+		ppu.Set_Rendering(true);
+		_speculating = false;
+	}
+
+	// Movie input only changes on frame boundaries, which is what lets a movie replay exactly. Live input is also
+	// polled here so a game halted until a button is pressed still wakes up.
+	void Take_Input()
+	{
+		if (_movie_playback)
+		{
+			joypad.Set_Buttons(_movie_playback->Buttons(static_cast<uint32_t>(_frame - _movie_start)));
+		}
+		else if (_live_input)
+		{
+			joypad.Set_Buttons(_live_input->load(std::memory_order_relaxed));
+		}
+		if (_movie_recording)
+		{
+			_movie_recording->Record(static_cast<uint32_t>(_frame - _movie_start), joypad.Buttons());
+		}
+	}
+
+	void Finish_Run()
+	{
+		apu.Flush();
+		if (_battery && !_speculating)
+		{
+			_battery->Capture();
+		}
+	}
+
+	void Finish_Frame()
+	{
+		_frame++;
+		if (_rewind)
+		{
+			Save_State(_rewind_scratch);
+			_rewind->Push(_rewind_scratch);
+		}
+
+		if (_throttled)
+		{
+			Pace();
+		}
+	}
+
+	// Runs on the child, copying the parent's state member by member. Memory goes before the CPU, which drops blocks
+	// cached from any code page that changed.
+	void Load_Fork(const Emulator& parent)
+	{
+		_target_cycle = parent._target_cycle;
+		_frame = parent._frame;
+		registers.Copy_State(parent.registers);
+		parent.memory.Fork_Into(memory);
+		mbc.Copy_Banking(parent.mbc);
+		cpu.Copy_State(parent.cpu);
+		scheduler.Copy_State(parent.scheduler);
+		timer.Copy_State(parent.timer);
+		ppu.Copy_State(parent.ppu);
+		joypad.Copy_State(parent.joypad);
+		apu.Copy_State(parent.apu);
+	}
+
+	void Connect_Input()
+	{
+		joypad.Connect(_movie_playback || _movie_recording ? nullptr : _live_input);
+	}
+
+	void Pace()
+	{
+		const auto frame_time = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(double(CYCLES_PER_FRAME) / CPU::CYCLES_PER_SECOND));
+
+		auto now = Clock::now();
+		if (_pace_frames == 0 || now - (_pace_start + frame_time * _pace_frames) > frame_time * MAX_FRAMES_BEHIND)
+		{
+			_pace_start = now;
+			_pace_frames = 0;
+		}
+
+		// Deadlines are measured from a fixed start so rounding in each sleep never accumulates.
+		_pace_frames++;
+		std::this_thread::sleep_until(_pace_start + frame_time * _pace_frames);
+	}
+
+	uint64_t _target_cycle = 0;
+	uint64_t _frame = 0;
+	bool _throttled = false;
+	Clock::time_point _pace_start;
+	uint64_t _pace_frames = 0;
+
+	const std::atomic<uint8_t>* _live_input = nullptr;
+	const Movie* _movie_playback = nullptr;
+	Movie* _movie_recording = nullptr;
+	uint64_t _movie_start = 0;
+
+	uint32_t _run_ahead = 0;
+	bool _speculating = false;
+	std::vector<uint8_t> _run_ahead_state;
+
+	std::unique_ptr<Rewind_Buffer> _rewind;
+	std::vector<uint8_t> _rewind_scratch;
+
+	// Declared after mbc, so it is destroyed first and gets to hand over the RAM's final contents.
+	std::unique_ptr<Save_RAM> _battery;
+};
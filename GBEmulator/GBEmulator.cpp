@@ -3,42 +3,376 @@
 
 #include "CPU.h"
 #include "Memory.h"
+#include "Batch_Runner.h"
+#include "Command_Line.h"
+
+#ifndef GB_NO_SDL
+#include "Audio_Device.h"
 #include "Display.h"
+#endif
 
+#include <atomic>
 #include <chrono>
+#include <filesystem>
 #include <thread>
 #include <vector>
 #include <fstream>
 #include <iostream>
+#include <string>
 
-int main()
+#ifdef GB_JIT_SUPPORTED
+// Runs every ROM with and without the recompiler and reports the first frame where they disagree.
+int Run_JIT_Differential(const std::vector<std::string>& roms, uint32_t frames)
 {
-    //std::ifstream input("drmario.gb", std::ios::binary);
-    std::ifstream input("tetris.gb", std::ios::binary);
-    //std::ifstream input("red.gb", std::ios::binary);
-    Memory memory(input);
-    Registers registers;
-    CPU cpu(memory, registers);
-    Display display(memory);
-    std::cout << memory.Get_Title() << std::endl;
-
-    registers.PC(0x100);
+    int failures = 0;
+    for (const auto& rom : roms)
+    {
+        std::ifstream interpreted_input(rom, std::ios::binary);
+        std::ifstream recompiled_input(rom, std::ios::binary);
+        Emulator interpreted(interpreted_input);
+        Emulator recompiled(recompiled_input);
+        recompiled.cpu.Enable_JIT(true);
+
+        uint32_t frame = 0;
+        for (; frame < frames; frame++)
+        {
+            interpreted.Run_Frames(1);
+            recompiled.Run_Frames(1);
+
+            auto& a = interpreted.registers;
+            auto& b = recompiled.registers;
+            if (a.PC() != b.PC() || a.SP() != b.SP() || a.AF() != b.AF() || a.BC() != b.BC() || a.DE() != b.DE() || a.HL() != b.HL()
+                || interpreted.cpu.Cycles() != recompiled.cpu.Cycles() || interpreted.memory.Checksum() != recompiled.memory.Checksum()
+                || interpreted.ppu.Checksum() != recompiled.ppu.Checksum())
+            {
+                std::cout << rom << ": JIT diverged in frame " << frame << std::hex
+                    << " (pc 0x" << a.PC() << " vs 0x" << b.PC() << ", af 0x" << a.AF() << " vs 0x" << b.AF() << ")" << std::dec << std::endl;
+                failures++;
+                break;
+            }
+        }
+
+        if (frame == frames)
+        {
+            std::cout << rom << ": JIT matches interpreter for " << frames << " frames" << std::endl;
+        }
+    }
+
+    return failures == 0 ? 0 : 1;
+}
+#endif
+
+const char* HEADLESS_USAGE = "GBEmulator --headless [--instances N] [--frames N | --cycles N] [--threads N] [--jit | --jit-diff] [--rewind N] [--save-dir DIR] [--profile DIR] [--trace DIR] [--movie FILE] [--code-cache DIR] rom [rom ...]";
+
+int Run_Headless(int argc, char* argv[])
+{
+    std::size_t instances = 1;
+    std::size_t threads = 0;
+    uint32_t frames = 60;
+    uint64_t cycles = 0;
+    bool jit = false;
+    bool jit_differential = false;
+    uint32_t rewind_frames = 0;
+    std::string save_directory;
+    std::string profile_directory;
+    std::string trace_directory;
+    std::string movie_path;
+    std::string code_cache_directory;
+    bool frames_given = false;
+    std::vector<std::string> roms;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--headless")
+        {
+            continue;
+        }
+        else if (arg == "--instances" && has_value)
+        {
+            if (!Parse_Number(arg, argv[++i], instances, HEADLESS_USAGE))
+            {
+                return 1;
+            }
+        }
+        else if (arg == "--frames" && has_value)
+        {
+            if (!Parse_Number(arg, argv[++i], frames, HEADLESS_USAGE))
+            {
+                return 1;
+            }
+            frames_given = true;
+        }
+        else if (arg == "--cycles" && has_value)
+        {
+            if (!Parse_Number(arg, argv[++i], cycles, HEADLESS_USAGE))
+            {
+                return 1;
+            }
+        }
+        else if (arg == "--threads" && has_value)
+        {
+            if (!Parse_Number(arg, argv[++i], threads, HEADLESS_USAGE))
+            {
+                return 1;
+            }
+        }
+        else if (arg == "--jit")
+        {
+            jit = true;
+        }
+        else if (arg == "--jit-diff")
+        {
+            jit_differential = true;
+        }
+        else if (arg == "--rewind" && has_value)
+        {
+            if (!Parse_Number(arg, argv[++i], rewind_frames, HEADLESS_USAGE))
+            {
+                return 1;
+            }
+        }
+        else if (arg == "--save-dir" && has_value)
+        {
+            save_directory = argv[++i];
+        }
+        else if (arg == "--profile" && has_value)
+        {
+            profile_directory = argv[++i];
+        }
+        else if (arg == "--trace" && has_value)
+        {
+            trace_directory = argv[++i];
+        }
+        else if (arg == "--movie" && has_value)
+        {
+            movie_path = argv[++i];
+        }
+        else if (arg == "--code-cache" && has_value)
+        {
+            code_cache_directory = argv[++i];
+        }
+        else if (std::ifstream(arg, std::ios::binary))
+        {
+            roms.push_back(arg);
+        }
+        else
+        {
+            std::cout << "Unknown argument or missing ROM: " << arg << std::endl;
+            return 1;
+        }
+    }
+
+    if (roms.empty())
+    {
+        roms = { "tetris.gb", "drmario.gb", "red.gb" };
+    }
+
+#ifndef GB_PROFILER
+    if (!profile_directory.empty())
+    {
+        std::cout << "Profiling needs a build with GB_PROFILER defined." << std::endl;
+        return 1;
+    }
+#endif
+
+    // Without --frames a movie plays to its end.
+    std::shared_ptr<const Movie> movie;
+    if (!movie_path.empty())
+    {
+        movie = Movie::Load(movie_path);
+        if (!movie)
+        {
+            std::cout << "Not a movie file: " << movie_path << std::endl;
+            return 1;
+        }
+        if (!frames_given)
+        {
+            frames = movie->Length();
+        }
+    }
+
+    if (jit_differential)
+    {
+#ifdef GB_JIT_SUPPORTED
+        return Run_JIT_Differential(roms, frames);
+#else
+        std::cout << "The recompiler is only available on x86-64." << std::endl;
+        return 1;
+#endif
+    }
+
+    // Instances are interleaved across the ROMs so every ROM gets the same share.
+    std::vector<Batch_Job> jobs;
+    for (std::size_t i = 0; i < instances; i++)
+    {
+        for (const auto& rom : roms)
+        {
+            // Every instance gets its own files, named after the ROM and the instance.
+            auto name = std::filesystem::path(rom).stem().string() + "." + std::to_string(i);
+            std::string save_path = save_directory.empty() ? "" : (std::filesystem::path(save_directory) / (name + ".sav")).string();
+            std::string profile_path = profile_directory.empty() ? "" : (std::filesystem::path(profile_directory) / name).string();
+            std::string trace_path = trace_directory.empty() ? "" : (std::filesystem::path(trace_directory) / (name + ".gbtrace")).string();
+            jobs.push_back({ rom, frames, cycles, jit, rewind_frames, save_path, profile_path, trace_path, movie, code_cache_directory });
+        }
+    }
+
+    Batch_Runner runner(threads);
+    auto start = std::chrono::steady_clock::now();
+    auto results = runner.Run(jobs);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    uint64_t total_cycles = 0;
+    for (std::size_t i = 0; i < results.size(); i++)
+    {
+        const auto& result = results[i];
+        total_cycles += result.cycles;
+        std::cout << i << " " << result.rom_path << " \"" << result.title << "\""
+            << " cycles=" << result.cycles
+            << " instructions=" << result.instructions
+            << " pc=0x" << std::hex << result.pc
+            << " checksum=0x" << result.checksum
+            << " frame=0x" << result.frame_checksum << std::dec;
+        if (rewind_frames > 0)
+        {
+            std::cout << " rewind=" << (result.rewind_ok ? "ok" : "MISMATCH") << " rewind_bytes=" << result.rewind_bytes;
+        }
+        if (!save_directory.empty())
+        {
+            std::cout << " battery=" << (result.battery ? "yes" : "no");
+        }
+        if (!trace_directory.empty())
+        {
+            std::cout << " trace=" << (result.trace_ok ? std::to_string(result.trace_records) : "FAILED");
+        }
+        std::cout << " seconds=" << result.seconds << std::endl;
+    }
+
+    std::cout << results.size() << " instances on " << runner.Thread_Count() << " threads in " << seconds << "s, "
+        << (total_cycles / seconds / 1000000.0) << " emulated MHz" << std::endl;
+
+    return 0;
+}
+
+int main(int argc, char* argv[])
+{
+#ifdef GB_NO_SDL
+    return Run_Headless(argc, argv);
+#else
+    for (int i = 1; i < argc; i++)
+    {
+        if (std::string(argv[i]) == "--headless")
+        {
+            return Run_Headless(argc, argv);
+        }
+    }
+
+    const char* usage = "GBEmulator [rom] [--record movie | --play movie] [--run-ahead frames]";
+    std::string rom_path = "tetris.gb";
+    std::string record_path;
+    std::string play_path;
+    uint32_t run_ahead = 0;
+    bool rom_given = false;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--record" && has_value)
+        {
+            record_path = argv[++i];
+        }
+        else if (arg == "--play" && has_value)
+        {
+            play_path = argv[++i];
+        }
+        else if (arg == "--run-ahead" && has_value)
+        {
+            if (!Parse_Number(arg, argv[++i], run_ahead, usage))
+            {
+                return 1;
+            }
+        }
+        else if (!rom_given && std::ifstream(arg, std::ios::binary))
+        {
+            rom_path = arg;
+            rom_given = true;
+        }
+        else
+        {
+            std::cout << "Unknown argument or missing ROM: " << arg << std::endl;
+            return 1;
+        }
+    }
+    std::ifstream input(rom_path, std::ios::binary);
+    Emulator emulator(input);
+    emulator.Enable_Battery(std::filesystem::path(rom_path).replace_extension(".sav").string());
+    Triple_Buffer<PPU::Frame> frames;
+    Display display(frames);
+    std::cout << emulator.Title() << std::endl;
+
+    emulator.ppu.Publish_Frames(&frames);
     display.Initialize();
 
+    // Declared after the display, so the device closes before SDL shuts down.
+    Audio_Ring samples(Audio_Device::RING_FRAMES);
+    Audio_Device audio(samples);
+    if (audio.Initialize())
+    {
+        emulator.apu.Publish_Audio(&samples, audio.Sample_Rate());
+    }
+
+    // Run_Frame sleeps to hold 59.7 Hz, so the loop needs no timing of its own.
+    Movie recording(emulator.memory.ROM().Hash());
+    std::unique_ptr<Movie> playback;
+    if (!record_path.empty())
+    {
+        emulator.Record_Movie(&recording);
+    }
+    else if (!play_path.empty())
+    {
+        playback = Movie::Load(play_path);
+        if (!playback)
+        {
+            std::cout << "Not a movie file: " << play_path << std::endl;
+            return 1;
+        }
+        if (playback->ROM_Hash() != emulator.memory.ROM().Hash())
+        {
+            std::cout << "The movie is of another cartridge: " << play_path << std::endl;
+            return 1;
+        }
+        emulator.Play_Movie(playback.get());
+    }
 
-    auto last_time = std::chrono::high_resolution_clock::now();
-    while (true)
+    // This thread only presents frames and handles input from here on, emulation gets a thread of its own.
+    emulator.Set_Live_Input(&display.Buttons());
+    emulator.Set_Run_Ahead(run_ahead);
+    emulator.Set_Throttled(true);
+    std::atomic<bool> running = true;
+    std::thread emulation([&emulator, &running]
     {
-        std::this_thread::sleep_for(std::chrono::milliseconds(1));
-        auto now_time = std::chrono::high_resolution_clock::now();
-        double delta_ms = std::chrono::duration<double, std::milli>(now_time - last_time).count();
-        last_time = last_time;
+        while (running.load(std::memory_order_relaxed))
+        {
+            emulator.Run_Frame();
+        }
+    });
 
-        cpu.Update(delta_ms);
+    while (display.Running())
+    {
         display.Update();
     }
 
+    running = false;
+    emulation.join();
+
+    if (!record_path.empty())
+    {
+        recording.Save(record_path);
+    }
+
     return 0;
+#endif
 }
 
 // Run program: Ctrl + F5 or Debug > Start Without Debugging menu
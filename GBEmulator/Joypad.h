@@ -0,0 +1,124 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+#include "Memory.h"
+#include "Save_State.h"
+
+// The P1 register. The game selects the direction keys, the action buttons or both, and reads the selected
+// lines back active low.
+class Joypad
+{
+public:
+	// Bit masks for Set_Buttons, a set bit is a held button.
+	const static uint8_t RIGHT = 0x01;
+	const static uint8_t LEFT = 0x02;
+	const static uint8_t UP = 0x04;
+	const static uint8_t DOWN = 0x08;
+	const static uint8_t A = 0x10;
+	const static uint8_t B = 0x20;
+	const static uint8_t SELECT = 0x40;
+	const static uint8_t START = 0x80;
+
+	Joypad(Memory& memory) : _memory(memory)
+	{
+		_memory.Set_IO_Handler(P1, this, &Joypad::Read_P1, &Joypad::Write_P1);
+	}
+
+	Joypad(const Joypad&) = delete;
+	Joypad& operator=(const Joypad&) = delete;
+
+	// Raises the joypad interrupt when a newly pressed button is on a selected line.
+	void Set_Buttons(uint8_t buttons)
+	{
+		uint8_t pressed = buttons & ~_buttons;
+		_buttons = buttons;
+		if (pressed & Selected_Mask())
+		{
+			_memory.IO(Memory::IO_Type::IF) |= JOYPAD_INTERRUPT;
+		}
+	}
+
+	uint8_t Buttons() const { return _buttons; }
+
+	// Buttons written by another thread, read the moment the game reads P1 rather than once a frame. Null goes
+	// back to Set_Buttons only.
+	void Connect(const std::atomic<uint8_t>* live)
+	{
+		_live = live;
+	}
+
+	// Takes the freshest live state, for reads of P1 and for presses the game waits on by interrupt.
+	void Poll()
+	{
+		if (_live)
+		{
+			uint8_t buttons = _live->load(std::memory_order_relaxed);
+			if (buttons != _buttons)
+			{
+				Set_Buttons(buttons);
+			}
+		}
+	}
+
+	void Save_State(State_Writer& writer)
+	{
+		writer.Write(_select);
+		writer.Write(_buttons);
+	}
+
+	void Load_State(State_Reader& reader)
+	{
+		reader.Read(_select);
+		reader.Read(_buttons);
+	}
+
+	// What Save_State keeps, straight from another instance.
+	void Copy_State(const Joypad& other)
+	{
+		_select = other._select;
+		_buttons = other._buttons;
+	}
+
+private:
+	const static uint16_t P1 = 0xFF00;
+	const static uint8_t SELECT_DIRECTIONS = 0x10;
+	const static uint8_t SELECT_BUTTONS = 0x20;
+	const static uint8_t JOYPAD_INTERRUPT = 0x10;
+
+	// The held buttons that show up in P1 under the current selection.
+	uint8_t Selected_Mask() const
+	{
+		uint8_t mask = 0;
+		if (!(_select & SELECT_DIRECTIONS))
+		{
+			mask |= 0x0F;
+		}
+		if (!(_select & SELECT_BUTTONS))
+		{
+			mask |= 0xF0;
+		}
+
+		return mask;
+	}
+
+	static uint8_t Read_P1(void* context, uint16_t /*address*/)
+	{
+		auto* joypad = static_cast<Joypad*>(context);
+		joypad->Poll();
+		uint8_t held = joypad->_buttons & joypad->Selected_Mask();
+		uint8_t lines = (held | (held >> 4)) & 0x0F;
+		return 0xC0 | joypad->_select | (~lines & 0x0F);
+	}
+
+	static void Write_P1(void* context, uint16_t /*address*/, uint8_t value)
+	{
+		static_cast<Joypad*>(context)->_select = value & (SELECT_DIRECTIONS | SELECT_BUTTONS);
+	}
+
+	Memory& _memory;
+	uint8_t _select = SELECT_DIRECTIONS | SELECT_BUTTONS;
+	uint8_t _buttons = 0;
+	const std::atomic<uint8_t>* _live = nullptr;
+};
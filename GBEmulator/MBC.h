@@ -0,0 +1,366 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <iterator>
+#include <vector>
+
+#include "CPU.h"
+#include "Memory.h"
+#include "Save_State.h"
+#include "Scheduler.h"
+
+// The cartridge's memory bank controller. A bank switch only repoints the 0x4000-0x7FFF (and for MBC1 0x0000-0x3FFF)
+// and 0xA000-0xBFFF pages into the ROM image and cartridge RAM, nothing is copied.
+class MBC
+{
+public:
+	enum class Type { None, MBC1, MBC3, MBC5 };
+
+	MBC(Memory& memory, Scheduler& scheduler) : _memory(memory), _scheduler(scheduler)
+	{
+		const uint8_t* header = _memory.ROM().Data();
+		_type = Get_Type(header[CARTRIDGE_TYPE]);
+		_has_rtc = header[CARTRIDGE_TYPE] == 0x0F || header[CARTRIDGE_TYPE] == 0x10;
+		_has_battery = Get_Battery(header[CARTRIDGE_TYPE]);
+
+		// Anything smaller than a bank is still given a whole one, so a mapped page never runs off the end.
+		const uint32_t ram_sizes[] = { 0, 0x800, 0x2000, 0x8000, 0x20000, 0x10000 };
+		uint8_t ram_size = header[RAM_SIZE];
+		if (_type != Type::None && ram_size < std::size(ram_sizes) && ram_sizes[ram_size])
+		{
+			_ram.resize(std::max(ram_sizes[ram_size], RAM_BANK_SIZE), 0xFF);
+		}
+
+		_memory.Set_Cartridge_Handler(this, &MBC::Read, &MBC::Write);
+		_memory.Set_Cartridge_RAM(_ram.data(), _ram.size());
+		Remap();
+	}
+
+	MBC(const MBC&) = delete;
+	MBC& operator=(const MBC&) = delete;
+
+	Type Get_Type() const { return _type; }
+	bool Has_Battery() const { return _has_battery; }
+
+	// Cartridge RAM, the part a battery keeps.
+	std::vector<uint8_t>& RAM() { return _ram; }
+
+	void Save_State(State_Writer& writer)
+	{
+		Save_Banking(writer);
+		writer.Write_Block(_ram);
+	}
+
+	void Load_State(State_Reader& reader)
+	{
+		Load_Banking(reader);
+		_memory.Load_Cartridge_RAM(reader);
+	}
+
+	// Everything but the RAM, which forks copy a page at a time through Memory.
+	void Save_Banking(State_Writer& writer)
+	{
+		writer.Write(_ram_enabled);
+		writer.Write(_rom_bank);
+		writer.Write(_ram_bank);
+		writer.Write(_banking_mode);
+		writer.Write(_rtc_cycle);
+		writer.Write(_rtc_seconds);
+		writer.Write(_rtc_halted);
+		writer.Write(_rtc_carry);
+		writer.Write(_rtc_latch);
+		writer.Write(_rtc_latched);
+	}
+
+	void Load_Banking(State_Reader& reader)
+	{
+		reader.Read(_ram_enabled);
+		reader.Read(_rom_bank);
+		reader.Read(_ram_bank);
+		reader.Read(_banking_mode);
+		reader.Read(_rtc_cycle);
+		reader.Read(_rtc_seconds);
+		reader.Read(_rtc_halted);
+		reader.Read(_rtc_carry);
+		reader.Read(_rtc_latch);
+		reader.Read(_rtc_latched);
+		Remap();
+	}
+
+	// What Save_Banking keeps, straight from another instance of the same cartridge.
+	void Copy_Banking(const MBC& other)
+	{
+		_ram_enabled = other._ram_enabled;
+		_rom_bank = other._rom_bank;
+		_ram_bank = other._ram_bank;
+		_banking_mode = other._banking_mode;
+		_rtc_cycle = other._rtc_cycle;
+		_rtc_seconds = other._rtc_seconds;
+		_rtc_halted = other._rtc_halted;
+		_rtc_carry = other._rtc_carry;
+		_rtc_latch = other._rtc_latch;
+		_rtc_latched = other._rtc_latched;
+		Remap();
+	}
+
+private:
+	const static uint16_t CARTRIDGE_TYPE = 0x147;
+	const static uint16_t RAM_SIZE = 0x149;
+	const static uint32_t RAM_BANK_SIZE = 0x2000;
+	const static uint16_t RAM_START = 0xA000;
+
+	// MBC3 selects these in place of a RAM bank to reach the clock.
+	const static uint8_t RTC_SECONDS = 0x08;
+	const static uint8_t RTC_DAY_HIGH = 0x0C;
+	const static uint64_t SECONDS_PER_DAY = 24 * 60 * 60;
+	const static uint64_t DAY_LIMIT = 512;
+
+	static Type Get_Type(uint8_t cartridge_type)
+	{
+		if (cartridge_type >= 0x01 && cartridge_type <= 0x03)
+		{
+			return Type::MBC1;
+		}
+		if (cartridge_type >= 0x0F && cartridge_type <= 0x13)
+		{
+			return Type::MBC3;
+		}
+		if (cartridge_type >= 0x19 && cartridge_type <= 0x1E)
+		{
+			return Type::MBC5;
+		}
+
+		return Type::None;
+	}
+
+	static bool Get_Battery(uint8_t cartridge_type)
+	{
+		switch (cartridge_type)
+		{
+		case 0x03:
+		case 0x0F:
+		case 0x10:
+		case 0x13:
+		case 0x1B:
+		case 0x1E:
+			return true;
+		default:
+			return false;
+		}
+	}
+
+	// Points the windows at whatever the bank registers now select.
+	void Remap()
+	{
+		uint16_t fixed_bank = 0;
+		uint16_t switched_bank = _rom_bank;
+		uint8_t ram_bank = _ram_bank;
+
+		switch (_type)
+		{
+		case Type::MBC1:
+			// The two high bits extend the ROM bank, and in mode 1 also pick the fixed bank and the RAM bank.
+			switched_bank = (_ram_bank << 5) | std::max<uint16_t>(_rom_bank & 0x1F, 1);
+			fixed_bank = _banking_mode ? _ram_bank << 5 : 0;
+			ram_bank = _banking_mode ? _ram_bank : 0;
+			break;
+		case Type::MBC3:
+			switched_bank = std::max<uint16_t>(_rom_bank, 1);
+			break;
+		case Type::None:
+			switched_bank = 1;
+			break;
+		default:
+			break;
+		}
+
+		_memory.Map_ROM_Bank(false, fixed_bank);
+		_memory.Map_ROM_Bank(true, switched_bank);
+
+		bool ram_selected = _ram_enabled && !_ram.empty() && !(_type == Type::MBC3 && ram_bank >= RTC_SECONDS);
+		_memory.Map_External_RAM(ram_selected ? _ram.data() + (ram_bank * RAM_BANK_SIZE) % _ram.size() : nullptr);
+	}
+
+	bool RTC_Selected() const
+	{
+		return _type == Type::MBC3 && _has_rtc && _ram_enabled && _ram_bank >= RTC_SECONDS && _ram_bank <= RTC_DAY_HIGH;
+	}
+
+	// Only reached for 0xA000-0xBFFF while no RAM bank is mapped there.
+	static uint8_t Read(void* context, uint16_t /*address*/)
+	{
+		auto* mbc = static_cast<MBC*>(context);
+		return mbc->RTC_Selected() ? mbc->_rtc_latched[mbc->_ram_bank - RTC_SECONDS] : 0xFF;
+	}
+
+	static void Write(void* context, uint16_t address, uint8_t value)
+	{
+		auto* mbc = static_cast<MBC*>(context);
+		if (address >= RAM_START)
+		{
+			if (mbc->RTC_Selected())
+			{
+				mbc->Write_RTC(mbc->_ram_bank, value);
+			}
+			return;
+		}
+
+		switch (mbc->_type)
+		{
+		case Type::MBC1:
+			mbc->Write_MBC1(address, value);
+			break;
+		case Type::MBC3:
+			mbc->Write_MBC3(address, value);
+			break;
+		case Type::MBC5:
+			mbc->Write_MBC5(address, value);
+			break;
+		default:
+			return;
+		}
+
+		mbc->Remap();
+	}
+
+	void Write_MBC1(uint16_t address, uint8_t value)
+	{
+		switch (address >> 13)
+		{
+		case 0:
+			_ram_enabled = (value & 0x0F) == 0x0A;
+			break;
+		case 1:
+			_rom_bank = value & 0x1F;
+			break;
+		case 2:
+			_ram_bank = value & 0x03;
+			break;
+		case 3:
+			_banking_mode = value & 0x01;
+			break;
+		}
+	}
+
+	void Write_MBC3(uint16_t address, uint8_t value)
+	{
+		switch (address >> 13)
+		{
+		case 0:
+			_ram_enabled = (value & 0x0F) == 0x0A;
+			break;
+		case 1:
+			_rom_bank = value & 0x7F;
+			break;
+		case 2:
+			_ram_bank = value & 0x0F;
+			break;
+		case 3:
+			// Writing 0 then 1 copies the running clock into the readable registers.
+			if (_has_rtc && _rtc_latch == 0 && value == 1)
+			{
+				Latch_RTC();
+			}
+			_rtc_latch = value;
+			break;
+		}
+	}
+
+	void Write_MBC5(uint16_t address, uint8_t value)
+	{
+		if (address < 0x2000)
+		{
+			_ram_enabled = (value & 0x0F) == 0x0A;
+		}
+		else if (address < 0x3000)
+		{
+			_rom_bank = (_rom_bank & 0x100) | value;
+		}
+		else if (address < 0x4000)
+		{
+			_rom_bank = (_rom_bank & 0xFF) | ((value & 0x01) << 8);
+		}
+		else if (address < 0x6000)
+		{
+			_ram_bank = value & 0x0F;
+		}
+	}
+
+	// The clock counts emulated time, so it stays in step with the game at any speed and across save states.
+	void Sync_RTC()
+	{
+		uint64_t now = _scheduler.Now();
+		if (_rtc_halted)
+		{
+			_rtc_cycle = now;
+			return;
+		}
+
+		uint64_t seconds = (now - _rtc_cycle) / CPU::CYCLES_PER_SECOND;
+		_rtc_seconds += seconds;
+		_rtc_cycle += seconds * CPU::CYCLES_PER_SECOND;
+		if (_rtc_seconds >= DAY_LIMIT * SECONDS_PER_DAY)
+		{
+			_rtc_seconds %= DAY_LIMIT * SECONDS_PER_DAY;
+			_rtc_carry = true;
+		}
+	}
+
+	std::array<uint8_t, 5> RTC_Registers()
+	{
+		Sync_RTC();
+		uint64_t days = _rtc_seconds / SECONDS_PER_DAY;
+		return {
+			static_cast<uint8_t>(_rtc_seconds % 60),
+			static_cast<uint8_t>(_rtc_seconds / 60 % 60),
+			static_cast<uint8_t>(_rtc_seconds / 3600 % 24),
+			static_cast<uint8_t>(days),
+			static_cast<uint8_t>((days >> 8) | (_rtc_halted ? 0x40 : 0) | (_rtc_carry ? 0x80 : 0))
+		};
+	}
+
+	void Latch_RTC()
+	{
+		_rtc_latched = RTC_Registers();
+	}
+
+	void Write_RTC(uint8_t select, uint8_t value)
+	{
+		auto registers = RTC_Registers();
+		registers[select - RTC_SECONDS] = value;
+		_rtc_latched[select - RTC_SECONDS] = value;
+
+		uint64_t days = registers[3] | ((registers[4] & 0x01) << 8);
+		_rtc_seconds = (registers[0] & 0x3F) + (registers[1] & 0x3F) * 60 + (registers[2] & 0x1F) * 3600 + days * SECONDS_PER_DAY;
+		_rtc_halted = registers[4] & 0x40;
+		_rtc_carry = registers[4] & 0x80;
+
+		// Writing the seconds also restarts the count toward the next one.
+		if (select == RTC_SECONDS)
+		{
+			_rtc_cycle = _scheduler.Now();
+		}
+	}
+
+	Memory& _memory;
+	Scheduler& _scheduler;
+
+	Type _type;
+	bool _has_rtc;
+	bool _has_battery;
+	std::vector<uint8_t> _ram;
+
+	bool _ram_enabled = false;
+	uint16_t _rom_bank = 1;
+	uint8_t _ram_bank = 0;
+	uint8_t _banking_mode = 0;
+
+	uint64_t _rtc_cycle = 0;
+	uint64_t _rtc_seconds = 0;
+	bool _rtc_halted = false;
+	bool _rtc_carry = false;
+	uint8_t _rtc_latch = 0xFF;
+	std::array<uint8_t, 5> _rtc_latched = {};
+};
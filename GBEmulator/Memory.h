@@ -1,22 +1,36 @@
 #pragma once
 
+#include <algorithm>
+#include <atomic>
+#include <cstring>
 #include <istream>
 #include <iterator>
 #include <cstdint>
 #include <string>
 #include <array>
+#include <bit>
 #include <vector>
 
 #include "Memory_Segment_Type.h"
+#include "ROM_Image.h"
+#include "Save_State.h"
 
 class Memory
 {
 public:
-	enum class MBC_Type { None, MBC3, MBC5 };
-	enum class IO_Type { SCY = 0xFF42, SCX = 0xFF43, LY = 0xFF44 };
+	enum class IO_Type
+	{
+		IF = 0xFF0F,
+		LCDC = 0xFF40, STAT = 0xFF41, SCY = 0xFF42, SCX = 0xFF43, LY = 0xFF44, LYC = 0xFF45,
+		DMA = 0xFF46, BGP = 0xFF47, OBP0 = 0xFF48, OBP1 = 0xFF49, WY = 0xFF4A, WX = 0xFF4B
+	};
+
+	using IO_Read_Handler = uint8_t (*)(void* context, uint16_t address);
+	using IO_Write_Handler = void (*)(void* context, uint16_t address, uint8_t value);
 
-	Memory(std::istream& s)
-		: _read_count(0), _rom(std::istreambuf_iterator<char>(s), {})
+	// Each instance owns only its RAM, the cartridge is shared read only.
+	Memory(std::shared_ptr<const ROM_Image> rom)
+		: _rom(std::move(rom))
 	{
 		_internal_ram.resize(Segment_Size(Memory_Segment_Type::RAM_INTERNAL));
 		_internal_switched_ram.resize(Segment_Size(Memory_Segment_Type::RAM_INTERNAL_SWITCHED));
@@ -27,144 +41,864 @@ public:
 		_high_ram.resize(Segment_Size(Memory_Segment_Type::RAM_HIGH));
 		_interupts.resize(Segment_Size(Memory_Segment_Type::INTERUPT_ENABLE));
 
-		_io[Segment_Offset(static_cast<std::size_t>(IO_Type::LY), Memory_Segment_Type::IO)] = 148;
-	}
+		// Post boot ROM state: LCD on with the background enabled and the standard palette.
+		IO(IO_Type::LCDC) = 0x91;
+		IO(IO_Type::BGP) = 0xFC;
 
-	uint8_t MBC()
-	{
-		return _rom[0x147];
+		for (auto* segment : { &_internal_ram, &_internal_switched_ram, &_vram })
+		{
+			Add_Fork_Pages(segment->data(), segment->size());
+		}
+
+		Map_Pages();
 	}
 
+	Memory(std::istream& s) : Memory(ROM_Image::From_Stream(s)) {}
+
+	Memory(const Memory&) = delete;
+	Memory& operator=(const Memory&) = delete;
+
 	std::string Get_Title()
 	{
-		auto title_begin_it = _rom.begin();
-		std::advance(title_begin_it, 0x134);
-
-		auto title_end_it = _rom.begin();
-		std::advance(title_end_it, 0x142);
+		auto title_begin_it = _rom->Data() + 0x134;
+		auto title_end_it = _rom->Data() + 0x142;
 
 		return { title_begin_it, title_end_it };
 	}
 
-	uint8_t Read8(uint16_t address, bool advance_count = true)
+	const ROM_Image& ROM() const
 	{
-		_read_count += advance_count ? 1 : 0;
+		return *_rom;
+	}
 
-		auto type = Get_Memory_Segment(address);
-		auto offset = Segment_Offset(address, type);
-		const auto &memory = Get_Read_Memory(type);
+	const std::shared_ptr<const ROM_Image>& Shared_ROM() const
+	{
+		return _rom;
+	}
 
-		return memory[offset];
+	uint8_t Read8(uint16_t address)
+	{
+		const uint8_t* page = _read_pages[address >> PAGE_SHIFT];
+		if (page)
+		{
+			return page[address & PAGE_MASK];
+		}
+
+		return (this->*_slow_handlers[address >> PAGE_SHIFT].read)(address);
 	}
 	
-	int8_t Readi8(uint16_t address, bool advance_count = true)
+	int8_t Readi8(uint16_t address)
+	{
+		return static_cast<int8_t>(Read8(address));
+	}
+
+	uint16_t Read16(uint16_t address)
 	{
-		_read_count += advance_count ? 1 : 0;
+		return Read8(address) | (Read8(address + 1) << 8);
+	}
 
-		auto type = Get_Memory_Segment(address);
-		auto offset = Segment_Offset(address, type);
-		const auto& memory = Get_Read_Memory(type);
+	void Write8(uint16_t address, uint8_t value)
+	{
+		uint8_t* page = _write_pages[address >> PAGE_SHIFT];
+		if (page)
+		{
+			page[address & PAGE_MASK] = value;
+			return;
+		}
 
-		return memory[offset];
+		Write_Slow(address, value);
 	}
 
-	uint16_t Read16(uint16_t address, bool advance_count = true)
+	void Write16(uint16_t address, uint16_t value)
 	{
-		_read_count += advance_count ? 2 : 0;
+		Write8(address, value & 0xFF);
+		Write8(address + 1, value >> 8);
+	}
 
-		auto type = Get_Memory_Segment(address);
-		auto offset = Segment_Offset(address, type);
-		const auto& memory = Get_Read_Memory(type);
+	// The byte a read of address lands on when nothing but memory is involved, null when it goes through a handler.
+	// High RAM shares its page with IO, so unlike Read8 it is also answered here.
+	const uint8_t* Plain_Read(uint16_t address) const
+	{
+		if (const uint8_t* page = _read_pages[address >> PAGE_SHIFT])
+		{
+			return page + (address & PAGE_MASK);
+		}
 
-		return memory[offset] | (memory[offset + 1] << 8);
+		return address >= HIGH_RAM_START && address < HIGH_RAM_END ? _high_ram.data() + (address - HIGH_RAM_START) : nullptr;
 	}
 
-	void Write8(uint16_t address, uint8_t value)
+	// The same for writes. Null as well wherever the tile cache or a watched code page has to hear about the write.
+	uint8_t* Plain_Write(uint16_t address)
 	{
-		auto type = Get_Memory_Segment(address);
-		auto offset = Segment_Offset(address, type);
-		auto& memory = Get_Write_Memory(type);
+		if (uint8_t* page = _write_pages[address >> PAGE_SHIFT])
+		{
+			return page + (address & PAGE_MASK);
+		}
 
-		memory[offset] = value;
+		return address >= HIGH_RAM_START && address < HIGH_RAM_END && !_code_pages[address >> PAGE_SHIFT] ? _high_ram.data() + (address - HIGH_RAM_START) : nullptr;
 	}
 
-	void Write16(uint16_t address, uint16_t value)
+	// Registers callbacks for a single IO register (0xFF00-0xFF7F). A null callback keeps the plain byte behaviour.
+	// A steady read only changes when memory is written or an event fires, never just because time has passed.
+	void Set_IO_Handler(uint16_t address, void* context, IO_Read_Handler read, IO_Write_Handler write, bool steady = false)
+	{
+		_io_handlers[Segment_Offset(address, Memory_Segment_Type::IO)] = { context, read, write, steady };
+	}
+
+	// Counts reads that may change with nothing written and no event fired, such as DIV, the joypad or the cartridge.
+	// Code that reads memory without adding to this sees the same values until one of those happens.
+	uint32_t Unsteady_Reads() const { return _unsteady_reads; }
+
+	uint8_t& IO(IO_Type type)
+	{
+		return _io[Segment_Offset(static_cast<uint16_t>(type), Memory_Segment_Type::IO)];
+	}
+
+	// Direct views of video memory for the PPU, which never goes through the page table.
+	const uint8_t* VRAM() const
+	{
+		return _vram.data();
+	}
+
+	uint8_t* OAM()
+	{
+		return _oam.data();
+	}
+
+	// The ROM bank currently visible at address (0x0000-0x7FFF).
+	uint16_t ROM_Bank(uint16_t address)
+	{
+		return _rom_banks[address >= ROM_Image::BANK_SIZE];
+	}
+
+	// Bank controller hooks. Writes to 0x0000-0x7FFF, and accesses to 0xA000-0xBFFF while no RAM bank is
+	// mapped there, go to these callbacks.
+	void Set_Cartridge_Handler(void* context, IO_Read_Handler read, IO_Write_Handler write)
+	{
+		_cartridge_handler = { context, read, write };
+	}
+
+	// Points 0x0000-0x3FFF (switched false) or 0x4000-0x7FFF (switched true) at a ROM bank without copying.
+	void Map_ROM_Bank(bool switched, uint16_t bank)
+	{
+		bank %= _rom->Bank_Count();
+		if (_rom_banks[switched] == bank)
+		{
+			return;
+		}
+
+		_rom_banks[switched] = bank;
+		const uint8_t* data = _rom->Data() + bank * ROM_Image::BANK_SIZE;
+		uint32_t first_page = switched ? ROM_Image::BANK_SIZE >> PAGE_SHIFT : 0;
+		for (uint32_t page = 0; page < (ROM_Image::BANK_SIZE >> PAGE_SHIFT); page++)
+		{
+			_read_pages[first_page + page] = data + (page << PAGE_SHIFT);
+		}
+
+		// Stops the CPU mid-block, the rest of it may have been decoded from the old bank.
+		_code_changed = true;
+	}
+
+	// The bank controller's RAM, all of it and not just the bank mapped, so forks can copy it with the rest.
+	void Set_Cartridge_RAM(uint8_t* ram, std::size_t size)
+	{
+		_cartridge_ram = ram;
+		_cartridge_fork_page = _fork_pages.size();
+		Add_Fork_Pages(ram, size);
+	}
+
+	// Points 0xA000-0xBFFF at 8 KB of cartridge RAM, or at the cartridge handler when bank is null.
+	void Map_External_RAM(uint8_t* bank)
+	{
+		if (bank == _external_ram_bank)
+		{
+			return;
+		}
+
+		_external_ram_bank = bank;
+		const auto& segment = MEMORY_SEGMENTS[static_cast<std::size_t>(Memory_Segment_Type::RAM_EXTERNAL)];
+		for (uint32_t address = segment.start; address <= segment.end; address += PAGE_SIZE)
+		{
+			auto page = address >> PAGE_SHIFT;
+			uint8_t* pointer = bank ? bank + (address - segment.start) : nullptr;
+			_read_pages[page] = pointer;
+			_page_fork_index[page] = pointer ? static_cast<uint16_t>(_cartridge_fork_page + (pointer - _cartridge_ram) / PAGE_SIZE) : NO_FORK_PAGE;
+			_fork_armed[page] = false;
+			Set_Write_Page(page, pointer);
+			if (_code_pages[page])
+			{
+				Unwatch_Code_Page(page);
+			}
+			Arm_Fork_Page(page);
+		}
+	}
+
+	// Sends writes to the page through the slow path so the CPU finds out when cached code on it is overwritten.
+	void Watch_Code_Page(uint8_t page)
+	{
+		_code_pages[page] = true;
+		_write_pages[page] = nullptr;
+	}
+
+	// Set when a watched page has been written since the last Take_Written_Code_Pages.
+	bool Code_Changed()
 	{
-		auto type = Get_Memory_Segment(address);
-		auto offset = Segment_Offset(address, type);
-		auto& memory = Get_Write_Memory(type);
+		return _code_changed;
+	}
+
+	template<typename Callback>
+	void Take_Written_Code_Pages(Callback&& callback)
+	{
+		if (!_code_changed)
+		{
+			return;
+		}
 
-		memory[offset] = value & 0xFF;
-		memory[offset + 1] = value >> 8;
+		for (uint32_t page = 0; page < PAGE_COUNT; page++)
+		{
+			if (_written_code_pages[page])
+			{
+				_written_code_pages[page] = false;
+				callback(static_cast<uint8_t>(page));
+			}
+		}
+
+		_code_changed = false;
 	}
 
-	uint16_t Read_Count()
+	// Calls back with the index of every 16-byte tile in 0x8000-0x97FF written since the last call.
+	template<typename Callback>
+	void Take_Dirty_Tiles(Callback&& callback)
 	{
-		return _read_count;
+		for (uint32_t word = 0; word < _dirty_tiles.size(); word++)
+		{
+			while (_dirty_tiles[word])
+			{
+				uint32_t bit = std::countr_zero(_dirty_tiles[word]);
+				_dirty_tiles[word] &= _dirty_tiles[word] - 1;
+				callback(static_cast<uint16_t>(word * 64 + bit));
+			}
+		}
+	}
+
+	uint8_t& Interrupt_Enable()
+	{
+		return _interupts[0];
+	}
+
+	// FNV-1a over all writable memory, used to compare the end state of headless runs.
+	uint32_t Checksum()
+	{
+		uint32_t hash = 2166136261u;
+		for (const auto* segment : { &_internal_ram, &_internal_switched_ram, &_vram, &_oam, &_io, &_high_ram, &_interupts })
+		{
+			for (auto value : *segment)
+			{
+				hash = (hash ^ value) * 16777619u;
+			}
+		}
+
+		return hash;
 	}
 
-	void Reset_Read_Count()
+	// Gives every RAM page written since the last seal a new version, and arms a trap on its next write. Pages with the
+	// same version in two instances hold the same bytes, which is what lets Fork_Into skip them.
+	void Seal()
 	{
-		_read_count = 0;
+		if (_sealed)
+		{
+			return;
+		}
+
+		// Normally only the pages written since the last seal need a look, after Forget_Fork_Versions every page does.
+		if (_fork_versions_forgotten)
+		{
+			uint64_t version = _next_fork_version.fetch_add(_fork_versions.size(), std::memory_order_relaxed);
+			for (std::size_t index = 0; index < _fork_versions.size(); index++)
+			{
+				if (_fork_versions[index] == 0)
+				{
+					_fork_versions[index] = version++;
+					_sealed_pages.push_back(static_cast<uint16_t>(index));
+				}
+			}
+			for (uint32_t page = 0; page < PAGE_COUNT; page++)
+			{
+				Arm_Fork_Page(page);
+			}
+			_fork_versions_forgotten = false;
+		}
+		else
+		{
+			uint64_t version = _next_fork_version.fetch_add(_written_fork_pages.size(), std::memory_order_relaxed);
+			for (auto index : _written_fork_pages)
+			{
+				if (_fork_versions[index] == 0)
+				{
+					_fork_versions[index] = version++;
+					_sealed_pages.push_back(index);
+				}
+			}
+			for (auto page : _disarmed_pages)
+			{
+				Arm_Fork_Page(page);
+			}
+
+			// A bank mapped in while its pages had no version was left unarmed.
+			const auto& segment = MEMORY_SEGMENTS[static_cast<std::size_t>(Memory_Segment_Type::RAM_EXTERNAL)];
+			for (uint32_t address = segment.start; address <= segment.end; address += PAGE_SIZE)
+			{
+				Arm_Fork_Page(address >> PAGE_SHIFT);
+			}
+		}
+
+		_written_fork_pages.clear();
+		_disarmed_pages.clear();
+		_sealed = true;
+
+		// Children synced to a position before the cut copy every page whose version differs, as a first fork does.
+		if (_sealed_pages.size() > SEALED_PAGES_KEPT * _fork_versions.size())
+		{
+			_sealed_pages_start += _sealed_pages.size();
+			_sealed_pages.clear();
+		}
+	}
+
+	bool Sealed() const { return _sealed; }
+
+	// Makes child's RAM a copy of this sealed memory, copying only the 256-byte pages whose versions differ, and the
+	// last page (OAM, IO and high RAM) which is always copied. A child last forked from this memory only looks at the
+	// pages either side has given a new version or written since then, any other child looks at every page. Only
+	// reads this instance, so one sealed parent can fork into several children on different threads at once. Bank
+	// mappings are the bank controller's to restore.
+	void Fork_Into(Memory& child) const
+	{
+		bool synced = child._fork_parent == _id && child._parent_position >= _sealed_pages_start
+			&& child._own_position >= child._sealed_pages_start;
+		if (synced)
+		{
+			for (std::size_t i = child._parent_position - _sealed_pages_start; i < _sealed_pages.size(); i++)
+			{
+				Copy_Fork_Page(child, _sealed_pages[i]);
+			}
+			for (std::size_t i = child._own_position - child._sealed_pages_start; i < child._sealed_pages.size(); i++)
+			{
+				Copy_Fork_Page(child, child._sealed_pages[i]);
+			}
+			for (auto index : child._written_fork_pages)
+			{
+				Copy_Fork_Page(child, index);
+			}
+		}
+		else
+		{
+			for (std::size_t index = 0; index < _fork_versions.size(); index++)
+			{
+				Copy_Fork_Page(child, index);
+			}
+		}
+
+		if (child._code_pages[0xFF] && child._high_ram != _high_ram)
+		{
+			child.Unwatch_Code_Page(0xFF);
+		}
+		child._oam = _oam;
+		child._invalid = _invalid;
+		child._io = _io;
+		child._high_ram = _high_ram;
+		child._interupts = _interupts;
+
+		child._sealed = false;
+		child.Seal();
+		child._fork_parent = _id;
+		child._parent_position = _sealed_pages_start + _sealed_pages.size();
+		child._own_position = child._sealed_pages_start + child._sealed_pages.size();
+	}
+
+	// For writes made behind the page table's back, such as a save file loaded into cartridge RAM.
+	void Forget_Fork_Versions()
+	{
+		std::fill(_fork_versions.begin(), _fork_versions.end(), 0);
+		for (uint32_t page = 0; page < PAGE_COUNT; page++)
+		{
+			if (_fork_armed[page])
+			{
+				Disarm_Fork_Page(page);
+			}
+		}
+		_written_fork_pages.clear();
+		_disarmed_pages.clear();
+		_fork_versions_forgotten = true;
+		_sealed = false;
+
+		// Nobody synced with this memory can trust what it logged before.
+		_sealed_pages_start += _sealed_pages.size() + 1;
+		_sealed_pages.clear();
+		_fork_parent = 0;
+	}
+
+	// The cartridge ROM is not part of a save state, only what the game can change.
+	void Save_State(State_Writer& writer)
+	{
+		for (const auto* segment : { &_internal_ram, &_internal_switched_ram, &_vram, &_oam, &_invalid, &_io, &_high_ram, &_interupts })
+		{
+			writer.Write_Block(*segment);
+		}
+	}
+
+	// Only the pages that differ from the state are written, so loading a recent state, as run-ahead does every
+	// frame, keeps the decoded tiles, cached code and fork versions of everything else.
+	void Load_State(State_Reader& reader)
+	{
+		std::size_t index = 0;
+		for (auto* segment : { &_internal_ram, &_internal_switched_ram, &_vram })
+		{
+			Load_Fork_Pages(reader, index, segment->size() / PAGE_SIZE);
+			index += segment->size() / PAGE_SIZE;
+		}
+
+		for (auto* segment : { &_oam, &_invalid, &_io })
+		{
+			reader.Read_Block(*segment);
+		}
+
+		const uint8_t* high_ram = reader.Take_Bytes(_high_ram.size());
+		if (high_ram && std::memcmp(_high_ram.data(), high_ram, _high_ram.size()) != 0)
+		{
+			std::memcpy(_high_ram.data(), high_ram, _high_ram.size());
+			if (_code_pages[0xFF])
+			{
+				Unwatch_Code_Page(0xFF);
+			}
+		}
+		reader.Read_Block(_interupts);
+	}
+
+	// The bank controller's part of a save state, its RAM as Set_Cartridge_RAM gave it.
+	void Load_Cartridge_RAM(State_Reader& reader)
+	{
+		Load_Fork_Pages(reader, _cartridge_fork_page, _fork_pages.size() - _cartridge_fork_page);
 	}
 
 private:
-	std::vector<uint8_t>& Get_Read_Memory(Memory_Segment_Type type)
-	{
-		switch (type)
-		{
-		case Memory_Segment_Type::ROM_FIXED:
-			return _rom;
-		case Memory_Segment_Type::RAM_INTERNAL:
-			return _internal_ram;
-		case Memory_Segment_Type::RAM_INTERNAL_SWITCHED:
-			return _internal_switched_ram;
-		case Memory_Segment_Type::VRAM:
-			return _vram;
-		case Memory_Segment_Type::OAM:
-			return _oam;
-		case Memory_Segment_Type::INVALID:
-			return _invalid;
-		case Memory_Segment_Type::IO:
-			return _io;
-		case Memory_Segment_Type::RAM_HIGH:
-			return _high_ram;
-		case Memory_Segment_Type::INTERUPT_ENABLE:
-			return _interupts;
-		default:
-			std::terminate();
-		}
-	}
-
-	std::vector<uint8_t>& Get_Write_Memory(Memory_Segment_Type type)
-	{
-		switch (type)
-		{
-		case Memory_Segment_Type::ROM_FIXED:
-			return _rom;
-		case Memory_Segment_Type::RAM_INTERNAL:
-			return _internal_ram;
-		case Memory_Segment_Type::RAM_INTERNAL_SWITCHED:
-			return _internal_switched_ram;
-		case Memory_Segment_Type::VRAM:
-			return _vram;
-		case Memory_Segment_Type::OAM:
-			return _oam;
-		case Memory_Segment_Type::INVALID:
-			return _invalid;
-		case Memory_Segment_Type::IO:
-			return _io;
-		case Memory_Segment_Type::RAM_HIGH:
-			return _high_ram;
-		case Memory_Segment_Type::INTERUPT_ENABLE:
-			return _interupts;
-		default:
-			std::terminate();
-		}
-	}
-
-	uint8_t _read_count;
-	std::vector<uint8_t> _rom;
+	struct Slow_Handler
+	{
+		uint8_t (Memory::*read)(uint16_t);
+		void (Memory::*write)(uint16_t, uint8_t);
+	};
+
+	struct IO_Handler
+	{
+		void* context = nullptr;
+		IO_Read_Handler read = nullptr;
+		IO_Write_Handler write = nullptr;
+		bool steady = false;
+	};
+
+	// Points every page of a segment directly at its backing memory, or at the slow path when it is not page aligned.
+	void Map_Segment(Memory_Segment_Type type, const uint8_t* read, uint8_t* write, Slow_Handler slow)
+	{
+		const auto& segment = MEMORY_SEGMENTS[static_cast<std::size_t>(type)];
+		bool aligned = (segment.start & PAGE_MASK) == 0 && (segment.Size() & PAGE_MASK) == 0;
+
+		for (uint32_t address = segment.start; address <= segment.end; address += PAGE_SIZE)
+		{
+			auto page = address >> PAGE_SHIFT;
+			auto offset = address - segment.start;
+			_read_pages[page] = aligned && read ? read + offset : nullptr;
+			Set_Write_Page(page, aligned && write ? write + offset : nullptr);
+			_slow_handlers[page] = slow;
+		}
+	}
+
+	void Map_Pages()
+	{
+		// RAM only reaches its handler while a write is watched, and then the page is still mapped.
+		const Slow_Handler ram_handler = { &Memory::Read_Mapped, &Memory::Write_Mapped };
+		const Slow_Handler rom_handler = { &Memory::Read_Unmapped, &Memory::Write_Cartridge };
+		const Slow_Handler cartridge_handler = { &Memory::Read_Cartridge, &Memory::Write_Cartridge };
+		const Slow_Handler vram_handler = { &Memory::Read_Mapped, &Memory::Write_VRAM };
+
+		// Writes into ROM are bank controller commands, so they never get a direct pointer.
+		Map_Segment(Memory_Segment_Type::ROM_FIXED, _rom->Data(), nullptr, rom_handler);
+		Map_Segment(Memory_Segment_Type::ROM_SWITCHED, _rom->Data() + ROM_Image::BANK_SIZE, nullptr, rom_handler);
+		// Tile data writes take the slow path so the tile cache hears about them, the tile maps stay direct.
+		Map_Segment(Memory_Segment_Type::VRAM, _vram.data(), nullptr, vram_handler);
+		for (uint32_t offset = TILE_DATA_SIZE; offset < _vram.size(); offset += PAGE_SIZE)
+		{
+			Set_Write_Page((VRAM_START + offset) >> PAGE_SHIFT, _vram.data() + offset);
+		}
+		Map_Segment(Memory_Segment_Type::RAM_EXTERNAL, nullptr, nullptr, cartridge_handler);
+		Map_Segment(Memory_Segment_Type::RAM_INTERNAL, _internal_ram.data(), _internal_ram.data(), ram_handler);
+		Map_Segment(Memory_Segment_Type::RAM_INTERNAL_SWITCHED, _internal_switched_ram.data(), _internal_switched_ram.data(), ram_handler);
+
+		// Echo RAM mirrors 0xC000-0xDDFF.
+		for (uint32_t address = MEMORY_SEGMENTS[static_cast<std::size_t>(Memory_Segment_Type::RAM_ECHO)].start; address < 0xFE00; address += PAGE_SIZE)
+		{
+			auto page = address >> PAGE_SHIFT;
+			auto mirror = (address - 0x2000) >> PAGE_SHIFT;
+			_read_pages[page] = _read_pages[mirror];
+			Set_Write_Page(page, _mapped_write_pages[mirror]);
+			_slow_handlers[page] = ram_handler;
+		}
+
+		// OAM and the unusable area after it share one page, IO, high RAM and interrupt enable the other, so both always
+		// take the slow path, each through a handler of its own.
+		for (auto type : { Memory_Segment_Type::OAM, Memory_Segment_Type::INVALID })
+		{
+			Map_Segment(type, nullptr, nullptr, { &Memory::Read_OAM, &Memory::Write_OAM });
+		}
+		for (auto type : { Memory_Segment_Type::IO, Memory_Segment_Type::RAM_HIGH, Memory_Segment_Type::INTERUPT_ENABLE })
+		{
+			Map_Segment(type, nullptr, nullptr, { &Memory::Read_High_Page, &Memory::Write_High_Page });
+		}
+
+		Map_Fork_Pages();
+	}
+
+	void Load_Fork_Pages(State_Reader& reader, std::size_t first, std::size_t count)
+	{
+		const uint8_t* data = reader.Take_Bytes(count * PAGE_SIZE);
+		if (!data)
+		{
+			return;
+		}
+
+		for (std::size_t index = first; index < first + count; index++, data += PAGE_SIZE)
+		{
+			if (std::memcmp(_fork_pages[index], data, PAGE_SIZE) != 0)
+			{
+				std::memcpy(_fork_pages[index], data, PAGE_SIZE);
+				Forget_Fork_Page(index);
+			}
+		}
+	}
+
+	// A fork page written behind the page table's back: its tiles are redecoded, code cached from it is dropped, and
+	// it loses its version as a write would have taken it.
+	void Forget_Fork_Page(std::size_t index)
+	{
+		if (index >= VRAM_FORK_PAGE && index < VRAM_FORK_PAGE + TILE_DATA_SIZE / PAGE_SIZE)
+		{
+			uint32_t tile = static_cast<uint32_t>(index - VRAM_FORK_PAGE) * (PAGE_SIZE / 16);
+			_dirty_tiles[tile >> 6] |= uint64_t(0xFFFF) << (tile & 63);
+		}
+
+		if (_fork_versions[index] != 0)
+		{
+			_fork_versions[index] = 0;
+			_written_fork_pages.push_back(static_cast<uint16_t>(index));
+			_sealed = false;
+		}
+
+		For_Each_Page_Showing(index, [this](uint32_t page)
+		{
+			if (_fork_armed[page])
+			{
+				Disarm_Fork_Page(page);
+			}
+			if (_code_pages[page])
+			{
+				Unwatch_Code_Page(page);
+			}
+		});
+	}
+
+	// Calls back with every page of the address space that shows the fork page.
+	template<typename Callback>
+	void For_Each_Page_Showing(std::size_t index, Callback&& callback) const
+	{
+		if (index < INTERNAL_RAM_PAGES)
+		{
+			callback((INTERNAL_RAM_START >> PAGE_SHIFT) + static_cast<uint32_t>(index));
+			if (ECHO_RAM_START + (index << PAGE_SHIFT) < ECHO_RAM_END)
+			{
+				callback((ECHO_RAM_START >> PAGE_SHIFT) + static_cast<uint32_t>(index));
+			}
+		}
+		else if (index < VRAM_FORK_PAGE + VRAM_PAGES)
+		{
+			callback((VRAM_START >> PAGE_SHIFT) + static_cast<uint32_t>(index - VRAM_FORK_PAGE));
+		}
+		else if (_external_ram_bank)
+		{
+			auto offset = _fork_pages[index] - _external_ram_bank;
+			if (offset >= 0 && offset < EXTERNAL_RAM_SIZE)
+			{
+				callback((EXTERNAL_RAM_START >> PAGE_SHIFT) + static_cast<uint32_t>(offset >> PAGE_SHIFT));
+			}
+		}
+	}
+
+	// Runs on the parent. Code cached from a page about to change is dropped, as Load_State would.
+	void Copy_Fork_Page(Memory& child, std::size_t index) const
+	{
+		if (child._fork_versions[index] == _fork_versions[index])
+		{
+			return;
+		}
+
+		child.For_Each_Page_Showing(index, [&child](uint32_t page)
+		{
+			if (child._code_pages[page])
+			{
+				child.Unwatch_Code_Page(page);
+			}
+		});
+		std::memcpy(child._fork_pages[index], _fork_pages[index], PAGE_SIZE);
+		child._fork_versions[index] = _fork_versions[index];
+		child._sealed_pages.push_back(static_cast<uint16_t>(index));
+		if (index >= VRAM_FORK_PAGE && index < VRAM_FORK_PAGE + TILE_DATA_SIZE / PAGE_SIZE)
+		{
+			uint32_t tile = static_cast<uint32_t>(index - VRAM_FORK_PAGE) * (PAGE_SIZE / 16);
+			child._dirty_tiles[tile >> 6] |= uint64_t(0xFFFF) << (tile & 63);
+		}
+	}
+
+	void Set_Write_Page(uint32_t page, uint8_t* pointer)
+	{
+		_mapped_write_pages[page] = pointer;
+		_write_pages[page] = _code_pages[page] || _fork_armed[page] ? nullptr : pointer;
+	}
+
+	void Add_Fork_Pages(uint8_t* memory, std::size_t size)
+	{
+		for (std::size_t offset = 0; offset < size; offset += PAGE_SIZE)
+		{
+			_fork_pages.push_back(memory + offset);
+			_fork_versions.push_back(0);
+		}
+	}
+
+	// Internal RAM and its echo, and VRAM, always show the same fork pages. Cartridge RAM follows the bank mapped.
+	void Map_Fork_Pages()
+	{
+		_page_fork_index.fill(NO_FORK_PAGE);
+		for (uint32_t page = 0; page < INTERNAL_RAM_PAGES; page++)
+		{
+			_page_fork_index[(INTERNAL_RAM_START >> PAGE_SHIFT) + page] = static_cast<uint16_t>(page);
+			if (ECHO_RAM_START + (page << PAGE_SHIFT) < ECHO_RAM_END)
+			{
+				_page_fork_index[(ECHO_RAM_START >> PAGE_SHIFT) + page] = static_cast<uint16_t>(page);
+			}
+		}
+		for (uint32_t page = 0; page < VRAM_PAGES; page++)
+		{
+			_page_fork_index[(VRAM_START >> PAGE_SHIFT) + page] = static_cast<uint16_t>(VRAM_FORK_PAGE + page);
+		}
+	}
+
+	// The first write to a page after a seal is caught here, on its way to the slow path.
+	void Arm_Fork_Page(uint32_t page)
+	{
+		auto index = _page_fork_index[page];
+		if (index != NO_FORK_PAGE && _fork_versions[index] != 0 && !_fork_armed[page])
+		{
+			_fork_armed[page] = true;
+			_write_pages[page] = nullptr;
+		}
+	}
+
+	// A fork page loses its version at most once between seals, and only a page showing a versioned fork page is
+	// armed, so both lists stay short however long the emulator runs unsealed.
+	void Disarm_Fork_Page(uint32_t page)
+	{
+		_disarmed_pages.push_back(static_cast<uint8_t>(page));
+		_fork_armed[page] = false;
+
+		auto index = _page_fork_index[page];
+		if (_fork_versions[index] != 0)
+		{
+			_fork_versions[index] = 0;
+			_written_fork_pages.push_back(index);
+		}
+		_sealed = false;
+		_write_pages[page] = _code_pages[page] ? nullptr : _mapped_write_pages[page];
+	}
+
+	void Write_Slow(uint16_t address, uint8_t value)
+	{
+		auto page = address >> PAGE_SHIFT;
+		if (_fork_armed[page])
+		{
+			Disarm_Fork_Page(page);
+		}
+
+		if (_mapped_write_pages[page])
+		{
+			_mapped_write_pages[page][address & PAGE_MASK] = value;
+		}
+		else
+		{
+			(this->*_slow_handlers[page].write)(address, value);
+		}
+
+		// The last page is shared with IO, only high RAM can hold code there.
+		if (_code_pages[page] && (page != 0xFF || address >= MEMORY_SEGMENTS[static_cast<std::size_t>(Memory_Segment_Type::RAM_HIGH)].start))
+		{
+			Unwatch_Code_Page(page);
+		}
+	}
+
+	void Unwatch_Code_Page(uint32_t page)
+	{
+		_code_pages[page] = false;
+		_write_pages[page] = _fork_armed[page] ? nullptr : _mapped_write_pages[page];
+		_written_code_pages[page] = true;
+		_code_changed = true;
+	}
+
+	uint8_t Read_Mapped(uint16_t address)
+	{
+		return _read_pages[address >> PAGE_SHIFT][address & PAGE_MASK];
+	}
+
+	void Write_Mapped(uint16_t address, uint8_t value)
+	{
+		_mapped_write_pages[address >> PAGE_SHIFT][address & PAGE_MASK] = value;
+	}
+
+	// 0xFE00-0xFE9F is OAM, the rest of the page is unusable but kept as plain bytes.
+	uint8_t Read_OAM(uint16_t address)
+	{
+		uint32_t offset = address - OAM_START;
+		return offset < _oam.size() ? _oam[offset] : _invalid[offset - _oam.size()];
+	}
+
+	void Write_OAM(uint16_t address, uint8_t value)
+	{
+		uint32_t offset = address - OAM_START;
+		(offset < _oam.size() ? _oam[offset] : _invalid[offset - _oam.size()]) = value;
+	}
+
+	// 0xFF00-0xFF7F is IO, 0xFF80-0xFFFE high RAM and 0xFFFF interrupt enable.
+	uint8_t Read_High_Page(uint16_t address)
+	{
+		if (address >= HIGH_RAM_START)
+		{
+			return address < HIGH_RAM_END ? _high_ram[address - HIGH_RAM_START] : _interupts[0];
+		}
+
+		auto& handler = _io_handlers[address & IO_MASK];
+		if (handler.read)
+		{
+			_unsteady_reads += !handler.steady;
+			return handler.read(handler.context, address);
+		}
+
+		return _io[address & IO_MASK];
+	}
+
+	void Write_High_Page(uint16_t address, uint8_t value)
+	{
+		if (address >= HIGH_RAM_START)
+		{
+			(address < HIGH_RAM_END ? _high_ram[address - HIGH_RAM_START] : _interupts[0]) = value;
+			return;
+		}
+
+		auto& handler = _io_handlers[address & IO_MASK];
+		if (handler.write)
+		{
+			handler.write(handler.context, address, value);
+			return;
+		}
+
+		_io[address & IO_MASK] = value;
+	}
+
+	void Write_VRAM(uint16_t address, uint8_t value)
+	{
+		uint32_t offset = address - VRAM_START;
+		_vram[offset] = value;
+
+		uint32_t tile = offset >> 4;
+		_dirty_tiles[tile >> 6] |= uint64_t(1) << (tile & 63);
+	}
+
+	uint8_t Read_Unmapped(uint16_t /*address*/)
+	{
+		return 0xFF;
+	}
+
+	uint8_t Read_Cartridge(uint16_t address)
+	{
+		_unsteady_reads++;
+		return _cartridge_handler.read ? _cartridge_handler.read(_cartridge_handler.context, address) : 0xFF;
+	}
+
+	// Writes into ROM are bank controller commands.
+	void Write_Cartridge(uint16_t address, uint8_t value)
+	{
+		if (_cartridge_handler.write)
+		{
+			_cartridge_handler.write(_cartridge_handler.context, address, value);
+		}
+	}
+
+	const static uint32_t PAGE_SHIFT = 8;
+	const static uint32_t PAGE_SIZE = 1 << PAGE_SHIFT;
+	const static uint32_t PAGE_MASK = PAGE_SIZE - 1;
+	const static uint32_t PAGE_COUNT = 0x10000 >> PAGE_SHIFT;
+
+	const static uint16_t VRAM_START = 0x8000;
+	const static uint32_t TILE_DATA_SIZE = 0x1800;
+	const static uint16_t INTERNAL_RAM_START = 0xC000;
+	const static uint16_t ECHO_RAM_START = 0xE000;
+	const static uint16_t ECHO_RAM_END = 0xFE00;
+	const static uint16_t OAM_START = 0xFE00;
+	const static uint16_t IO_MASK = 0x7F;
+	const static uint16_t EXTERNAL_RAM_START = 0xA000;
+	const static std::ptrdiff_t EXTERNAL_RAM_SIZE = 0x2000;
+
+	// Fork pages are numbered internal RAM first, then VRAM, then cartridge RAM.
+	const static uint32_t INTERNAL_RAM_PAGES = 0x2000 >> PAGE_SHIFT;
+	const static uint32_t VRAM_PAGES = 0x2000 >> PAGE_SHIFT;
+	const static uint32_t VRAM_FORK_PAGE = INTERNAL_RAM_PAGES;
+	static constexpr uint16_t NO_FORK_PAGE = 0xFFFF;
+	const static std::size_t SEALED_PAGES_KEPT = 4; // Times the fork page count, before the log is cut.
+	const static uint16_t HIGH_RAM_START = MEMORY_SEGMENTS[static_cast<std::size_t>(Memory_Segment_Type::RAM_HIGH)].start;
+	const static uint16_t HIGH_RAM_END = MEMORY_SEGMENTS[static_cast<std::size_t>(Memory_Segment_Type::INTERUPT_ENABLE)].start;
+
+	std::array<const uint8_t*, PAGE_COUNT> _read_pages;
+	std::array<uint8_t*, PAGE_COUNT> _write_pages;
+	std::array<uint8_t*, PAGE_COUNT> _mapped_write_pages = {};
+	std::array<bool, PAGE_COUNT> _code_pages = {};
+	std::array<bool, PAGE_COUNT> _written_code_pages = {};
+	bool _code_changed = false;
+	std::array<uint64_t, TILE_DATA_SIZE / 16 / 64> _dirty_tiles = { ~uint64_t(0), ~uint64_t(0), ~uint64_t(0), ~uint64_t(0), ~uint64_t(0), ~uint64_t(0) };
+	std::array<Slow_Handler, PAGE_COUNT> _slow_handlers;
+	IO_Handler _cartridge_handler;
+	std::array<uint16_t, 2> _rom_banks = { 0, 1 };
+
+	std::vector<uint8_t*> _fork_pages;
+	std::vector<uint64_t> _fork_versions; // Zero once written since the last seal.
+	std::array<uint16_t, PAGE_COUNT> _page_fork_index;
+	std::array<bool, PAGE_COUNT> _fork_armed = {};
+	std::vector<uint16_t> _written_fork_pages; // Since the last seal, to give new versions.
+	std::vector<uint8_t> _disarmed_pages; // Since the last seal, to rearm.
+	bool _fork_versions_forgotten = true;
+	bool _sealed = false;
+	uint8_t* _cartridge_ram = nullptr;
+	uint8_t* _external_ram_bank = nullptr;
+	std::size_t _cartridge_fork_page = 0;
+	static inline std::atomic<uint64_t> _next_fork_version{ 1 };
+	static inline std::atomic<uint64_t> _next_id{ 1 };
+	const uint64_t _id = _next_id.fetch_add(1, std::memory_order_relaxed);
+
+	// The fork pages given new versions by each seal, or by a fork into this memory, in turn. The first of them is at
+	// position _sealed_pages_start.
+	std::vector<uint16_t> _sealed_pages;
+	uint64_t _sealed_pages_start = 0;
+
+	// The memory this one was last forked from, with where that one's log and this one's stood then.
+	uint64_t _fork_parent = 0;
+	uint64_t _parent_position = 0;
+	uint64_t _own_position = 0;
+	std::array<IO_Handler, MEMORY_SEGMENTS[static_cast<std::size_t>(Memory_Segment_Type::IO)].Size()> _io_handlers;
+	uint32_t _unsteady_reads = 0;
+
+	std::shared_ptr<const ROM_Image> _rom;
 	std::vector<uint8_t> _internal_ram;
 	std::vector<uint8_t> _internal_switched_ram;
 	std::vector<uint8_t> _vram;
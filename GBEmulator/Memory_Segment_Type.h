@@ -55,17 +55,3 @@ constexpr uint16_t Segment_Offset(uint16_t address, Memory_Segment_Type type)
 {
 	return address - MEMORY_SEGMENTS[static_cast<std::size_t>(type)].start;
 }
-
-constexpr Memory_Segment_Type Get_Memory_Segment(uint16_t address)
-{
-	for (const auto& segment : MEMORY_SEGMENTS)
-	{
-		if (address >= segment.start && address <= segment.end)
-		{
-			return segment.type;
-		}
-	}
-
-	// If we got here, the memory ranges above are wrong. 16 bit range should be completely mapped.
-	std::terminate();
-}
\ No newline at end of file
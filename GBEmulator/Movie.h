@@ -0,0 +1,96 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Save_State.h"
+
+// Joypad input keyed by frame, counted from when recording started. Only changes are stored, so a movie of a long
+// session stays small. Played back from power on with the same ROM, a movie reproduces the session exactly.
+class Movie
+{
+public:
+	Movie() = default;
+	explicit Movie(uint64_t rom_hash) : _rom_hash(rom_hash) {}
+
+	// Frames must be recorded in order.
+	void Record(uint32_t frame, uint8_t buttons)
+	{
+		if (_changes.empty() ? buttons != 0 : buttons != _changes.back().buttons)
+		{
+			_changes.push_back({ frame, buttons });
+		}
+		_length = std::max(_length, frame + 1);
+	}
+
+	// The buttons held during the given frame.
+	uint8_t Buttons(uint32_t frame) const
+	{
+		auto it = std::upper_bound(_changes.begin(), _changes.end(), frame, [](uint32_t frame, const Change& change) { return frame < change.frame; });
+		return it == _changes.begin() ? 0 : std::prev(it)->buttons;
+	}
+
+	// Frames recorded, including any with no input at the end.
+	uint32_t Length() const { return _length; }
+	uint64_t ROM_Hash() const { return _rom_hash; }
+
+	bool Save(const std::string& path) const
+	{
+		std::vector<uint8_t> data;
+		State_Writer writer(data);
+		writer.Write(MAGIC);
+		writer.Write(VERSION);
+		writer.Write(_rom_hash);
+		writer.Write(_length);
+		writer.Write(static_cast<uint32_t>(_changes.size()));
+		writer.Write_Block(_changes);
+
+		std::ofstream file(path, std::ios::binary);
+		file.write(reinterpret_cast<const char*>(data.data()), data.size());
+		return static_cast<bool>(file);
+	}
+
+	// Null if the file is missing or is not a movie of this version.
+	static std::unique_ptr<Movie> Load(const std::string& path)
+	{
+		std::ifstream file(path, std::ios::binary);
+		std::vector<uint8_t> data{ std::istreambuf_iterator<char>(file), {} };
+		State_Reader reader(data.data(), data.size());
+		if (reader.Read<uint32_t>() != MAGIC || reader.Read<uint32_t>() != VERSION)
+		{
+			return nullptr;
+		}
+
+		auto movie = std::make_unique<Movie>();
+		reader.Read(movie->_rom_hash);
+		reader.Read(movie->_length);
+		movie->_changes.resize(std::min<std::size_t>(reader.Read<uint32_t>(), data.size() / sizeof(Change)));
+		reader.Read_Block(movie->_changes);
+		if (!reader.Ok() || !reader.At_End())
+		{
+			return nullptr;
+		}
+
+		return movie;
+	}
+
+private:
+	static constexpr uint32_t MAGIC = 0x564D4247; // "GBMV"
+	static constexpr uint32_t VERSION = 1;
+
+	struct Change
+	{
+		uint32_t frame;
+		uint8_t buttons;
+		uint8_t padding[3] = {};
+	};
+
+	uint64_t _rom_hash = 0;
+	uint32_t _length = 0;
+	std::vector<Change> _changes;
+};
@@ -0,0 +1,591 @@
+#pragma once
+
+#include <cstdint>
+#include <array>
+
+struct Opcode_Info
+{
+	const char* mnemonic;
+	uint8_t length;       // Bytes including the opcode (and the 0xCB prefix for CB opcodes).
+	uint8_t cycles;       // Cycles when a conditional branch is not taken, or the only cost otherwise.
+	uint8_t cycles_taken; // Cycles when a conditional branch is taken.
+
+	constexpr Opcode_Info(const char* mnemonic, uint8_t length, uint8_t cycles, uint8_t cycles_taken)
+		: mnemonic(mnemonic), length(length), cycles(cycles), cycles_taken(cycles_taken) {}
+};
+
+// The 0xCB entry only covers the prefix, the full cost of a CB instruction comes from CB_OPCODES.
+constexpr std::array<Opcode_Info, 256> OPCODES =
+{
+	Opcode_Info{ "NOP", 1, 4, 4 }, // 0x00
+	Opcode_Info{ "LD BC,u16", 3, 12, 12 }, // 0x01
+	Opcode_Info{ "LD (BC),A", 1, 8, 8 }, // 0x02
+	Opcode_Info{ "INC BC", 1, 8, 8 }, // 0x03
+	Opcode_Info{ "INC B", 1, 4, 4 }, // 0x04
+	Opcode_Info{ "DEC B", 1, 4, 4 }, // 0x05
+	Opcode_Info{ "LD B,u8", 2, 8, 8 }, // 0x06
+	Opcode_Info{ "RLCA", 1, 4, 4 }, // 0x07
+	Opcode_Info{ "LD (u16),SP", 3, 20, 20 }, // 0x08
+	Opcode_Info{ "ADD HL,BC", 1, 8, 8 }, // 0x09
+	Opcode_Info{ "LD A,(BC)", 1, 8, 8 }, // 0x0A
+	Opcode_Info{ "DEC BC", 1, 8, 8 }, // 0x0B
+	Opcode_Info{ "INC C", 1, 4, 4 }, // 0x0C
+	Opcode_Info{ "DEC C", 1, 4, 4 }, // 0x0D
+	Opcode_Info{ "LD C,u8", 2, 8, 8 }, // 0x0E
+	Opcode_Info{ "RRCA", 1, 4, 4 }, // 0x0F
+	Opcode_Info{ "STOP", 2, 4, 4 }, // 0x10
+	Opcode_Info{ "LD DE,u16", 3, 12, 12 }, // 0x11
+	Opcode_Info{ "LD (DE),A", 1, 8, 8 }, // 0x12
+	Opcode_Info{ "INC DE", 1, 8, 8 }, // 0x13
+	Opcode_Info{ "INC D", 1, 4, 4 }, // 0x14
+	Opcode_Info{ "DEC D", 1, 4, 4 }, // 0x15
+	Opcode_Info{ "LD D,u8", 2, 8, 8 }, // 0x16
+	Opcode_Info{ "RLA", 1, 4, 4 }, // 0x17
+	Opcode_Info{ "JR i8", 2, 12, 12 }, // 0x18
+	Opcode_Info{ "ADD HL,DE", 1, 8, 8 }, // 0x19
+	Opcode_Info{ "LD A,(DE)", 1, 8, 8 }, // 0x1A
+	Opcode_Info{ "DEC DE", 1, 8, 8 }, // 0x1B
+	Opcode_Info{ "INC E", 1, 4, 4 }, // 0x1C
+	Opcode_Info{ "DEC E", 1, 4, 4 }, // 0x1D
+	Opcode_Info{ "LD E,u8", 2, 8, 8 }, // 0x1E
+	Opcode_Info{ "RRA", 1, 4, 4 }, // 0x1F
+	Opcode_Info{ "JR NZ,i8", 2, 8, 12 }, // 0x20
+	Opcode_Info{ "LD HL,u16", 3, 12, 12 }, // 0x21
+	Opcode_Info{ "LD (HL+),A", 1, 8, 8 }, // 0x22
+	Opcode_Info{ "INC HL", 1, 8, 8 }, // 0x23
+	Opcode_Info{ "INC H", 1, 4, 4 }, // 0x24
+	Opcode_Info{ "DEC H", 1, 4, 4 }, // 0x25
+	Opcode_Info{ "LD H,u8", 2, 8, 8 }, // 0x26
+	Opcode_Info{ "DAA", 1, 4, 4 }, // 0x27
+	Opcode_Info{ "JR Z,i8", 2, 8, 12 }, // 0x28
+	Opcode_Info{ "ADD HL,HL", 1, 8, 8 }, // 0x29
+	Opcode_Info{ "LD A,(HL+)", 1, 8, 8 }, // 0x2A
+	Opcode_Info{ "DEC HL", 1, 8, 8 }, // 0x2B
+	Opcode_Info{ "INC L", 1, 4, 4 }, // 0x2C
+	Opcode_Info{ "DEC L", 1, 4, 4 }, // 0x2D
+	Opcode_Info{ "LD L,u8", 2, 8, 8 }, // 0x2E
+	Opcode_Info{ "CPL", 1, 4, 4 }, // 0x2F
+	Opcode_Info{ "JR NC,i8", 2, 8, 12 }, // 0x30
+	Opcode_Info{ "LD SP,u16", 3, 12, 12 }, // 0x31
+	Opcode_Info{ "LD (HL-),A", 1, 8, 8 }, // 0x32
+	Opcode_Info{ "INC SP", 1, 8, 8 }, // 0x33
+	Opcode_Info{ "INC (HL)", 1, 12, 12 }, // 0x34
+	Opcode_Info{ "DEC (HL)", 1, 12, 12 }, // 0x35
+	Opcode_Info{ "LD (HL),u8", 2, 12, 12 }, // 0x36
+	Opcode_Info{ "SCF", 1, 4, 4 }, // 0x37
+	Opcode_Info{ "JR C,i8", 2, 8, 12 }, // 0x38
+	Opcode_Info{ "ADD HL,SP", 1, 8, 8 }, // 0x39
+	Opcode_Info{ "LD A,(HL-)", 1, 8, 8 }, // 0x3A
+	Opcode_Info{ "DEC SP", 1, 8, 8 }, // 0x3B
+	Opcode_Info{ "INC A", 1, 4, 4 }, // 0x3C
+	Opcode_Info{ "DEC A", 1, 4, 4 }, // 0x3D
+	Opcode_Info{ "LD A,u8", 2, 8, 8 }, // 0x3E
+	Opcode_Info{ "CCF", 1, 4, 4 }, // 0x3F
+	Opcode_Info{ "LD B,B", 1, 4, 4 }, // 0x40
+	Opcode_Info{ "LD B,C", 1, 4, 4 }, // 0x41
+	Opcode_Info{ "LD B,D", 1, 4, 4 }, // 0x42
+	Opcode_Info{ "LD B,E", 1, 4, 4 }, // 0x43
+	Opcode_Info{ "LD B,H", 1, 4, 4 }, // 0x44
+	Opcode_Info{ "LD B,L", 1, 4, 4 }, // 0x45
+	Opcode_Info{ "LD B,(HL)", 1, 8, 8 }, // 0x46
+	Opcode_Info{ "LD B,A", 1, 4, 4 }, // 0x47
+	Opcode_Info{ "LD C,B", 1, 4, 4 }, // 0x48
+	Opcode_Info{ "LD C,C", 1, 4, 4 }, // 0x49
+	Opcode_Info{ "LD C,D", 1, 4, 4 }, // 0x4A
+	Opcode_Info{ "LD C,E", 1, 4, 4 }, // 0x4B
+	Opcode_Info{ "LD C,H", 1, 4, 4 }, // 0x4C
+	Opcode_Info{ "LD C,L", 1, 4, 4 }, // 0x4D
+	Opcode_Info{ "LD C,(HL)", 1, 8, 8 }, // 0x4E
+	Opcode_Info{ "LD C,A", 1, 4, 4 }, // 0x4F
+	Opcode_Info{ "LD D,B", 1, 4, 4 }, // 0x50
+	Opcode_Info{ "LD D,C", 1, 4, 4 }, // 0x51
+	Opcode_Info{ "LD D,D", 1, 4, 4 }, // 0x52
+	Opcode_Info{ "LD D,E", 1, 4, 4 }, // 0x53
+	Opcode_Info{ "LD D,H", 1, 4, 4 }, // 0x54
+	Opcode_Info{ "LD D,L", 1, 4, 4 }, // 0x55
+	Opcode_Info{ "LD D,(HL)", 1, 8, 8 }, // 0x56
+	Opcode_Info{ "LD D,A", 1, 4, 4 }, // 0x57
+	Opcode_Info{ "LD E,B", 1, 4, 4 }, // 0x58
+	Opcode_Info{ "LD E,C", 1, 4, 4 }, // 0x59
+	Opcode_Info{ "LD E,D", 1, 4, 4 }, // 0x5A
+	Opcode_Info{ "LD E,E", 1, 4, 4 }, // 0x5B
+	Opcode_Info{ "LD E,H", 1, 4, 4 }, // 0x5C
+	Opcode_Info{ "LD E,L", 1, 4, 4 }, // 0x5D
+	Opcode_Info{ "LD E,(HL)", 1, 8, 8 }, // 0x5E
+	Opcode_Info{ "LD E,A", 1, 4, 4 }, // 0x5F
+	Opcode_Info{ "LD H,B", 1, 4, 4 }, // 0x60
+	Opcode_Info{ "LD H,C", 1, 4, 4 }, // 0x61
+	Opcode_Info{ "LD H,D", 1, 4, 4 }, // 0x62
+	Opcode_Info{ "LD H,E", 1, 4, 4 }, // 0x63
+	Opcode_Info{ "LD H,H", 1, 4, 4 }, // 0x64
+	Opcode_Info{ "LD H,L", 1, 4, 4 }, // 0x65
+	Opcode_Info{ "LD H,(HL)", 1, 8, 8 }, // 0x66
+	Opcode_Info{ "LD H,A", 1, 4, 4 }, // 0x67
+	Opcode_Info{ "LD L,B", 1, 4, 4 }, // 0x68
+	Opcode_Info{ "LD L,C", 1, 4, 4 }, // 0x69
+	Opcode_Info{ "LD L,D", 1, 4, 4 }, // 0x6A
+	Opcode_Info{ "LD L,E", 1, 4, 4 }, // 0x6B
+	Opcode_Info{ "LD L,H", 1, 4, 4 }, // 0x6C
+	Opcode_Info{ "LD L,L", 1, 4, 4 }, // 0x6D
+	Opcode_Info{ "LD L,(HL)", 1, 8, 8 }, // 0x6E
+	Opcode_Info{ "LD L,A", 1, 4, 4 }, // 0x6F
+	Opcode_Info{ "LD (HL),B", 1, 8, 8 }, // 0x70
+	Opcode_Info{ "LD (HL),C", 1, 8, 8 }, // 0x71
+	Opcode_Info{ "LD (HL),D", 1, 8, 8 }, // 0x72
+	Opcode_Info{ "LD (HL),E", 1, 8, 8 }, // 0x73
+	Opcode_Info{ "LD (HL),H", 1, 8, 8 }, // 0x74
+	Opcode_Info{ "LD (HL),L", 1, 8, 8 }, // 0x75
+	Opcode_Info{ "HALT", 1, 4, 4 }, // 0x76
+	Opcode_Info{ "LD (HL),A", 1, 8, 8 }, // 0x77
+	Opcode_Info{ "LD A,B", 1, 4, 4 }, // 0x78
+	Opcode_Info{ "LD A,C", 1, 4, 4 }, // 0x79
+	Opcode_Info{ "LD A,D", 1, 4, 4 }, // 0x7A
+	Opcode_Info{ "LD A,E", 1, 4, 4 }, // 0x7B
+	Opcode_Info{ "LD A,H", 1, 4, 4 }, // 0x7C
+	Opcode_Info{ "LD A,L", 1, 4, 4 }, // 0x7D
+	Opcode_Info{ "LD A,(HL)", 1, 8, 8 }, // 0x7E
+	Opcode_Info{ "LD A,A", 1, 4, 4 }, // 0x7F
+	Opcode_Info{ "ADD A,B", 1, 4, 4 }, // 0x80
+	Opcode_Info{ "ADD A,C", 1, 4, 4 }, // 0x81
+	Opcode_Info{ "ADD A,D", 1, 4, 4 }, // 0x82
+	Opcode_Info{ "ADD A,E", 1, 4, 4 }, // 0x83
+	Opcode_Info{ "ADD A,H", 1, 4, 4 }, // 0x84
+	Opcode_Info{ "ADD A,L", 1, 4, 4 }, // 0x85
+	Opcode_Info{ "ADD A,(HL)", 1, 8, 8 }, // 0x86
+	Opcode_Info{ "ADD A,A", 1, 4, 4 }, // 0x87
+	Opcode_Info{ "ADC A,B", 1, 4, 4 }, // 0x88
+	Opcode_Info{ "ADC A,C", 1, 4, 4 }, // 0x89
+	Opcode_Info{ "ADC A,D", 1, 4, 4 }, // 0x8A
+	Opcode_Info{ "ADC A,E", 1, 4, 4 }, // 0x8B
+	Opcode_Info{ "ADC A,H", 1, 4, 4 }, // 0x8C
+	Opcode_Info{ "ADC A,L", 1, 4, 4 }, // 0x8D
+	Opcode_Info{ "ADC A,(HL)", 1, 8, 8 }, // 0x8E
+	Opcode_Info{ "ADC A,A", 1, 4, 4 }, // 0x8F
+	Opcode_Info{ "SUB A,B", 1, 4, 4 }, // 0x90
+	Opcode_Info{ "SUB A,C", 1, 4, 4 }, // 0x91
+	Opcode_Info{ "SUB A,D", 1, 4, 4 }, // 0x92
+	Opcode_Info{ "SUB A,E", 1, 4, 4 }, // 0x93
+	Opcode_Info{ "SUB A,H", 1, 4, 4 }, // 0x94
+	Opcode_Info{ "SUB A,L", 1, 4, 4 }, // 0x95
+	Opcode_Info{ "SUB A,(HL)", 1, 8, 8 }, // 0x96
+	Opcode_Info{ "SUB A,A", 1, 4, 4 }, // 0x97
+	Opcode_Info{ "SBC A,B", 1, 4, 4 }, // 0x98
+	Opcode_Info{ "SBC A,C", 1, 4, 4 }, // 0x99
+	Opcode_Info{ "SBC A,D", 1, 4, 4 }, // 0x9A
+	Opcode_Info{ "SBC A,E", 1, 4, 4 }, // 0x9B
+	Opcode_Info{ "SBC A,H", 1, 4, 4 }, // 0x9C
+	Opcode_Info{ "SBC A,L", 1, 4, 4 }, // 0x9D
+	Opcode_Info{ "SBC A,(HL)", 1, 8, 8 }, // 0x9E
+	Opcode_Info{ "SBC A,A", 1, 4, 4 }, // 0x9F
+	Opcode_Info{ "AND A,B", 1, 4, 4 }, // 0xA0
+	Opcode_Info{ "AND A,C", 1, 4, 4 }, // 0xA1
+	Opcode_Info{ "AND A,D", 1, 4, 4 }, // 0xA2
+	Opcode_Info{ "AND A,E", 1, 4, 4 }, // 0xA3
+	Opcode_Info{ "AND A,H", 1, 4, 4 }, // 0xA4
+	Opcode_Info{ "AND A,L", 1, 4, 4 }, // 0xA5
+	Opcode_Info{ "AND A,(HL)", 1, 8, 8 }, // 0xA6
+	Opcode_Info{ "AND A,A", 1, 4, 4 }, // 0xA7
+	Opcode_Info{ "XOR A,B", 1, 4, 4 }, // 0xA8
+	Opcode_Info{ "XOR A,C", 1, 4, 4 }, // 0xA9
+	Opcode_Info{ "XOR A,D", 1, 4, 4 }, // 0xAA
+	Opcode_Info{ "XOR A,E", 1, 4, 4 }, // 0xAB
+	Opcode_Info{ "XOR A,H", 1, 4, 4 }, // 0xAC
+	Opcode_Info{ "XOR A,L", 1, 4, 4 }, // 0xAD
+	Opcode_Info{ "XOR A,(HL)", 1, 8, 8 }, // 0xAE
+	Opcode_Info{ "XOR A,A", 1, 4, 4 }, // 0xAF
+	Opcode_Info{ "OR A,B", 1, 4, 4 }, // 0xB0
+	Opcode_Info{ "OR A,C", 1, 4, 4 }, // 0xB1
+	Opcode_Info{ "OR A,D", 1, 4, 4 }, // 0xB2
+	Opcode_Info{ "OR A,E", 1, 4, 4 }, // 0xB3
+	Opcode_Info{ "OR A,H", 1, 4, 4 }, // 0xB4
+	Opcode_Info{ "OR A,L", 1, 4, 4 }, // 0xB5
+	Opcode_Info{ "OR A,(HL)", 1, 8, 8 }, // 0xB6
+	Opcode_Info{ "OR A,A", 1, 4, 4 }, // 0xB7
+	Opcode_Info{ "CP A,B", 1, 4, 4 }, // 0xB8
+	Opcode_Info{ "CP A,C", 1, 4, 4 }, // 0xB9
+	Opcode_Info{ "CP A,D", 1, 4, 4 }, // 0xBA
+	Opcode_Info{ "CP A,E", 1, 4, 4 }, // 0xBB
+	Opcode_Info{ "CP A,H", 1, 4, 4 }, // 0xBC
+	Opcode_Info{ "CP A,L", 1, 4, 4 }, // 0xBD
+	Opcode_Info{ "CP A,(HL)", 1, 8, 8 }, // 0xBE
+	Opcode_Info{ "CP A,A", 1, 4, 4 }, // 0xBF
+	Opcode_Info{ "RET NZ", 1, 8, 20 }, // 0xC0
+	Opcode_Info{ "POP BC", 1, 12, 12 }, // 0xC1
+	Opcode_Info{ "JP NZ,u16", 3, 12, 16 }, // 0xC2
+	Opcode_Info{ "JP u16", 3, 16, 16 }, // 0xC3
+	Opcode_Info{ "CALL NZ,u16", 3, 12, 24 }, // 0xC4
+	Opcode_Info{ "PUSH BC", 1, 16, 16 }, // 0xC5
+	Opcode_Info{ "ADD A,u8", 2, 8, 8 }, // 0xC6
+	Opcode_Info{ "RST 00h", 1, 16, 16 }, // 0xC7
+	Opcode_Info{ "RET Z", 1, 8, 20 }, // 0xC8
+	Opcode_Info{ "RET", 1, 16, 16 }, // 0xC9
+	Opcode_Info{ "JP Z,u16", 3, 12, 16 }, // 0xCA
+	Opcode_Info{ "PREFIX CB", 2, 4, 4 }, // 0xCB
+	Opcode_Info{ "CALL Z,u16", 3, 12, 24 }, // 0xCC
+	Opcode_Info{ "CALL u16", 3, 24, 24 }, // 0xCD
+	Opcode_Info{ "ADC A,u8", 2, 8, 8 }, // 0xCE
+	Opcode_Info{ "RST 08h", 1, 16, 16 }, // 0xCF
+	Opcode_Info{ "RET NC", 1, 8, 20 }, // 0xD0
+	Opcode_Info{ "POP DE", 1, 12, 12 }, // 0xD1
+	Opcode_Info{ "JP NC,u16", 3, 12, 16 }, // 0xD2
+	Opcode_Info{ "ILLEGAL", 1, 4, 4 }, // 0xD3
+	Opcode_Info{ "CALL NC,u16", 3, 12, 24 }, // 0xD4
+	Opcode_Info{ "PUSH DE", 1, 16, 16 }, // 0xD5
+	Opcode_Info{ "SUB A,u8", 2, 8, 8 }, // 0xD6
+	Opcode_Info{ "RST 10h", 1, 16, 16 }, // 0xD7
+	Opcode_Info{ "RET C", 1, 8, 20 }, // 0xD8
+	Opcode_Info{ "RETI", 1, 16, 16 }, // 0xD9
+	Opcode_Info{ "JP C,u16", 3, 12, 16 }, // 0xDA
+	Opcode_Info{ "ILLEGAL", 1, 4, 4 }, // 0xDB
+	Opcode_Info{ "CALL C,u16", 3, 12, 24 }, // 0xDC
+	Opcode_Info{ "ILLEGAL", 1, 4, 4 }, // 0xDD
+	Opcode_Info{ "SBC A,u8", 2, 8, 8 }, // 0xDE
+	Opcode_Info{ "RST 18h", 1, 16, 16 }, // 0xDF
+	Opcode_Info{ "LD (FF00+u8),A", 2, 12, 12 }, // 0xE0
+	Opcode_Info{ "POP HL", 1, 12, 12 }, // 0xE1
+	Opcode_Info{ "LD (FF00+C),A", 1, 8, 8 }, // 0xE2
+	Opcode_Info{ "ILLEGAL", 1, 4, 4 }, // 0xE3
+	Opcode_Info{ "ILLEGAL", 1, 4, 4 }, // 0xE4
+	Opcode_Info{ "PUSH HL", 1, 16, 16 }, // 0xE5
+	Opcode_Info{ "AND A,u8", 2, 8, 8 }, // 0xE6
+	Opcode_Info{ "RST 20h", 1, 16, 16 }, // 0xE7
+	Opcode_Info{ "ADD SP,i8", 2, 16, 16 }, // 0xE8
+	Opcode_Info{ "JP HL", 1, 4, 4 }, // 0xE9
+	Opcode_Info{ "LD (u16),A", 3, 16, 16 }, // 0xEA
+	Opcode_Info{ "ILLEGAL", 1, 4, 4 }, // 0xEB
+	Opcode_Info{ "ILLEGAL", 1, 4, 4 }, // 0xEC
+	Opcode_Info{ "ILLEGAL", 1, 4, 4 }, // 0xED
+	Opcode_Info{ "XOR A,u8", 2, 8, 8 }, // 0xEE
+	Opcode_Info{ "RST 28h", 1, 16, 16 }, // 0xEF
+	Opcode_Info{ "LD A,(FF00+u8)", 2, 12, 12 }, // 0xF0
+	Opcode_Info{ "POP AF", 1, 12, 12 }, // 0xF1
+	Opcode_Info{ "LD A,(FF00+C)", 1, 8, 8 }, // 0xF2
+	Opcode_Info{ "DI", 1, 4, 4 }, // 0xF3
+	Opcode_Info{ "ILLEGAL", 1, 4, 4 }, // 0xF4
+	Opcode_Info{ "PUSH AF", 1, 16, 16 }, // 0xF5
+	Opcode_Info{ "OR A,u8", 2, 8, 8 }, // 0xF6
+	Opcode_Info{ "RST 30h", 1, 16, 16 }, // 0xF7
+	Opcode_Info{ "LD HL,SP+i8", 2, 12, 12 }, // 0xF8
+	Opcode_Info{ "LD SP,HL", 1, 8, 8 }, // 0xF9
+	Opcode_Info{ "LD A,(u16)", 3, 16, 16 }, // 0xFA
+	Opcode_Info{ "EI", 1, 4, 4 }, // 0xFB
+	Opcode_Info{ "ILLEGAL", 1, 4, 4 }, // 0xFC
+	Opcode_Info{ "ILLEGAL", 1, 4, 4 }, // 0xFD
+	Opcode_Info{ "CP A,u8", 2, 8, 8 }, // 0xFE
+	Opcode_Info{ "RST 38h", 1, 16, 16 } // 0xFF
+};
+
+constexpr std::array<Opcode_Info, 256> CB_OPCODES =
+{
+	Opcode_Info{ "RLC B", 2, 8, 8 }, // 0xCB 0x00
+	Opcode_Info{ "RLC C", 2, 8, 8 }, // 0xCB 0x01
+	Opcode_Info{ "RLC D", 2, 8, 8 }, // 0xCB 0x02
+	Opcode_Info{ "RLC E", 2, 8, 8 }, // 0xCB 0x03
+	Opcode_Info{ "RLC H", 2, 8, 8 }, // 0xCB 0x04
+	Opcode_Info{ "RLC L", 2, 8, 8 }, // 0xCB 0x05
+	Opcode_Info{ "RLC (HL)", 2, 16, 16 }, // 0xCB 0x06
+	Opcode_Info{ "RLC A", 2, 8, 8 }, // 0xCB 0x07
+	Opcode_Info{ "RRC B", 2, 8, 8 }, // 0xCB 0x08
+	Opcode_Info{ "RRC C", 2, 8, 8 }, // 0xCB 0x09
+	Opcode_Info{ "RRC D", 2, 8, 8 }, // 0xCB 0x0A
+	Opcode_Info{ "RRC E", 2, 8, 8 }, // 0xCB 0x0B
+	Opcode_Info{ "RRC H", 2, 8, 8 }, // 0xCB 0x0C
+	Opcode_Info{ "RRC L", 2, 8, 8 }, // 0xCB 0x0D
+	Opcode_Info{ "RRC (HL)", 2, 16, 16 }, // 0xCB 0x0E
+	Opcode_Info{ "RRC A", 2, 8, 8 }, // 0xCB 0x0F
+	Opcode_Info{ "RL B", 2, 8, 8 }, // 0xCB 0x10
+	Opcode_Info{ "RL C", 2, 8, 8 }, // 0xCB 0x11
+	Opcode_Info{ "RL D", 2, 8, 8 }, // 0xCB 0x12
+	Opcode_Info{ "RL E", 2, 8, 8 }, // 0xCB 0x13
+	Opcode_Info{ "RL H", 2, 8, 8 }, // 0xCB 0x14
+	Opcode_Info{ "RL L", 2, 8, 8 }, // 0xCB 0x15
+	Opcode_Info{ "RL (HL)", 2, 16, 16 }, // 0xCB 0x16
+	Opcode_Info{ "RL A", 2, 8, 8 }, // 0xCB 0x17
+	Opcode_Info{ "RR B", 2, 8, 8 }, // 0xCB 0x18
+	Opcode_Info{ "RR C", 2, 8, 8 }, // 0xCB 0x19
+	Opcode_Info{ "RR D", 2, 8, 8 }, // 0xCB 0x1A
+	Opcode_Info{ "RR E", 2, 8, 8 }, // 0xCB 0x1B
+	Opcode_Info{ "RR H", 2, 8, 8 }, // 0xCB 0x1C
+	Opcode_Info{ "RR L", 2, 8, 8 }, // 0xCB 0x1D
+	Opcode_Info{ "RR (HL)", 2, 16, 16 }, // 0xCB 0x1E
+	Opcode_Info{ "RR A", 2, 8, 8 }, // 0xCB 0x1F
+	Opcode_Info{ "SLA B", 2, 8, 8 }, // 0xCB 0x20
+	Opcode_Info{ "SLA C", 2, 8, 8 }, // 0xCB 0x21
+	Opcode_Info{ "SLA D", 2, 8, 8 }, // 0xCB 0x22
+	Opcode_Info{ "SLA E", 2, 8, 8 }, // 0xCB 0x23
+	Opcode_Info{ "SLA H", 2, 8, 8 }, // 0xCB 0x24
+	Opcode_Info{ "SLA L", 2, 8, 8 }, // 0xCB 0x25
+	Opcode_Info{ "SLA (HL)", 2, 16, 16 }, // 0xCB 0x26
+	Opcode_Info{ "SLA A", 2, 8, 8 }, // 0xCB 0x27
+	Opcode_Info{ "SRA B", 2, 8, 8 }, // 0xCB 0x28
+	Opcode_Info{ "SRA C", 2, 8, 8 }, // 0xCB 0x29
+	Opcode_Info{ "SRA D", 2, 8, 8 }, // 0xCB 0x2A
+	Opcode_Info{ "SRA E", 2, 8, 8 }, // 0xCB 0x2B
+	Opcode_Info{ "SRA H", 2, 8, 8 }, // 0xCB 0x2C
+	Opcode_Info{ "SRA L", 2, 8, 8 }, // 0xCB 0x2D
+	Opcode_Info{ "SRA (HL)", 2, 16, 16 }, // 0xCB 0x2E
+	Opcode_Info{ "SRA A", 2, 8, 8 }, // 0xCB 0x2F
+	Opcode_Info{ "SWAP B", 2, 8, 8 }, // 0xCB 0x30
+	Opcode_Info{ "SWAP C", 2, 8, 8 }, // 0xCB 0x31
+	Opcode_Info{ "SWAP D", 2, 8, 8 }, // 0xCB 0x32
+	Opcode_Info{ "SWAP E", 2, 8, 8 }, // 0xCB 0x33
+	Opcode_Info{ "SWAP H", 2, 8, 8 }, // 0xCB 0x34
+	Opcode_Info{ "SWAP L", 2, 8, 8 }, // 0xCB 0x35
+	Opcode_Info{ "SWAP (HL)", 2, 16, 16 }, // 0xCB 0x36
+	Opcode_Info{ "SWAP A", 2, 8, 8 }, // 0xCB 0x37
+	Opcode_Info{ "SRL B", 2, 8, 8 }, // 0xCB 0x38
+	Opcode_Info{ "SRL C", 2, 8, 8 }, // 0xCB 0x39
+	Opcode_Info{ "SRL D", 2, 8, 8 }, // 0xCB 0x3A
+	Opcode_Info{ "SRL E", 2, 8, 8 }, // 0xCB 0x3B
+	Opcode_Info{ "SRL H", 2, 8, 8 }, // 0xCB 0x3C
+	Opcode_Info{ "SRL L", 2, 8, 8 }, // 0xCB 0x3D
+	Opcode_Info{ "SRL (HL)", 2, 16, 16 }, // 0xCB 0x3E
+	Opcode_Info{ "SRL A", 2, 8, 8 }, // 0xCB 0x3F
+	Opcode_Info{ "BIT 0,B", 2, 8, 8 }, // 0xCB 0x40
+	Opcode_Info{ "BIT 0,C", 2, 8, 8 }, // 0xCB 0x41
+	Opcode_Info{ "BIT 0,D", 2, 8, 8 }, // 0xCB 0x42
+	Opcode_Info{ "BIT 0,E", 2, 8, 8 }, // 0xCB 0x43
+	Opcode_Info{ "BIT 0,H", 2, 8, 8 }, // 0xCB 0x44
+	Opcode_Info{ "BIT 0,L", 2, 8, 8 }, // 0xCB 0x45
+	Opcode_Info{ "BIT 0,(HL)", 2, 12, 12 }, // 0xCB 0x46
+	Opcode_Info{ "BIT 0,A", 2, 8, 8 }, // 0xCB 0x47
+	Opcode_Info{ "BIT 1,B", 2, 8, 8 }, // 0xCB 0x48
+	Opcode_Info{ "BIT 1,C", 2, 8, 8 }, // 0xCB 0x49
+	Opcode_Info{ "BIT 1,D", 2, 8, 8 }, // 0xCB 0x4A
+	Opcode_Info{ "BIT 1,E", 2, 8, 8 }, // 0xCB 0x4B
+	Opcode_Info{ "BIT 1,H", 2, 8, 8 }, // 0xCB 0x4C
+	Opcode_Info{ "BIT 1,L", 2, 8, 8 }, // 0xCB 0x4D
+	Opcode_Info{ "BIT 1,(HL)", 2, 12, 12 }, // 0xCB 0x4E
+	Opcode_Info{ "BIT 1,A", 2, 8, 8 }, // 0xCB 0x4F
+	Opcode_Info{ "BIT 2,B", 2, 8, 8 }, // 0xCB 0x50
+	Opcode_Info{ "BIT 2,C", 2, 8, 8 }, // 0xCB 0x51
+	Opcode_Info{ "BIT 2,D", 2, 8, 8 }, // 0xCB 0x52
+	Opcode_Info{ "BIT 2,E", 2, 8, 8 }, // 0xCB 0x53
+	Opcode_Info{ "BIT 2,H", 2, 8, 8 }, // 0xCB 0x54
+	Opcode_Info{ "BIT 2,L", 2, 8, 8 }, // 0xCB 0x55
+	Opcode_Info{ "BIT 2,(HL)", 2, 12, 12 }, // 0xCB 0x56
+	Opcode_Info{ "BIT 2,A", 2, 8, 8 }, // 0xCB 0x57
+	Opcode_Info{ "BIT 3,B", 2, 8, 8 }, // 0xCB 0x58
+	Opcode_Info{ "BIT 3,C", 2, 8, 8 }, // 0xCB 0x59
+	Opcode_Info{ "BIT 3,D", 2, 8, 8 }, // 0xCB 0x5A
+	Opcode_Info{ "BIT 3,E", 2, 8, 8 }, // 0xCB 0x5B
+	Opcode_Info{ "BIT 3,H", 2, 8, 8 }, // 0xCB 0x5C
+	Opcode_Info{ "BIT 3,L", 2, 8, 8 }, // 0xCB 0x5D
+	Opcode_Info{ "BIT 3,(HL)", 2, 12, 12 }, // 0xCB 0x5E
+	Opcode_Info{ "BIT 3,A", 2, 8, 8 }, // 0xCB 0x5F
+	Opcode_Info{ "BIT 4,B", 2, 8, 8 }, // 0xCB 0x60
+	Opcode_Info{ "BIT 4,C", 2, 8, 8 }, // 0xCB 0x61
+	Opcode_Info{ "BIT 4,D", 2, 8, 8 }, // 0xCB 0x62
+	Opcode_Info{ "BIT 4,E", 2, 8, 8 }, // 0xCB 0x63
+	Opcode_Info{ "BIT 4,H", 2, 8, 8 }, // 0xCB 0x64
+	Opcode_Info{ "BIT 4,L", 2, 8, 8 }, // 0xCB 0x65
+	Opcode_Info{ "BIT 4,(HL)", 2, 12, 12 }, // 0xCB 0x66
+	Opcode_Info{ "BIT 4,A", 2, 8, 8 }, // 0xCB 0x67
+	Opcode_Info{ "BIT 5,B", 2, 8, 8 }, // 0xCB 0x68
+	Opcode_Info{ "BIT 5,C", 2, 8, 8 }, // 0xCB 0x69
+	Opcode_Info{ "BIT 5,D", 2, 8, 8 }, // 0xCB 0x6A
+	Opcode_Info{ "BIT 5,E", 2, 8, 8 }, // 0xCB 0x6B
+	Opcode_Info{ "BIT 5,H", 2, 8, 8 }, // 0xCB 0x6C
+	Opcode_Info{ "BIT 5,L", 2, 8, 8 }, // 0xCB 0x6D
+	Opcode_Info{ "BIT 5,(HL)", 2, 12, 12 }, // 0xCB 0x6E
+	Opcode_Info{ "BIT 5,A", 2, 8, 8 }, // 0xCB 0x6F
+	Opcode_Info{ "BIT 6,B", 2, 8, 8 }, // 0xCB 0x70
+	Opcode_Info{ "BIT 6,C", 2, 8, 8 }, // 0xCB 0x71
+	Opcode_Info{ "BIT 6,D", 2, 8, 8 }, // 0xCB 0x72
+	Opcode_Info{ "BIT 6,E", 2, 8, 8 }, // 0xCB 0x73
+	Opcode_Info{ "BIT 6,H", 2, 8, 8 }, // 0xCB 0x74
+	Opcode_Info{ "BIT 6,L", 2, 8, 8 }, // 0xCB 0x75
+	Opcode_Info{ "BIT 6,(HL)", 2, 12, 12 }, // 0xCB 0x76
+	Opcode_Info{ "BIT 6,A", 2, 8, 8 }, // 0xCB 0x77
+	Opcode_Info{ "BIT 7,B", 2, 8, 8 }, // 0xCB 0x78
+	Opcode_Info{ "BIT 7,C", 2, 8, 8 }, // 0xCB 0x79
+	Opcode_Info{ "BIT 7,D", 2, 8, 8 }, // 0xCB 0x7A
+	Opcode_Info{ "BIT 7,E", 2, 8, 8 }, // 0xCB 0x7B
+	Opcode_Info{ "BIT 7,H", 2, 8, 8 }, // 0xCB 0x7C
+	Opcode_Info{ "BIT 7,L", 2, 8, 8 }, // 0xCB 0x7D
+	Opcode_Info{ "BIT 7,(HL)", 2, 12, 12 }, // 0xCB 0x7E
+	Opcode_Info{ "BIT 7,A", 2, 8, 8 }, // 0xCB 0x7F
+	Opcode_Info{ "RES 0,B", 2, 8, 8 }, // 0xCB 0x80
+	Opcode_Info{ "RES 0,C", 2, 8, 8 }, // 0xCB 0x81
+	Opcode_Info{ "RES 0,D", 2, 8, 8 }, // 0xCB 0x82
+	Opcode_Info{ "RES 0,E", 2, 8, 8 }, // 0xCB 0x83
+	Opcode_Info{ "RES 0,H", 2, 8, 8 }, // 0xCB 0x84
+	Opcode_Info{ "RES 0,L", 2, 8, 8 }, // 0xCB 0x85
+	Opcode_Info{ "RES 0,(HL)", 2, 16, 16 }, // 0xCB 0x86
+	Opcode_Info{ "RES 0,A", 2, 8, 8 }, // 0xCB 0x87
+	Opcode_Info{ "RES 1,B", 2, 8, 8 }, // 0xCB 0x88
+	Opcode_Info{ "RES 1,C", 2, 8, 8 }, // 0xCB 0x89
+	Opcode_Info{ "RES 1,D", 2, 8, 8 }, // 0xCB 0x8A
+	Opcode_Info{ "RES 1,E", 2, 8, 8 }, // 0xCB 0x8B
+	Opcode_Info{ "RES 1,H", 2, 8, 8 }, // 0xCB 0x8C
+	Opcode_Info{ "RES 1,L", 2, 8, 8 }, // 0xCB 0x8D
+	Opcode_Info{ "RES 1,(HL)", 2, 16, 16 }, // 0xCB 0x8E
+	Opcode_Info{ "RES 1,A", 2, 8, 8 }, // 0xCB 0x8F
+	Opcode_Info{ "RES 2,B", 2, 8, 8 }, // 0xCB 0x90
+	Opcode_Info{ "RES 2,C", 2, 8, 8 }, // 0xCB 0x91
+	Opcode_Info{ "RES 2,D", 2, 8, 8 }, // 0xCB 0x92
+	Opcode_Info{ "RES 2,E", 2, 8, 8 }, // 0xCB 0x93
+	Opcode_Info{ "RES 2,H", 2, 8, 8 }, // 0xCB 0x94
+	Opcode_Info{ "RES 2,L", 2, 8, 8 }, // 0xCB 0x95
+	Opcode_Info{ "RES 2,(HL)", 2, 16, 16 }, // 0xCB 0x96
+	Opcode_Info{ "RES 2,A", 2, 8, 8 }, // 0xCB 0x97
+	Opcode_Info{ "RES 3,B", 2, 8, 8 }, // 0xCB 0x98
+	Opcode_Info{ "RES 3,C", 2, 8, 8 }, // 0xCB 0x99
+	Opcode_Info{ "RES 3,D", 2, 8, 8 }, // 0xCB 0x9A
+	Opcode_Info{ "RES 3,E", 2, 8, 8 }, // 0xCB 0x9B
+	Opcode_Info{ "RES 3,H", 2, 8, 8 }, // 0xCB 0x9C
+	Opcode_Info{ "RES 3,L", 2, 8, 8 }, // 0xCB 0x9D
+	Opcode_Info{ "RES 3,(HL)", 2, 16, 16 }, // 0xCB 0x9E
+	Opcode_Info{ "RES 3,A", 2, 8, 8 }, // 0xCB 0x9F
+	Opcode_Info{ "RES 4,B", 2, 8, 8 }, // 0xCB 0xA0
+	Opcode_Info{ "RES 4,C", 2, 8, 8 }, // 0xCB 0xA1
+	Opcode_Info{ "RES 4,D", 2, 8, 8 }, // 0xCB 0xA2
+	Opcode_Info{ "RES 4,E", 2, 8, 8 }, // 0xCB 0xA3
+	Opcode_Info{ "RES 4,H", 2, 8, 8 }, // 0xCB 0xA4
+	Opcode_Info{ "RES 4,L", 2, 8, 8 }, // 0xCB 0xA5
+	Opcode_Info{ "RES 4,(HL)", 2, 16, 16 }, // 0xCB 0xA6
+	Opcode_Info{ "RES 4,A", 2, 8, 8 }, // 0xCB 0xA7
+	Opcode_Info{ "RES 5,B", 2, 8, 8 }, // 0xCB 0xA8
+	Opcode_Info{ "RES 5,C", 2, 8, 8 }, // 0xCB 0xA9
+	Opcode_Info{ "RES 5,D", 2, 8, 8 }, // 0xCB 0xAA
+	Opcode_Info{ "RES 5,E", 2, 8, 8 }, // 0xCB 0xAB
+	Opcode_Info{ "RES 5,H", 2, 8, 8 }, // 0xCB 0xAC
+	Opcode_Info{ "RES 5,L", 2, 8, 8 }, // 0xCB 0xAD
+	Opcode_Info{ "RES 5,(HL)", 2, 16, 16 }, // 0xCB 0xAE
+	Opcode_Info{ "RES 5,A", 2, 8, 8 }, // 0xCB 0xAF
+	Opcode_Info{ "RES 6,B", 2, 8, 8 }, // 0xCB 0xB0
+	Opcode_Info{ "RES 6,C", 2, 8, 8 }, // 0xCB 0xB1
+	Opcode_Info{ "RES 6,D", 2, 8, 8 }, // 0xCB 0xB2
+	Opcode_Info{ "RES 6,E", 2, 8, 8 }, // 0xCB 0xB3
+	Opcode_Info{ "RES 6,H", 2, 8, 8 }, // 0xCB 0xB4
+	Opcode_Info{ "RES 6,L", 2, 8, 8 }, // 0xCB 0xB5
+	Opcode_Info{ "RES 6,(HL)", 2, 16, 16 }, // 0xCB 0xB6
+	Opcode_Info{ "RES 6,A", 2, 8, 8 }, // 0xCB 0xB7
+	Opcode_Info{ "RES 7,B", 2, 8, 8 }, // 0xCB 0xB8
+	Opcode_Info{ "RES 7,C", 2, 8, 8 }, // 0xCB 0xB9
+	Opcode_Info{ "RES 7,D", 2, 8, 8 }, // 0xCB 0xBA
+	Opcode_Info{ "RES 7,E", 2, 8, 8 }, // 0xCB 0xBB
+	Opcode_Info{ "RES 7,H", 2, 8, 8 }, // 0xCB 0xBC
+	Opcode_Info{ "RES 7,L", 2, 8, 8 }, // 0xCB 0xBD
+	Opcode_Info{ "RES 7,(HL)", 2, 16, 16 }, // 0xCB 0xBE
+	Opcode_Info{ "RES 7,A", 2, 8, 8 }, // 0xCB 0xBF
+	Opcode_Info{ "SET 0,B", 2, 8, 8 }, // 0xCB 0xC0
+	Opcode_Info{ "SET 0,C", 2, 8, 8 }, // 0xCB 0xC1
+	Opcode_Info{ "SET 0,D", 2, 8, 8 }, // 0xCB 0xC2
+	Opcode_Info{ "SET 0,E", 2, 8, 8 }, // 0xCB 0xC3
+	Opcode_Info{ "SET 0,H", 2, 8, 8 }, // 0xCB 0xC4
+	Opcode_Info{ "SET 0,L", 2, 8, 8 }, // 0xCB 0xC5
+	Opcode_Info{ "SET 0,(HL)", 2, 16, 16 }, // 0xCB 0xC6
+	Opcode_Info{ "SET 0,A", 2, 8, 8 }, // 0xCB 0xC7
+	Opcode_Info{ "SET 1,B", 2, 8, 8 }, // 0xCB 0xC8
+	Opcode_Info{ "SET 1,C", 2, 8, 8 }, // 0xCB 0xC9
+	Opcode_Info{ "SET 1,D", 2, 8, 8 }, // 0xCB 0xCA
+	Opcode_Info{ "SET 1,E", 2, 8, 8 }, // 0xCB 0xCB
+	Opcode_Info{ "SET 1,H", 2, 8, 8 }, // 0xCB 0xCC
+	Opcode_Info{ "SET 1,L", 2, 8, 8 }, // 0xCB 0xCD
+	Opcode_Info{ "SET 1,(HL)", 2, 16, 16 }, // 0xCB 0xCE
+	Opcode_Info{ "SET 1,A", 2, 8, 8 }, // 0xCB 0xCF
+	Opcode_Info{ "SET 2,B", 2, 8, 8 }, // 0xCB 0xD0
+	Opcode_Info{ "SET 2,C", 2, 8, 8 }, // 0xCB 0xD1
+	Opcode_Info{ "SET 2,D", 2, 8, 8 }, // 0xCB 0xD2
+	Opcode_Info{ "SET 2,E", 2, 8, 8 }, // 0xCB 0xD3
+	Opcode_Info{ "SET 2,H", 2, 8, 8 }, // 0xCB 0xD4
+	Opcode_Info{ "SET 2,L", 2, 8, 8 }, // 0xCB 0xD5
+	Opcode_Info{ "SET 2,(HL)", 2, 16, 16 }, // 0xCB 0xD6
+	Opcode_Info{ "SET 2,A", 2, 8, 8 }, // 0xCB 0xD7
+	Opcode_Info{ "SET 3,B", 2, 8, 8 }, // 0xCB 0xD8
+	Opcode_Info{ "SET 3,C", 2, 8, 8 }, // 0xCB 0xD9
+	Opcode_Info{ "SET 3,D", 2, 8, 8 }, // 0xCB 0xDA
+	Opcode_Info{ "SET 3,E", 2, 8, 8 }, // 0xCB 0xDB
+	Opcode_Info{ "SET 3,H", 2, 8, 8 }, // 0xCB 0xDC
+	Opcode_Info{ "SET 3,L", 2, 8, 8 }, // 0xCB 0xDD
+	Opcode_Info{ "SET 3,(HL)", 2, 16, 16 }, // 0xCB 0xDE
+	Opcode_Info{ "SET 3,A", 2, 8, 8 }, // 0xCB 0xDF
+	Opcode_Info{ "SET 4,B", 2, 8, 8 }, // 0xCB 0xE0
+	Opcode_Info{ "SET 4,C", 2, 8, 8 }, // 0xCB 0xE1
+	Opcode_Info{ "SET 4,D", 2, 8, 8 }, // 0xCB 0xE2
+	Opcode_Info{ "SET 4,E", 2, 8, 8 }, // 0xCB 0xE3
+	Opcode_Info{ "SET 4,H", 2, 8, 8 }, // 0xCB 0xE4
+	Opcode_Info{ "SET 4,L", 2, 8, 8 }, // 0xCB 0xE5
+	Opcode_Info{ "SET 4,(HL)", 2, 16, 16 }, // 0xCB 0xE6
+	Opcode_Info{ "SET 4,A", 2, 8, 8 }, // 0xCB 0xE7
+	Opcode_Info{ "SET 5,B", 2, 8, 8 }, // 0xCB 0xE8
+	Opcode_Info{ "SET 5,C", 2, 8, 8 }, // 0xCB 0xE9
+	Opcode_Info{ "SET 5,D", 2, 8, 8 }, // 0xCB 0xEA
+	Opcode_Info{ "SET 5,E", 2, 8, 8 }, // 0xCB 0xEB
+	Opcode_Info{ "SET 5,H", 2, 8, 8 }, // 0xCB 0xEC
+	Opcode_Info{ "SET 5,L", 2, 8, 8 }, // 0xCB 0xED
+	Opcode_Info{ "SET 5,(HL)", 2, 16, 16 }, // 0xCB 0xEE
+	Opcode_Info{ "SET 5,A", 2, 8, 8 }, // 0xCB 0xEF
+	Opcode_Info{ "SET 6,B", 2, 8, 8 }, // 0xCB 0xF0
+	Opcode_Info{ "SET 6,C", 2, 8, 8 }, // 0xCB 0xF1
+	Opcode_Info{ "SET 6,D", 2, 8, 8 }, // 0xCB 0xF2
+	Opcode_Info{ "SET 6,E", 2, 8, 8 }, // 0xCB 0xF3
+	Opcode_Info{ "SET 6,H", 2, 8, 8 }, // 0xCB 0xF4
+	Opcode_Info{ "SET 6,L", 2, 8, 8 }, // 0xCB 0xF5
+	Opcode_Info{ "SET 6,(HL)", 2, 16, 16 }, // 0xCB 0xF6
+	Opcode_Info{ "SET 6,A", 2, 8, 8 }, // 0xCB 0xF7
+	Opcode_Info{ "SET 7,B", 2, 8, 8 }, // 0xCB 0xF8
+	Opcode_Info{ "SET 7,C", 2, 8, 8 }, // 0xCB 0xF9
+	Opcode_Info{ "SET 7,D", 2, 8, 8 }, // 0xCB 0xFA
+	Opcode_Info{ "SET 7,E", 2, 8, 8 }, // 0xCB 0xFB
+	Opcode_Info{ "SET 7,H", 2, 8, 8 }, // 0xCB 0xFC
+	Opcode_Info{ "SET 7,L", 2, 8, 8 }, // 0xCB 0xFD
+	Opcode_Info{ "SET 7,(HL)", 2, 16, 16 }, // 0xCB 0xFE
+	Opcode_Info{ "SET 7,A", 2, 8, 8 } // 0xCB 0xFF
+};
+
+// Instructions after which the next PC or interrupt state can't be known when decoding ahead.
+constexpr bool Ends_Block(uint8_t opcode)
+{
+	switch (opcode)
+	{
+	case 0x10: // STOP
+	case 0x18: case 0x20: case 0x28: case 0x30: case 0x38: // JR
+	case 0x76: // HALT
+	case 0xC0: case 0xC8: case 0xC9: case 0xD0: case 0xD8: case 0xD9: // RET, RETI
+	case 0xC2: case 0xC3: case 0xCA: case 0xD2: case 0xDA: case 0xE9: // JP
+	case 0xC4: case 0xCC: case 0xCD: case 0xD4: case 0xDC: // CALL
+	case 0xC7: case 0xCF: case 0xD7: case 0xDF: case 0xE7: case 0xEF: case 0xF7: case 0xFF: // RST
+	case 0xF3: case 0xFB: // DI, EI
+	case 0xD3: case 0xDB: case 0xDD: case 0xE3: case 0xE4: case 0xEB: case 0xEC: case 0xED: case 0xF4: case 0xFC: case 0xFD: // ILLEGAL
+		return true;
+	default:
+		return false;
+	}
+}
+
+// Instructions that change nothing but registers and flags, though they may read memory.
+constexpr bool Changes_Only_Registers(uint8_t opcode, uint8_t cb_opcode)
+{
+	if (opcode == 0xCB)
+	{
+		// Only BIT leaves (HL) alone when that is the operand.
+		return (cb_opcode & 0xC0) == 0x40 || (cb_opcode & 0x07) != 6;
+	}
+
+	if (opcode >= 0x40 && opcode < 0xC0)
+	{
+		// Every LD and ALU op, apart from LD (HL),r and HALT.
+		return (opcode & 0xF8) != 0x70;
+	}
+
+	switch (opcode)
+	{
+	case 0x00: // NOP
+	case 0x01: case 0x11: case 0x21: case 0x31: // LD rr,nn
+	case 0x03: case 0x13: case 0x23: case 0x33: case 0x0B: case 0x1B: case 0x2B: case 0x3B: // INC rr, DEC rr
+	case 0x04: case 0x0C: case 0x14: case 0x1C: case 0x24: case 0x2C: case 0x3C: // INC r
+	case 0x05: case 0x0D: case 0x15: case 0x1D: case 0x25: case 0x2D: case 0x3D: // DEC r
+	case 0x06: case 0x0E: case 0x16: case 0x1E: case 0x26: case 0x2E: case 0x3E: // LD r,n
+	case 0x07: case 0x0F: case 0x17: case 0x1F: case 0x27: case 0x2F: case 0x37: case 0x3F: // RLCA..CCF
+	case 0x09: case 0x19: case 0x29: case 0x39: // ADD HL,rr
+	case 0x0A: case 0x1A: case 0x2A: case 0x3A: // LD A,(rr)
+	case 0xC6: case 0xCE: case 0xD6: case 0xDE: case 0xE6: case 0xEE: case 0xF6: case 0xFE: // ALU A,n
+	case 0xE8: case 0xF8: case 0xF9: // ADD SP,e, LD HL,SP+e, LD SP,HL
+	case 0xF0: case 0xF2: case 0xFA: // LDH A,(n), LDH A,(C), LD A,(nn)
+		return true;
+	default:
+		return false;
+	}
+}
@@ -0,0 +1,460 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+
+#include "Memory.h"
+#include "Scheduler.h"
+#include "Tile_Cache.h"
+#include "Triple_Buffer.h"
+
+// Scanline renderer: each LCD mode change is a scheduled event that drives LY and STAT, and a line is drawn when it enters pixel transfer.
+class PPU
+{
+public:
+	const static uint32_t WIDTH = 160;
+	const static uint32_t HEIGHT = 144;
+
+	const static uint32_t OAM_SEARCH_CYCLES = 80;
+	const static uint32_t TRANSFER_CYCLES = 172;
+	const static uint32_t HBLANK_CYCLES = 204;
+	const static uint32_t LINE_CYCLES = OAM_SEARCH_CYCLES + TRANSFER_CYCLES + HBLANK_CYCLES;
+	const static uint32_t LINE_COUNT = 154;
+
+	using Frame = std::array<uint8_t, WIDTH * HEIGHT>;
+
+	enum class Mode : uint8_t { HBlank = 0, VBlank = 1, OAM_Search = 2, Transfer = 3 };
+
+	PPU(Memory& memory, Scheduler& scheduler) : _memory(memory), _scheduler(scheduler), _tiles(memory)
+	{
+		_memory.Set_IO_Handler(static_cast<uint16_t>(Memory::IO_Type::LCDC), this, nullptr, &PPU::Write_LCDC);
+		_memory.Set_IO_Handler(static_cast<uint16_t>(Memory::IO_Type::STAT), this, &PPU::Read_STAT, &PPU::Write_STAT, true);
+		_memory.Set_IO_Handler(static_cast<uint16_t>(Memory::IO_Type::LY), this, nullptr, &PPU::Write_LY);
+		_memory.Set_IO_Handler(static_cast<uint16_t>(Memory::IO_Type::LYC), this, nullptr, &PPU::Write_LYC);
+		_memory.Set_IO_Handler(static_cast<uint16_t>(Memory::IO_Type::DMA), this, nullptr, &PPU::Write_DMA);
+		_scheduler.Set_Handler(Event_Type::PPU, this, &PPU::Mode_Event);
+
+		_framebuffer.fill(0);
+
+		if (IO(Memory::IO_Type::LCDC) & LCDC_ENABLE)
+		{
+			Enable(_scheduler.Now());
+		}
+	}
+
+	PPU(const PPU&) = delete;
+	PPU& operator=(const PPU&) = delete;
+
+	// One shade (0 lightest to 3 darkest) per pixel, row major.
+	const Frame& Framebuffer() const
+	{
+		return _framebuffer;
+	}
+
+	// Every completed frame is copied into frames at vertical blank, pass null to stop.
+	void Publish_Frames(Triple_Buffer<Frame>* frames)
+	{
+		_frames = frames;
+	}
+
+	// While off, lines are not drawn and frames are not published, only the state the game can see is kept. For
+	// frames that will be thrown away, like run-ahead's hidden ones.
+	void Set_Rendering(bool rendering)
+	{
+		_rendering = rendering;
+	}
+
+	// Counts completed frames, bumped on entering vertical blank.
+	uint64_t Frame_Count() const
+	{
+		return _frame_count;
+	}
+
+	Mode Current_Mode() const
+	{
+		return _mode;
+	}
+
+	// The framebuffer is left out, it is rebuilt within a frame and would dominate the size of rewind deltas.
+	void Save_State(State_Writer& writer)
+	{
+		writer.Write(_mode);
+		writer.Write(_window_line);
+		writer.Write(_enabled);
+		writer.Write(_frame_count);
+	}
+
+	void Load_State(State_Reader& reader)
+	{
+		reader.Read(_mode);
+		reader.Read(_window_line);
+		reader.Read(_enabled);
+		reader.Read(_frame_count);
+	}
+
+	// What Save_State keeps, straight from another instance.
+	void Copy_State(const PPU& other)
+	{
+		_mode = other._mode;
+		_window_line = other._window_line;
+		_enabled = other._enabled;
+		_frame_count = other._frame_count;
+	}
+
+	// FNV-1a over the framebuffer, used to compare headless runs.
+	uint32_t Checksum() const
+	{
+		uint32_t hash = 2166136261u;
+		for (auto shade : _framebuffer)
+		{
+			hash = (hash ^ shade) * 16777619u;
+		}
+
+		return hash;
+	}
+
+private:
+	const static uint8_t LCDC_BACKGROUND = 0x01;
+	const static uint8_t LCDC_SPRITES = 0x02;
+	const static uint8_t LCDC_TALL_SPRITES = 0x04;
+	const static uint8_t LCDC_BACKGROUND_MAP = 0x08;
+	const static uint8_t LCDC_UNSIGNED_TILES = 0x10;
+	const static uint8_t LCDC_WINDOW = 0x20;
+	const static uint8_t LCDC_WINDOW_MAP = 0x40;
+	const static uint8_t LCDC_ENABLE = 0x80;
+
+	const static uint8_t STAT_COINCIDENCE = 0x04;
+	const static uint8_t STAT_HBLANK_INTERRUPT = 0x08;
+	const static uint8_t STAT_VBLANK_INTERRUPT = 0x10;
+	const static uint8_t STAT_OAM_INTERRUPT = 0x20;
+	const static uint8_t STAT_COINCIDENCE_INTERRUPT = 0x40;
+
+	const static uint8_t VBLANK_INTERRUPT = 0x01;
+	const static uint8_t STAT_INTERRUPT = 0x02;
+
+	const static uint32_t MAX_SPRITES_PER_LINE = 10;
+
+	// One tile more than the screen is wide so a fine scroll still covers every pixel.
+	const static uint32_t LINE_TILES = WIDTH / 8 + 1;
+
+	uint8_t& IO(Memory::IO_Type type)
+	{
+		return _memory.IO(type);
+	}
+
+	// Moves on to the next mode and returns how long it lasts.
+	uint32_t Next_Mode()
+	{
+		switch (_mode)
+		{
+		case Mode::OAM_Search:
+			if (_rendering)
+			{
+				Render_Line(IO(Memory::IO_Type::LY));
+			}
+			else if (Window_Visible(IO(Memory::IO_Type::LCDC), IO(Memory::IO_Type::LY)))
+			{
+				_window_line++;
+			}
+			Set_Mode(Mode::Transfer);
+			return TRANSFER_CYCLES;
+		case Mode::Transfer:
+			Set_Mode(Mode::HBlank);
+			return HBLANK_CYCLES;
+		case Mode::HBlank:
+			Set_LY(IO(Memory::IO_Type::LY) + 1);
+			if (IO(Memory::IO_Type::LY) == HEIGHT)
+			{
+				_frame_count++;
+				IO(Memory::IO_Type::IF) |= VBLANK_INTERRUPT;
+				if (_frames && _rendering)
+				{
+					_frames->Write_Buffer() = _framebuffer;
+					_frames->Publish();
+				}
+				Set_Mode(Mode::VBlank);
+				return LINE_CYCLES;
+			}
+
+			Set_Mode(Mode::OAM_Search);
+			return OAM_SEARCH_CYCLES;
+		case Mode::VBlank:
+			if (IO(Memory::IO_Type::LY) + 1u == LINE_COUNT)
+			{
+				_window_line = 0;
+				Set_LY(0);
+				Set_Mode(Mode::OAM_Search);
+				return OAM_SEARCH_CYCLES;
+			}
+
+			Set_LY(IO(Memory::IO_Type::LY) + 1);
+			return LINE_CYCLES;
+		}
+
+		return LINE_CYCLES;
+	}
+
+	static void Mode_Event(void* context, uint64_t cycle)
+	{
+		auto* ppu = static_cast<PPU*>(context);
+		ppu->_scheduler.Schedule(Event_Type::PPU, cycle + ppu->Next_Mode());
+	}
+
+	// A disabled LCD sits at the start of line 0 until it is switched back on.
+	void Enable(uint64_t cycle)
+	{
+		_enabled = true;
+		_window_line = 0;
+		Set_LY(0);
+		Set_Mode(Mode::OAM_Search);
+		_scheduler.Schedule(Event_Type::PPU, cycle + OAM_SEARCH_CYCLES);
+	}
+
+	void Disable()
+	{
+		_enabled = false;
+		_scheduler.Cancel(Event_Type::PPU);
+		IO(Memory::IO_Type::LY) = 0;
+		_mode = Mode::HBlank;
+		IO(Memory::IO_Type::STAT) &= ~0x03;
+	}
+
+	void Set_Mode(Mode mode)
+	{
+		_mode = mode;
+		uint8_t& stat = IO(Memory::IO_Type::STAT);
+		stat = (stat & ~0x03) | static_cast<uint8_t>(mode);
+
+		uint8_t source = 0;
+		switch (mode)
+		{
+		case Mode::HBlank: source = STAT_HBLANK_INTERRUPT; break;
+		case Mode::VBlank: source = STAT_VBLANK_INTERRUPT; break;
+		case Mode::OAM_Search: source = STAT_OAM_INTERRUPT; break;
+		default: break;
+		}
+
+		if (stat & source)
+		{
+			IO(Memory::IO_Type::IF) |= STAT_INTERRUPT;
+		}
+	}
+
+	void Set_LY(uint8_t ly)
+	{
+		IO(Memory::IO_Type::LY) = ly;
+		Compare_LYC();
+	}
+
+	void Compare_LYC()
+	{
+		uint8_t& stat = IO(Memory::IO_Type::STAT);
+		if (IO(Memory::IO_Type::LY) == IO(Memory::IO_Type::LYC))
+		{
+			stat |= STAT_COINCIDENCE;
+			if (stat & STAT_COINCIDENCE_INTERRUPT)
+			{
+				IO(Memory::IO_Type::IF) |= STAT_INTERRUPT;
+			}
+		}
+		else
+		{
+			stat &= ~STAT_COINCIDENCE;
+		}
+	}
+
+	void Render_Line(uint8_t ly)
+	{
+		uint8_t lcdc = IO(Memory::IO_Type::LCDC);
+		_tiles.Update();
+
+		// Colour indices before the palette, sprites need them to honour background priority.
+		std::array<uint8_t, WIDTH> colors = {};
+
+		if (lcdc & LCDC_BACKGROUND)
+		{
+			uint8_t scx = IO(Memory::IO_Type::SCX);
+			uint8_t y = ly + IO(Memory::IO_Type::SCY);
+			uint16_t map = lcdc & LCDC_BACKGROUND_MAP ? 0x9C00 : 0x9800;
+			Render_Tiles(lcdc, map, y, scx >> 3, scx & 7, 0, colors);
+
+			if (Window_Visible(lcdc, ly))
+			{
+				uint8_t wx = IO(Memory::IO_Type::WX);
+				uint16_t window_map = lcdc & LCDC_WINDOW_MAP ? 0x9C00 : 0x9800;
+				uint32_t start = wx < 7 ? 0 : wx - 7;
+				Render_Tiles(lcdc, window_map, _window_line, 0, wx < 7 ? 7 - wx : 0, start, colors);
+				_window_line++;
+			}
+		}
+
+		uint8_t* line = &_framebuffer[ly * WIDTH];
+		Apply_Palette(IO(Memory::IO_Type::BGP), colors.data(), line, WIDTH);
+
+		if (lcdc & LCDC_SPRITES)
+		{
+			Render_Sprites(lcdc, ly, colors, line);
+		}
+	}
+
+	// The window's own line counter only advances on lines where it is drawn.
+	bool Window_Visible(uint8_t lcdc, uint8_t ly)
+	{
+		return (lcdc & LCDC_BACKGROUND) && (lcdc & LCDC_WINDOW) && ly >= IO(Memory::IO_Type::WY) && IO(Memory::IO_Type::WX) < WIDTH + 7;
+	}
+
+	// Copies a row of decoded map tiles and then the visible part into colors from start onwards.
+	void Render_Tiles(uint8_t lcdc, uint16_t map, uint8_t y, uint32_t first_tile, uint32_t fine_x, uint32_t start, std::array<uint8_t, WIDTH>& colors)
+	{
+		const uint8_t* map_row = _memory.VRAM() + (map - 0x8000) + (y >> 3) * 32;
+		uint32_t fine_y = y & 7;
+
+		std::array<uint8_t, LINE_TILES * 8> pixels;
+		for (uint32_t i = 0; i < LINE_TILES; i++)
+		{
+			std::copy_n(_tiles.Row(Tile_Index(lcdc, map_row[(first_tile + i) & 31]), fine_y), 8, pixels.begin() + i * 8);
+		}
+
+		std::copy_n(pixels.begin() + fine_x, WIDTH - start, colors.begin() + start);
+	}
+
+	static uint32_t Tile_Index(uint8_t lcdc, uint8_t index)
+	{
+		if (lcdc & LCDC_UNSIGNED_TILES)
+		{
+			return index;
+		}
+
+		return 256 + static_cast<int8_t>(index);
+	}
+
+	static void Apply_Palette(uint8_t palette, const uint8_t* colors, uint8_t* shades, uint32_t count)
+	{
+		const uint8_t lookup[4] = { static_cast<uint8_t>(palette & 3), static_cast<uint8_t>((palette >> 2) & 3), static_cast<uint8_t>((palette >> 4) & 3), static_cast<uint8_t>(palette >> 6) };
+		for (uint32_t i = 0; i < count; i++)
+		{
+			shades[i] = lookup[colors[i]];
+		}
+	}
+
+	void Render_Sprites(uint8_t lcdc, uint8_t ly, const std::array<uint8_t, WIDTH>& colors, uint8_t* line)
+	{
+		const uint8_t* oam = _memory.OAM();
+		uint32_t height = lcdc & LCDC_TALL_SPRITES ? 16 : 8;
+
+		// The first ten sprites in OAM order that overlap the line are the only ones drawn.
+		std::array<uint8_t, MAX_SPRITES_PER_LINE> visible;
+		uint32_t count = 0;
+		for (uint32_t i = 0; i < 40 && count < MAX_SPRITES_PER_LINE; i++)
+		{
+			int32_t top = oam[i * 4] - 16;
+			if (ly >= top && ly < top + static_cast<int32_t>(height))
+			{
+				visible[count++] = static_cast<uint8_t>(i);
+			}
+		}
+
+		// Lower X wins, then lower OAM index, so draw from lowest priority up.
+		std::stable_sort(visible.begin(), visible.begin() + count, [oam](uint8_t a, uint8_t b) { return oam[a * 4 + 1] < oam[b * 4 + 1]; });
+
+		for (uint32_t i = count; i-- > 0;)
+		{
+			const uint8_t* sprite = oam + visible[i] * 4;
+			int32_t x = sprite[1] - 8;
+			uint8_t flags = sprite[3];
+			uint32_t row = ly - (sprite[0] - 16);
+			if (flags & 0x40)
+			{
+				row = height - 1 - row;
+			}
+
+			// Tall sprites continue into the next tile.
+			uint32_t tile = (height == 16 ? sprite[2] & 0xFE : sprite[2]) + (row >> 3);
+			const uint8_t* pixels = _tiles.Row(tile, row & 7, flags & 0x20);
+
+			uint8_t palette = IO(flags & 0x10 ? Memory::IO_Type::OBP1 : Memory::IO_Type::OBP0);
+			for (int32_t p = 0; p < 8; p++)
+			{
+				int32_t screen_x = x + p;
+				uint8_t color = pixels[p];
+				if (screen_x < 0 || screen_x >= static_cast<int32_t>(WIDTH) || color == 0)
+				{
+					continue;
+				}
+
+				// Behind-background sprites only show through background colour 0.
+				if ((flags & 0x80) && colors[screen_x] != 0)
+				{
+					continue;
+				}
+
+				line[screen_x] = (palette >> (color * 2)) & 3;
+			}
+		}
+	}
+
+	static void Write_LCDC(void* context, uint16_t /*address*/, uint8_t value)
+	{
+		auto* ppu = static_cast<PPU*>(context);
+		ppu->IO(Memory::IO_Type::LCDC) = value;
+		if ((value & LCDC_ENABLE) && !ppu->_enabled)
+		{
+			ppu->Enable(ppu->_scheduler.Now());
+		}
+		else if (!(value & LCDC_ENABLE) && ppu->_enabled)
+		{
+			ppu->Disable();
+		}
+	}
+
+	static uint8_t Read_STAT(void* context, uint16_t /*address*/)
+	{
+		return static_cast<PPU*>(context)->IO(Memory::IO_Type::STAT) | 0x80;
+	}
+
+	// The mode and coincidence bits are read only.
+	static void Write_STAT(void* context, uint16_t /*address*/, uint8_t value)
+	{
+		uint8_t& stat = static_cast<PPU*>(context)->IO(Memory::IO_Type::STAT);
+		stat = (stat & 0x07) | (value & 0x78);
+	}
+
+	static void Write_LY(void* /*context*/, uint16_t /*address*/, uint8_t /*value*/)
+	{
+	}
+
+	static void Write_LYC(void* context, uint16_t /*address*/, uint8_t value)
+	{
+		auto* ppu = static_cast<PPU*>(context);
+		ppu->IO(Memory::IO_Type::LYC) = value;
+		if (ppu->_enabled)
+		{
+			ppu->Compare_LYC();
+		}
+	}
+
+	// OAM DMA copies all 160 bytes at once rather than over 160 microseconds.
+	static void Write_DMA(void* context, uint16_t /*address*/, uint8_t value)
+	{
+		auto* ppu = static_cast<PPU*>(context);
+		ppu->IO(Memory::IO_Type::DMA) = value;
+
+		uint8_t* oam = ppu->_memory.OAM();
+		for (uint16_t i = 0; i < 0xA0; i++)
+		{
+			oam[i] = ppu->_memory.Read8(static_cast<uint16_t>((value << 8) | i));
+		}
+	}
+
+	Memory& _memory;
+	Scheduler& _scheduler;
+	Tile_Cache _tiles;
+	Frame _framebuffer;
+	Triple_Buffer<Frame>* _frames = nullptr;
+	Mode _mode = Mode::HBlank;
+	uint8_t _window_line = 0;
+	bool _enabled = false;
+	uint64_t _frame_count = 0;
+	bool _rendering = true;
+};
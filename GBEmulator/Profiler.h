@@ -0,0 +1,211 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <iomanip>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "Opcodes.h"
+
+// Counts what the emulated program executes: per opcode, and per (ROM bank, PC) site. Host time is sampled once
+// every HOST_SAMPLE_PERIOD blocks and scaled up, so enabling the profiler costs a few increments per instruction.
+// Only compiled into the CPU when GB_PROFILER is defined.
+class Profiler
+{
+public:
+	const static uint32_t HOST_SAMPLE_PERIOD = 64;
+
+	// CB opcodes follow the 256 plain ones.
+	static uint16_t Opcode_Index(uint8_t opcode, uint16_t operand)
+	{
+		return opcode == 0xCB ? 0x100 | (operand & 0xFF) : opcode;
+	}
+
+	static const char* Mnemonic(uint16_t index)
+	{
+		return index < 0x100 ? OPCODES[index].mnemonic : CB_OPCODES[index & 0xFF].mnemonic;
+	}
+
+	// site is the block cache key, the bank in the high half and the PC in the low half.
+	void Record(uint32_t site, uint16_t opcode_index, uint32_t cycles)
+	{
+		auto& opcode = _opcodes[opcode_index];
+		opcode.count++;
+		opcode.cycles += cycles;
+
+		auto& counter = Site(site);
+		counter.count++;
+		counter.cycles += cycles;
+		counter.opcode = opcode_index;
+	}
+
+	// Cycles spent halted or entering interrupts, which belong to no instruction.
+	void Record_Idle(uint32_t cycles) { _idle_cycles += cycles; }
+	void Record_Interrupt(uint32_t cycles) { _interrupt_cycles += cycles; }
+
+	// True for the blocks whose host time should be measured.
+	bool Sample_Host()
+	{
+		return ++_blocks % HOST_SAMPLE_PERIOD == 0;
+	}
+
+	void Record_Host(uint32_t site, uint64_t nanoseconds)
+	{
+		Site(site).host_nanoseconds += nanoseconds * HOST_SAMPLE_PERIOD;
+	}
+
+	void Clear()
+	{
+		_opcodes = {};
+		_pages.clear();
+		_last_page = nullptr;
+		_idle_cycles = 0;
+		_interrupt_cycles = 0;
+		_blocks = 0;
+	}
+
+	// The most expensive opcodes by emulated cycles.
+	void Write_Opcode_Report(std::ostream& out, std::size_t limit = 32) const
+	{
+		std::vector<uint16_t> indices;
+		uint64_t total = _idle_cycles + _interrupt_cycles;
+		for (uint16_t index = 0; index < _opcodes.size(); index++)
+		{
+			if (_opcodes[index].count)
+			{
+				indices.push_back(index);
+				total += _opcodes[index].cycles;
+			}
+		}
+		std::sort(indices.begin(), indices.end(), [this](uint16_t a, uint16_t b) { return _opcodes[a].cycles > _opcodes[b].cycles; });
+
+		out << std::left << std::setw(16) << "opcode" << std::right << std::setw(14) << "count" << std::setw(14) << "cycles" << std::setw(8) << "%" << "\n";
+		for (std::size_t i = 0; i < std::min(limit, indices.size()); i++)
+		{
+			const auto& counter = _opcodes[indices[i]];
+			out << std::left << std::setw(16) << Mnemonic(indices[i]) << std::right << std::setw(14) << counter.count << std::setw(14) << counter.cycles
+				<< std::setw(8) << std::fixed << std::setprecision(2) << Percent(counter.cycles, total) << "\n";
+		}
+		out << "idle " << _idle_cycles << " cycles, interrupts " << _interrupt_cycles << " cycles\n";
+	}
+
+	// The hottest sites by emulated cycles, with their sampled host time.
+	void Write_Site_Report(std::ostream& out, std::size_t limit = 32) const
+	{
+		auto sites = Sorted_Sites();
+		out << std::left << std::setw(12) << "bank:pc" << std::setw(16) << "opcode" << std::right << std::setw(14) << "count" << std::setw(14) << "cycles" << std::setw(14) << "host ns" << "\n";
+		for (std::size_t i = 0; i < std::min(limit, sites.size()); i++)
+		{
+			const auto& [site, counter] = sites[i];
+			out << std::left << std::setw(12) << Site_Name(site) << std::setw(16) << Mnemonic(counter->opcode) << std::right << std::setw(14) << counter->count
+				<< std::setw(14) << counter->cycles << std::setw(14) << counter->host_nanoseconds << "\n";
+		}
+	}
+
+	// Collapsed stacks for flamegraph.pl and compatible tools. Emulated cycles go under "emulated", grouped by bank
+	// and 256-byte page, with the instruction as the leaf. Sampled host nanoseconds go under "host" the same way.
+	void Write_Collapsed(std::ostream& out, const std::string& root) const
+	{
+		for (const auto& [site, counter] : Sorted_Sites())
+		{
+			std::string stack = Bank_Name(site) + ";" + Page_Name(site) + ";" + Site_Name(site);
+			out << root << ";emulated;" << stack << " " << Mnemonic(counter->opcode) << " " << counter->cycles << "\n";
+
+			// Host time is measured per block, so it lands on the block's first instruction.
+			if (counter->host_nanoseconds)
+			{
+				out << root << ";host;" << stack << " " << counter->host_nanoseconds << "\n";
+			}
+		}
+
+		if (_idle_cycles)
+		{
+			out << root << ";emulated;(halted) " << _idle_cycles << "\n";
+		}
+		if (_interrupt_cycles)
+		{
+			out << root << ";emulated;(interrupt dispatch) " << _interrupt_cycles << "\n";
+		}
+	}
+
+private:
+	struct Counter
+	{
+		uint64_t count = 0;
+		uint64_t cycles = 0;
+		uint64_t host_nanoseconds = 0;
+		uint16_t opcode = 0;
+	};
+
+	using Page = std::array<Counter, 256>;
+
+	// Consecutive instructions nearly always share a page, so the map is only consulted on page changes.
+	Counter& Site(uint32_t site)
+	{
+		uint32_t page = site >> 8;
+		if (!_last_page || page != _last_page_key)
+		{
+			auto& slot = _pages[page];
+			if (!slot)
+			{
+				slot = std::make_unique<Page>();
+			}
+			_last_page = slot.get();
+			_last_page_key = page;
+		}
+
+		return (*_last_page)[site & 0xFF];
+	}
+
+	std::vector<std::pair<uint32_t, const Counter*>> Sorted_Sites() const
+	{
+		std::vector<std::pair<uint32_t, const Counter*>> sites;
+		for (const auto& [page, counters] : _pages)
+		{
+			for (uint32_t offset = 0; offset < counters->size(); offset++)
+			{
+				if ((*counters)[offset].count)
+				{
+					sites.push_back({ (page << 8) | offset, &(*counters)[offset] });
+				}
+			}
+		}
+		std::sort(sites.begin(), sites.end(), [](const auto& a, const auto& b) { return a.second->cycles != b.second->cycles ? a.second->cycles > b.second->cycles : a.first < b.first; });
+
+		return sites;
+	}
+
+	static std::string Hex(uint32_t value, int digits)
+	{
+		const char* hex = "0123456789abcdef";
+		std::string text(digits, '0');
+		for (int i = digits - 1; i >= 0; i--, value >>= 4)
+		{
+			text[i] = hex[value & 0xF];
+		}
+
+		return text;
+	}
+
+	static std::string Bank_Name(uint32_t site) { return "bank_" + Hex(site >> 16, 2); }
+	static std::string Page_Name(uint32_t site) { return "0x" + Hex((site >> 8) & 0xFF, 2) + "xx"; }
+	static std::string Site_Name(uint32_t site) { return Hex(site >> 16, 2) + ":" + Hex(site & 0xFFFF, 4); }
+
+	static double Percent(uint64_t part, uint64_t total)
+	{
+		return total ? 100.0 * part / total : 0.0;
+	}
+
+	std::array<Counter, 0x200> _opcodes = {};
+	std::unordered_map<uint32_t, std::unique_ptr<Page>> _pages;
+	Page* _last_page = nullptr;
+	uint32_t _last_page_key = 0;
+	uint64_t _idle_cycles = 0;
+	uint64_t _interrupt_cycles = 0;
+	uint64_t _blocks = 0;
+};
@@ -0,0 +1,335 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include "Opcodes.h"
+#include "ROM_Image.h"
+#include "Save_State.h"
+
+// A static walk of a cartridge: which bytes start instructions, where straight line runs begin (the leaders), and the
+// jumps, calls and restarts between them. The walk follows every path from the entry point and the interrupt vectors,
+// and from seeds, which are blocks the CPU has been seen to reach. A jump into the switched bank from bank 0 can't say
+// which bank it lands in, so that code is only found from the same bank or from a seed.
+// Analyses are cached on disk under the ROM's hash, and each batch adds the blocks it reached as new seeds.
+class ROM_Analysis
+{
+public:
+	// Locations are block cache keys, the ROM bank in the high half and the address in the low half.
+	struct Edge
+	{
+		uint32_t from; // The jump, call or restart.
+		uint32_t to; // Its target, in NO_BANK when it is in the switched bank and that can't be known.
+	};
+
+	static constexpr uint16_t NO_BANK = 0xFFFF;
+
+	static std::unique_ptr<ROM_Analysis> Analyze(const ROM_Image& rom, std::vector<uint32_t> seeds = {})
+	{
+		std::unique_ptr<ROM_Analysis> analysis(new ROM_Analysis(rom));
+		std::sort(seeds.begin(), seeds.end());
+		seeds.erase(std::unique(seeds.begin(), seeds.end()), seeds.end());
+		analysis->_seeds = std::move(seeds);
+		analysis->Walk(rom.Data());
+		return analysis;
+	}
+
+	// The same walk with more seeds, or null when they hold nothing new.
+	std::unique_ptr<ROM_Analysis> With_Seeds(const ROM_Image& rom, const std::vector<uint32_t>& seeds) const
+	{
+		std::vector<uint32_t> merged = _seeds;
+		for (uint32_t seed : seeds)
+		{
+			if (!std::binary_search(_seeds.begin(), _seeds.end(), seed))
+			{
+				merged.push_back(seed);
+			}
+		}
+
+		return merged.size() == _seeds.size() ? nullptr : Analyze(rom, std::move(merged));
+	}
+
+	uint64_t ROM_Hash() const { return _rom_hash; }
+
+	bool Is_Instruction(uint32_t location) const { return Test(_instructions, location); }
+	bool Is_Leader(uint32_t location) const { return Test(_leaders, location); }
+
+	// In address order within each bank.
+	std::vector<uint32_t> Leaders() const
+	{
+		std::vector<uint32_t> leaders;
+		for (uint32_t offset = 0; offset < _size; offset++)
+		{
+			if (Test_Offset(_leaders, offset))
+			{
+				leaders.push_back(Location(offset));
+			}
+		}
+
+		return leaders;
+	}
+
+	const std::vector<Edge>& Edges() const { return _edges; }
+	const std::vector<uint32_t>& Seeds() const { return _seeds; }
+
+	// The blocks worth decoding before the first frame: the ones seen running, or every leader before any have been.
+	std::vector<uint32_t> Block_Starts() const
+	{
+		return _seeds.empty() ? Leaders() : _seeds;
+	}
+
+	bool Save(const std::string& path) const
+	{
+		std::vector<uint8_t> data;
+		State_Writer writer(data);
+		writer.Write(MAGIC);
+		writer.Write(VERSION);
+		writer.Write(_rom_hash);
+		writer.Write(static_cast<uint32_t>(_size));
+		writer.Write_Block(_instructions);
+		writer.Write_Block(_leaders);
+		writer.Write(static_cast<uint32_t>(_edges.size()));
+		writer.Write_Block(_edges);
+		writer.Write(static_cast<uint32_t>(_seeds.size()));
+		writer.Write_Block(_seeds);
+
+		// Written aside and renamed over the old file, so processes sharing the cache never read half of one.
+		auto temporary = path + "." + std::to_string(std::chrono::steady_clock::now().time_since_epoch().count()) + ".tmp";
+		{
+			std::ofstream file(temporary, std::ios::binary);
+			file.write(reinterpret_cast<const char*>(data.data()), data.size());
+			if (!file)
+			{
+				return false;
+			}
+		}
+
+		std::error_code error;
+		std::filesystem::rename(temporary, path, error);
+		if (error)
+		{
+			std::filesystem::remove(temporary, error);
+			return false;
+		}
+
+		return true;
+	}
+
+	// Null if the file is missing, is not an analysis of this version, or is of another cartridge.
+	static std::unique_ptr<ROM_Analysis> Load(const std::string& path, const ROM_Image& rom)
+	{
+		std::ifstream file(path, std::ios::binary | std::ios::ate);
+		std::vector<uint8_t> data(file ? static_cast<std::size_t>(file.tellg()) : 0);
+		file.seekg(0);
+		file.read(reinterpret_cast<char*>(data.data()), data.size());
+		State_Reader reader(data.data(), data.size());
+		if (reader.Read<uint32_t>() != MAGIC || reader.Read<uint32_t>() != VERSION
+			|| reader.Read<uint64_t>() != rom.Hash() || reader.Read<uint32_t>() != rom.Size())
+		{
+			return nullptr;
+		}
+
+		std::unique_ptr<ROM_Analysis> analysis(new ROM_Analysis(rom));
+		reader.Read_Block(analysis->_instructions);
+		reader.Read_Block(analysis->_leaders);
+		analysis->_edges.resize(std::min<std::size_t>(reader.Read<uint32_t>(), data.size() / sizeof(Edge)));
+		reader.Read_Block(analysis->_edges);
+		analysis->_seeds.resize(std::min<std::size_t>(reader.Read<uint32_t>(), data.size() / sizeof(uint32_t)));
+		reader.Read_Block(analysis->_seeds);
+		if (!reader.Ok() || !reader.At_End())
+		{
+			return nullptr;
+		}
+
+		return analysis;
+	}
+
+	static std::string Cache_Path(const std::string& directory, const ROM_Image& rom)
+	{
+		char name[32];
+		std::snprintf(name, sizeof(name), "%016llx.gbcode", static_cast<unsigned long long>(rom.Hash()));
+		return (std::filesystem::path(directory) / name).string();
+	}
+
+	// The cached analysis of the cartridge, or a fresh one, which is saved for next time when the directory allows.
+	static std::unique_ptr<ROM_Analysis> Open(const std::string& directory, const ROM_Image& rom)
+	{
+		auto path = Cache_Path(directory, rom);
+		if (auto analysis = Load(path, rom))
+		{
+			return analysis;
+		}
+
+		auto analysis = Analyze(rom);
+		std::error_code error;
+		std::filesystem::create_directories(directory, error);
+		analysis->Save(path);
+		return analysis;
+	}
+
+private:
+	static constexpr uint32_t MAGIC = 0x41434247; // "GBCA"
+	static constexpr uint32_t VERSION = 1;
+
+	// Where the cartridge starts, and then the interrupt vectors: VBlank, STAT, timer, serial and joypad.
+	static constexpr uint16_t ENTRY_POINTS[] = { 0x0100, 0x0040, 0x0048, 0x0050, 0x0058, 0x0060 };
+
+	explicit ROM_Analysis(const ROM_Image& rom)
+		: _rom_hash(rom.Hash()), _size(rom.Size()), _bank_count(rom.Bank_Count()),
+		_instructions((rom.Size() + 63) / 64), _leaders((rom.Size() + 63) / 64)
+	{
+	}
+
+	static uint8_t Length(uint8_t opcode)
+	{
+		return opcode == 0xCB ? 2 : OPCODES[opcode].length;
+	}
+
+	static uint32_t Offset(uint32_t location)
+	{
+		return (location >> 16) * static_cast<uint32_t>(ROM_Image::BANK_SIZE) + (location & (ROM_Image::BANK_SIZE - 1));
+	}
+
+	static uint32_t Location(uint32_t offset)
+	{
+		uint32_t bank = offset / ROM_Image::BANK_SIZE;
+		uint32_t address = offset % ROM_Image::BANK_SIZE + (bank ? ROM_Image::BANK_SIZE : 0);
+		return (bank << 16) | address;
+	}
+
+	bool Test(const std::vector<uint64_t>& bits, uint32_t location) const
+	{
+		return (location >> 16) < _bank_count && (location & 0xFFFF) < 0x8000 && Test_Offset(bits, Offset(location));
+	}
+
+	static bool Test_Offset(const std::vector<uint64_t>& bits, uint32_t offset)
+	{
+		return (bits[offset >> 6] >> (offset & 63)) & 1;
+	}
+
+	static void Set(std::vector<uint64_t>& bits, uint32_t offset)
+	{
+		bits[offset >> 6] |= uint64_t(1) << (offset & 63);
+	}
+
+	// Where a jump from the bank lands. The switched bank stays put, except that with only two there is no switching.
+	uint32_t Target(uint16_t bank, uint16_t address) const
+	{
+		if (address < ROM_Image::BANK_SIZE || address >= 0x8000)
+		{
+			return address;
+		}
+		if (bank == 0)
+		{
+			return (static_cast<uint32_t>(_bank_count == 2 ? 1 : NO_BANK) << 16) | address;
+		}
+
+		return (static_cast<uint32_t>(bank) << 16) | address;
+	}
+
+	void Walk(const uint8_t* data)
+	{
+		std::vector<uint32_t> pending(_seeds.rbegin(), _seeds.rend());
+		for (uint16_t entry : ENTRY_POINTS)
+		{
+			pending.push_back(entry);
+		}
+
+		while (!pending.empty())
+		{
+			uint32_t location = pending.back();
+			pending.pop_back();
+
+			uint16_t bank = location >> 16;
+			uint16_t pc = static_cast<uint16_t>(location);
+			if (bank >= _bank_count || pc >= 0x8000)
+			{
+				continue;
+			}
+			Set(_leaders, Offset(location));
+
+			while (true)
+			{
+				uint32_t offset = Offset((static_cast<uint32_t>(bank) << 16) | pc);
+				uint8_t opcode = data[offset];
+				uint8_t length = Length(opcode);
+				if (Test_Offset(_instructions, offset) || Is_Illegal(opcode) || (pc & (ROM_Image::BANK_SIZE - 1)) + length > ROM_Image::BANK_SIZE)
+				{
+					break;
+				}
+				Set(_instructions, offset);
+
+				uint16_t next = pc + length;
+				uint16_t operand = length == 3 ? data[offset + 1] | (data[offset + 2] << 8) : length == 2 ? data[offset + 1] : 0;
+				uint32_t from = (static_cast<uint32_t>(bank) << 16) | pc;
+				uint32_t to = 0;
+				bool jumps = true;
+				switch (opcode)
+				{
+				case 0x18: case 0x20: case 0x28: case 0x30: case 0x38: // JR
+					to = Target(bank, next + static_cast<int8_t>(operand));
+					break;
+				case 0xC2: case 0xC3: case 0xCA: case 0xD2: case 0xDA: // JP
+				case 0xC4: case 0xCC: case 0xCD: case 0xD4: case 0xDC: // CALL
+					to = Target(bank, operand);
+					break;
+				case 0xC7: case 0xCF: case 0xD7: case 0xDF: case 0xE7: case 0xEF: case 0xF7: case 0xFF: // RST
+					to = opcode & 0x38;
+					break;
+				default:
+					jumps = false;
+					break;
+				}
+
+				if (jumps)
+				{
+					_edges.push_back({ from, to });
+					pending.push_back(to);
+				}
+
+				// Running on past the end of the bank lands in a bank the walk can't know, or in RAM.
+				bool in_bank = (pc & (ROM_Image::BANK_SIZE - 1)) + length < ROM_Image::BANK_SIZE;
+				if (!Ends_Block(opcode) && in_bank)
+				{
+					pc = next;
+					continue;
+				}
+
+				// Only an unconditional JR or JP, JP (HL), RET and RETI never carry on to the next instruction.
+				bool falls_through = opcode != 0x18 && opcode != 0xC3 && opcode != 0xE9 && opcode != 0xC9 && opcode != 0xD9;
+				if (Ends_Block(opcode) && falls_through && in_bank)
+				{
+					pending.push_back((static_cast<uint32_t>(bank) << 16) | next);
+				}
+				break;
+			}
+		}
+	}
+
+	static bool Is_Illegal(uint8_t opcode)
+	{
+		switch (opcode)
+		{
+		case 0xD3: case 0xDB: case 0xDD: case 0xE3: case 0xE4: case 0xEB: case 0xEC: case 0xED: case 0xF4: case 0xFC: case 0xFD:
+			return true;
+		default:
+			return false;
+		}
+	}
+
+	uint64_t _rom_hash;
+	std::size_t _size;
+	std::size_t _bank_count;
+	std::vector<uint64_t> _instructions; // A bit per ROM byte, set where an instruction starts. Bytes no instruction covers are data.
+	std::vector<uint64_t> _leaders; // The same, where a block starts.
+	std::vector<Edge> _edges;
+	std::vector<uint32_t> _seeds;
+};
@@ -0,0 +1,210 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <istream>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// A cartridge image: read only, content hashed, and shared by every emulator running the same game.
+// Files are memory mapped, so opening even a large cartridge costs no copying and all instances share the pages.
+class ROM_Image
+{
+public:
+	const static std::size_t BANK_SIZE = 0x4000;
+
+	~ROM_Image()
+	{
+		if (_mapping)
+		{
+#ifdef _WIN32
+			UnmapViewOfFile(_mapping);
+#else
+			munmap(_mapping, _size);
+#endif
+		}
+	}
+
+	ROM_Image(const ROM_Image&) = delete;
+	ROM_Image& operator=(const ROM_Image&) = delete;
+
+	// Maps the file, or hands back the image already open with the same contents. Null if the file can't be read.
+	static std::shared_ptr<const ROM_Image> Open(const std::string& path)
+	{
+		std::unique_ptr<ROM_Image> image(new ROM_Image());
+		if (!image->Map(path))
+		{
+			return nullptr;
+		}
+
+		return Share(std::move(image));
+	}
+
+	static std::shared_ptr<const ROM_Image> From_Stream(std::istream& stream)
+	{
+		std::unique_ptr<ROM_Image> image(new ROM_Image());
+		image->Own({ std::istreambuf_iterator<char>(stream), {} });
+		return Share(std::move(image));
+	}
+
+	const uint8_t* Data() const { return _data; }
+	std::size_t Size() const { return _size; }
+	uint64_t Hash() const { return _hash; }
+
+	// Always at least two, the image is padded to whole banks.
+	std::size_t Bank_Count() const { return _size / BANK_SIZE; }
+
+private:
+	ROM_Image() = default;
+
+	bool Map(const std::string& path)
+	{
+#ifdef _WIN32
+		HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (file == INVALID_HANDLE_VALUE)
+		{
+			return false;
+		}
+
+		LARGE_INTEGER file_size;
+		std::size_t size = GetFileSizeEx(file, &file_size) ? static_cast<std::size_t>(file_size.QuadPart) : 0;
+		void* mapping = nullptr;
+		if (Mappable(size))
+		{
+			HANDLE section = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+			if (section)
+			{
+				mapping = MapViewOfFile(section, FILE_MAP_READ, 0, 0, 0);
+				CloseHandle(section);
+			}
+		}
+#else
+		int file = open(path.c_str(), O_RDONLY);
+		if (file < 0)
+		{
+			return false;
+		}
+
+		struct stat status;
+		std::size_t size = fstat(file, &status) == 0 ? static_cast<std::size_t>(status.st_size) : 0;
+		void* mapping = nullptr;
+		if (Mappable(size))
+		{
+			mapping = mmap(nullptr, size, PROT_READ, MAP_SHARED, file, 0);
+			if (mapping == MAP_FAILED)
+			{
+				mapping = nullptr;
+			}
+		}
+#endif
+
+		if (mapping)
+		{
+			_mapping = mapping;
+			_data = static_cast<const uint8_t*>(mapping);
+			_size = size;
+			_hash = Hash_Bytes(_data, _size);
+		}
+		else
+		{
+			// Odd sized cartridges get padded, which needs a private copy.
+			std::vector<uint8_t> bytes(size);
+#ifdef _WIN32
+			DWORD read = 0;
+			bool ok = size == 0 || (ReadFile(file, bytes.data(), static_cast<DWORD>(size), &read, nullptr) && read == size);
+#else
+			bool ok = size == 0 || read(file, bytes.data(), size) == static_cast<ssize_t>(size);
+#endif
+			if (!ok)
+			{
+#ifdef _WIN32
+				CloseHandle(file);
+#else
+				close(file);
+#endif
+				return false;
+			}
+			Own(std::move(bytes));
+		}
+
+#ifdef _WIN32
+		CloseHandle(file);
+#else
+		close(file);
+#endif
+		return true;
+	}
+
+	// Bank switching indexes whole banks and the fixed mapping needs two of them.
+	static bool Mappable(std::size_t size)
+	{
+		return size >= 2 * BANK_SIZE && size % BANK_SIZE == 0;
+	}
+
+	void Own(std::vector<uint8_t> bytes)
+	{
+		std::size_t size = std::max<std::size_t>(bytes.size(), 2 * BANK_SIZE);
+		bytes.resize((size + BANK_SIZE - 1) / BANK_SIZE * BANK_SIZE, 0xFF);
+
+		_owned = std::move(bytes);
+		_data = _owned.data();
+		_size = _owned.size();
+		_hash = Hash_Bytes(_data, _size);
+	}
+
+	// FNV-1a, 64 bit.
+	static uint64_t Hash_Bytes(const uint8_t* data, std::size_t size)
+	{
+		uint64_t hash = 14695981039346656037ull;
+		for (std::size_t i = 0; i < size; i++)
+		{
+			hash = (hash ^ data[i]) * 1099511628211ull;
+		}
+
+		return hash;
+	}
+
+	// Returns the live image with identical contents if there is one, so all instances share a single copy.
+	static std::shared_ptr<const ROM_Image> Share(std::unique_ptr<ROM_Image> image)
+	{
+		static std::mutex mutex;
+		static std::unordered_map<uint64_t, std::weak_ptr<const ROM_Image>> images;
+
+		std::lock_guard<std::mutex> lock(mutex);
+		auto& slot = images[image->_hash];
+		if (auto existing = slot.lock())
+		{
+			if (existing->_size == image->_size && std::memcmp(existing->_data, image->_data, image->_size) == 0)
+			{
+				return existing;
+			}
+		}
+
+		std::shared_ptr<const ROM_Image> shared(image.release());
+		slot = shared;
+		return shared;
+	}
+
+	void* _mapping = nullptr;
+	std::vector<uint8_t> _owned;
+	const uint8_t* _data = nullptr;
+	std::size_t _size = 0;
+	uint64_t _hash = 0;
+};
@@ -1,7 +1,10 @@
 #pragma once
 
+#include <cstddef>
 #include <cstdint>
 
+#include "Save_State.h"
+
 class Registers
 {
 public:
@@ -14,22 +17,40 @@ public:
 		_DE = 0x00D8;
 		_HL = 0x014D;
 		_SP = 0xFFFE;
+		_PC = 0x0100;
 
-		_zero = false;
-		_negative = false;
-		_carry = false;
-		_half_carry = false;
+		F(0xB0);
 	}
 
-	bool Zero() { return _zero; }
-	bool Negative() { return _negative; }
-	bool Carry() { return _carry; }
-	bool Half_Carry() { return _half_carry; }
+	bool Zero() { return (ZNH() & ZERO) != 0; }
+	bool Negative() { return (ZNH() & NEGATIVE) != 0; }
+	bool Carry() { return Carry_Bit() != 0; }
+	bool Half_Carry() { return (ZNH() & HALF_CARRY) != 0; }
+
+	void Zero(bool v) { Set_ZNH(ZERO, v); }
+	void Negative(bool v) { Set_ZNH(NEGATIVE, v); }
+	void Carry(bool v) { _carry_source = { Flag_Op::Explicit, static_cast<uint8_t>(v ? CARRY : 0) }; }
+	void Half_Carry(bool v) { Set_ZNH(HALF_CARRY, v); }
+
+	// The ALU records its operation and operands here, the flags are only worked out when something reads them.
+	void Flags_From_Add(uint8_t a, uint8_t b, uint8_t carry) { _znh_source = _carry_source = { Flag_Op::Add, a, b, carry }; }
+	void Flags_From_Sub(uint8_t a, uint8_t b, uint8_t carry) { _znh_source = _carry_source = { Flag_Op::Sub, a, b, carry }; }
+	void Flags_From_And(uint8_t r) { _znh_source = { Flag_Op::And, r }; _carry_source = { Flag_Op::Explicit, 0 }; }
+	void Flags_From_Or(uint8_t r) { _znh_source = { Flag_Op::Or, r }; _carry_source = { Flag_Op::Explicit, 0 }; }
+	void Flags_From_Increment(uint8_t r) { _znh_source = { Flag_Op::Increment, r }; }
+	void Flags_From_Decrement(uint8_t r) { _znh_source = { Flag_Op::Decrement, r }; }
+
+	// Flags packed the way they sit in the low byte of AF.
+	uint8_t F()
+	{
+		return ZNH() | Carry_Bit();
+	}
 
-	void Zero(bool v) { _zero = v; }
-	void Negative(bool v) { _negative = v; }
-	void Carry(bool v) { _carry = v; }
-	void Half_Carry(bool v) { _half_carry = v; }
+	void F(uint8_t v)
+	{
+		_znh_source = { Flag_Op::Explicit, static_cast<uint8_t>(v & (ZERO | NEGATIVE | HALF_CARRY)) };
+		_carry_source = { Flag_Op::Explicit, static_cast<uint8_t>(v & CARRY) };
+	}
 
 	uint8_t A() { return _A; }
 	uint8_t B() { return _BC >> 8; }
@@ -47,17 +68,63 @@ public:
 	void H(uint8_t v) { _HL = (_HL & 0x00FF) | (v << 8); }
 	void L(uint8_t v) { _HL = (_HL & 0xFF00) | v; }
 
+	uint16_t AF() { return (_A << 8) | F(); }
 	uint16_t BC() { return _BC; }
 	uint16_t DE() { return _DE; }
 	uint16_t HL() { return _HL; }
 	uint16_t SP() { return _SP; }
 	uint16_t PC() { return _PC; }
 
+	void AF(uint16_t v) { _A = v >> 8; F(v & 0xFF); }
 	void BC(uint16_t v) { _BC = v; }
 	void DE(uint16_t v) { _DE = v; }
 	void HL(uint16_t v) { _HL = v; }
 	void SP(uint16_t v) { _SP = v; }
 	void PC(uint16_t v) { _PC = v; }
+
+	// Flags are stored resolved, so a loaded state never depends on how they were last computed.
+	void Save_State(State_Writer& writer)
+	{
+		writer.Write(_A);
+		writer.Write(F());
+		writer.Write(_BC);
+		writer.Write(_DE);
+		writer.Write(_HL);
+		writer.Write(_SP);
+		writer.Write(_PC);
+	}
+
+	void Load_State(State_Reader& reader)
+	{
+		reader.Read(_A);
+		F(reader.Read<uint8_t>());
+		reader.Read(_BC);
+		reader.Read(_DE);
+		reader.Read(_HL);
+		reader.Read(_SP);
+		reader.Read(_PC);
+	}
+
+	// What Save_State keeps, straight from another instance.
+	void Copy_State(const Registers& other)
+	{
+		_A = other._A;
+		_BC = other._BC;
+		_DE = other._DE;
+		_HL = other._HL;
+		_SP = other._SP;
+		_PC = other._PC;
+		_znh_source = other._znh_source;
+		_carry_source = other._carry_source;
+	}
+
+	// Byte offsets into the register file for generated code. Pairs are little endian, so B, D and H sit at +1.
+	static std::size_t Offset_A() { return offsetof(Registers, _A); }
+	static std::size_t Offset_BC() { return offsetof(Registers, _BC); }
+	static std::size_t Offset_DE() { return offsetof(Registers, _DE); }
+	static std::size_t Offset_HL() { return offsetof(Registers, _HL); }
+	static std::size_t Offset_SP() { return offsetof(Registers, _SP); }
+	static std::size_t Offset_PC() { return offsetof(Registers, _PC); }
 private:
 	uint8_t _A;
 	uint16_t _BC;
@@ -66,8 +133,65 @@ private:
 	uint16_t _SP;
 	uint16_t _PC;
 
-	bool _zero;
-	bool _negative;
-	bool _carry;
-	bool _half_carry;
+	const static uint8_t ZERO = 0x80;
+	const static uint8_t NEGATIVE = 0x40;
+	const static uint8_t HALF_CARRY = 0x20;
+	const static uint8_t CARRY = 0x10;
+
+	enum class Flag_Op : uint8_t { Explicit, Add, Sub, And, Or, Increment, Decrement };
+
+	// Explicit keeps the flag bits themselves in a, the logic and INC/DEC ops keep their result there.
+	struct Flag_Source
+	{
+		Flag_Op op;
+		uint8_t a;
+		uint8_t b = 0;
+		uint8_t carry = 0;
+	};
+
+	uint8_t ZNH()
+	{
+		const auto& s = _znh_source;
+		switch (s.op)
+		{
+		case Flag_Op::Add:
+			return (static_cast<uint8_t>(s.a + s.b + s.carry) == 0 ? ZERO : 0)
+				| ((s.a & 0xF) + (s.b & 0xF) + s.carry > 0xF ? HALF_CARRY : 0);
+		case Flag_Op::Sub:
+			return (static_cast<uint8_t>(s.a - s.b - s.carry) == 0 ? ZERO : 0) | NEGATIVE
+				| ((s.a & 0xF) < (s.b & 0xF) + s.carry ? HALF_CARRY : 0);
+		case Flag_Op::And:
+			return (s.a == 0 ? ZERO : 0) | HALF_CARRY;
+		case Flag_Op::Or:
+			return s.a == 0 ? ZERO : 0;
+		case Flag_Op::Increment:
+			return (s.a == 0 ? ZERO : 0) | ((s.a & 0xF) == 0 ? HALF_CARRY : 0);
+		case Flag_Op::Decrement:
+			return (s.a == 0 ? ZERO : 0) | NEGATIVE | ((s.a & 0xF) == 0xF ? HALF_CARRY : 0);
+		default:
+			return s.a;
+		}
+	}
+
+	uint8_t Carry_Bit()
+	{
+		const auto& s = _carry_source;
+		switch (s.op)
+		{
+		case Flag_Op::Add:
+			return s.a + s.b + s.carry > 0xFF ? CARRY : 0;
+		case Flag_Op::Sub:
+			return s.a < s.b + s.carry ? CARRY : 0;
+		default:
+			return s.a;
+		}
+	}
+
+	void Set_ZNH(uint8_t flag, bool v)
+	{
+		_znh_source = { Flag_Op::Explicit, static_cast<uint8_t>((ZNH() & ~flag) | (v ? flag : 0)) };
+	}
+
+	Flag_Source _znh_source = { Flag_Op::Explicit, 0 };
+	Flag_Source _carry_source = { Flag_Op::Explicit, 0 };
 };
\ No newline at end of file
@@ -0,0 +1,160 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+// Keeps the newest save state in full and, going backwards, the XOR of each state with the one before it,
+// run-length encoded. Consecutive frames usually differ in a few dozen scattered bytes, so deltas stay small and the
+// oldest can be dropped without breaking the chain.
+class Rewind_Buffer
+{
+public:
+	explicit Rewind_Buffer(std::size_t capacity) : _capacity(capacity) {}
+
+	void Push(const std::vector<uint8_t>& state)
+	{
+		if (_latest.size() != state.size())
+		{
+			Clear();
+		}
+		else
+		{
+			_deltas.push_back(Encode(state, _latest));
+			_bytes += _deltas.back().size();
+			while (_deltas.size() > _capacity)
+			{
+				_bytes -= _deltas.front().size();
+				_deltas.pop_front();
+			}
+		}
+
+		_latest = state;
+	}
+
+	// Replaces state with the snapshot before the newest, returning false when there is none.
+	bool Step_Back(std::vector<uint8_t>& state)
+	{
+		if (_deltas.empty())
+		{
+			return false;
+		}
+
+		Apply(_deltas.back(), _latest);
+		_bytes -= _deltas.back().size();
+		_deltas.pop_back();
+
+		state = _latest;
+		return true;
+	}
+
+	void Clear()
+	{
+		_latest.clear();
+		_deltas.clear();
+		_bytes = 0;
+	}
+
+	// How many steps back are available.
+	std::size_t Frames() const { return _deltas.size(); }
+
+	// Memory held by the deltas plus the one full snapshot.
+	std::size_t Bytes() const { return _bytes + _latest.size(); }
+
+private:
+	// Most changed runs are a few bytes of a counter or register, so a run shorter than SHORT_RUN shares one varint
+	// with the unchanged run before it: (unchanged << RUN_BITS) | changed. Longer runs put zero in the low bits and
+	// their length in a second varint. Each changed run is followed by its XOR bytes, and the unchanged tail is left off.
+	static constexpr unsigned RUN_BITS = 3;
+	static constexpr std::size_t SHORT_RUN = std::size_t(1) << RUN_BITS;
+
+	static std::vector<uint8_t> Encode(const std::vector<uint8_t>& next, const std::vector<uint8_t>& previous)
+	{
+		std::vector<uint8_t> delta;
+		std::size_t i = 0;
+		while (true)
+		{
+			std::size_t same = i;
+			while (same < next.size() && next[same] == previous[same])
+			{
+				same++;
+			}
+
+			if (same == next.size())
+			{
+				return delta;
+			}
+
+			std::size_t changed = same;
+			while (changed < next.size() && next[changed] != previous[changed])
+			{
+				changed++;
+			}
+
+			if (changed - same < SHORT_RUN)
+			{
+				Write_Varint(delta, (same - i) << RUN_BITS | (changed - same));
+			}
+			else
+			{
+				Write_Varint(delta, (same - i) << RUN_BITS);
+				Write_Varint(delta, changed - same);
+			}
+			for (std::size_t j = same; j < changed; j++)
+			{
+				delta.push_back(next[j] ^ previous[j]);
+			}
+
+			i = changed;
+		}
+	}
+
+	static void Apply(const std::vector<uint8_t>& delta, std::vector<uint8_t>& state)
+	{
+		std::size_t position = 0;
+		std::size_t offset = 0;
+		while (position < delta.size())
+		{
+			std::size_t run = Read_Varint(delta, position);
+			offset += run >> RUN_BITS;
+			std::size_t changed = run & (SHORT_RUN - 1);
+			if (!changed)
+			{
+				changed = Read_Varint(delta, position);
+			}
+			for (std::size_t j = 0; j < changed; j++)
+			{
+				state[offset++] ^= delta[position++];
+			}
+		}
+	}
+
+	static void Write_Varint(std::vector<uint8_t>& out, std::size_t value)
+	{
+		while (value >= 0x80)
+		{
+			out.push_back(static_cast<uint8_t>(value | 0x80));
+			value >>= 7;
+		}
+		out.push_back(static_cast<uint8_t>(value));
+	}
+
+	static std::size_t Read_Varint(const std::vector<uint8_t>& in, std::size_t& position)
+	{
+		std::size_t value = 0;
+		for (int shift = 0; ; shift += 7)
+		{
+			uint8_t byte = in[position++];
+			value |= static_cast<std::size_t>(byte & 0x7F) << shift;
+			if (!(byte & 0x80))
+			{
+				return value;
+			}
+		}
+	}
+
+	std::size_t _capacity;
+	std::vector<uint8_t> _latest;
+	std::deque<std::vector<uint8_t>> _deltas;
+	std::size_t _bytes = 0;
+};
@@ -0,0 +1,317 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+// Battery backed cartridge RAM kept in a memory mapped .sav file.
+// The game writes to ordinary memory. Once a frame the emulation thread compares it with the last copy it handed over,
+// and only a changed image is copied across. A flush thread writes the newest copy out on a timer, so bursts of writes
+// coalesce and no file I/O happens on the emulation thread.
+// The file holds two slots, each with its own header. A flush overwrites the older slot and then its header, so a crash
+// part way through always leaves the other slot intact. Loading takes the newest slot whose checksum matches.
+class Save_RAM
+{
+public:
+	static constexpr std::chrono::milliseconds DEFAULT_FLUSH_INTERVAL{ 1000 };
+
+	// Hands over the last changes and waits for them to reach the file.
+	~Save_RAM()
+	{
+		if (!_mapping)
+		{
+			return;
+		}
+
+		Capture();
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			_stopping = true;
+		}
+		_wake.notify_one();
+		_flusher.join();
+
+#ifdef _WIN32
+		UnmapViewOfFile(_mapping);
+		CloseHandle(_section);
+		CloseHandle(_file);
+#else
+		munmap(_mapping, _mapping_size);
+		close(_file);
+#endif
+	}
+
+	Save_RAM(const Save_RAM&) = delete;
+	Save_RAM& operator=(const Save_RAM&) = delete;
+
+	// Maps or creates the file and fills ram with the saved contents, if there are any. Null if the file can't be used.
+	// ram must outlive the returned object.
+	static std::unique_ptr<Save_RAM> Open(const std::string& path, uint8_t* ram, std::size_t size, std::chrono::milliseconds interval = DEFAULT_FLUSH_INTERVAL)
+	{
+		std::unique_ptr<Save_RAM> save(new Save_RAM(ram, size, interval));
+		if (!save->Map(path))
+		{
+			return nullptr;
+		}
+
+		save->Load();
+		save->_flusher = std::thread(&Save_RAM::Flush_Loop, save.get());
+		return save;
+	}
+
+	// Called from the emulation thread. Costs a compare when nothing changed, and a copy when something did.
+	void Capture()
+	{
+		if (std::memcmp(_ram, _captured.data(), _size) == 0)
+		{
+			return;
+		}
+
+		std::memcpy(_captured.data(), _ram, _size);
+		std::lock_guard<std::mutex> lock(_mutex);
+		std::memcpy(_pending.data(), _captured.data(), _size);
+		_dirty = true;
+	}
+
+	// How many times the file has been written, including by earlier runs.
+	uint64_t Generation()
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		return _sequence;
+	}
+
+private:
+	const static uint32_t MAGIC = 0x56534247; // "GBSV"
+	const static uint32_t VERSION = 1;
+
+	// Headers sit in their own page so each slot starts page aligned and can be synced alone.
+	const static std::size_t HEADER_AREA = 0x1000;
+
+	struct Header
+	{
+		uint32_t magic;
+		uint32_t version;
+		uint64_t sequence;
+		uint32_t size;
+		uint32_t checksum;
+	};
+
+	Save_RAM(uint8_t* ram, std::size_t size, std::chrono::milliseconds interval)
+		: _ram(ram), _size(size), _interval(interval), _captured(size), _pending(size), _flushing(size)
+	{
+	}
+
+	bool Map(const std::string& path)
+	{
+		_mapping_size = HEADER_AREA + 2 * _size;
+#ifdef _WIN32
+		_file = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (_file == INVALID_HANDLE_VALUE)
+		{
+			return false;
+		}
+
+		LARGE_INTEGER file_size;
+		_file_size = GetFileSizeEx(_file, &file_size) ? static_cast<std::size_t>(file_size.QuadPart) : 0;
+		if (_file_size > 0 && _file_size == _size)
+		{
+			_raw_image.resize(_size);
+			DWORD read = 0;
+			ReadFile(_file, _raw_image.data(), static_cast<DWORD>(_size), &read, nullptr);
+		}
+
+		// Mapping a larger size grows the file.
+		_section = CreateFileMappingA(_file, nullptr, PAGE_READWRITE, 0, static_cast<DWORD>(_mapping_size), nullptr);
+		_mapping = _section ? static_cast<uint8_t*>(MapViewOfFile(_section, FILE_MAP_WRITE, 0, 0, _mapping_size)) : nullptr;
+		if (!_mapping)
+		{
+			if (_section)
+			{
+				CloseHandle(_section);
+			}
+			CloseHandle(_file);
+			return false;
+		}
+#else
+		_file = open(path.c_str(), O_RDWR | O_CREAT, 0644);
+		if (_file < 0)
+		{
+			return false;
+		}
+
+		off_t file_size = lseek(_file, 0, SEEK_END);
+		_file_size = file_size > 0 ? static_cast<std::size_t>(file_size) : 0;
+		if (_file_size > 0 && _file_size == _size)
+		{
+			_raw_image.resize(_size);
+			if (pread(_file, _raw_image.data(), _size, 0) != static_cast<ssize_t>(_size))
+			{
+				_raw_image.clear();
+			}
+		}
+
+		void* mapping = MAP_FAILED;
+		if (ftruncate(_file, static_cast<off_t>(std::max(_file_size, _mapping_size))) == 0)
+		{
+			mapping = mmap(nullptr, _mapping_size, PROT_READ | PROT_WRITE, MAP_SHARED, _file, 0);
+		}
+		if (mapping == MAP_FAILED)
+		{
+			close(_file);
+			return false;
+		}
+		_mapping = static_cast<uint8_t*>(mapping);
+#endif
+		return true;
+	}
+
+	void Load()
+	{
+		const Header* newest = nullptr;
+		for (uint32_t slot = 0; slot < 2; slot++)
+		{
+			const Header* header = Slot_Header(slot);
+			if (header->magic == MAGIC && header->version == VERSION && header->size == _size
+				&& header->checksum == Checksum(Slot_Data(slot)) && (!newest || header->sequence > newest->sequence))
+			{
+				newest = header;
+			}
+		}
+
+		if (newest)
+		{
+			_sequence = newest->sequence;
+			std::memcpy(_ram, Slot_Data(static_cast<uint32_t>(_sequence & 1)), _size);
+		}
+		else if (!_raw_image.empty())
+		{
+			// A plain RAM dump, as other emulators write, is taken as is and rewritten in this format before Open returns.
+			// Slot 1 lies past the dump, and its header only overwrites the dump once the slot's data is on disk, so a
+			// crash at any point leaves either the dump or a valid slot.
+			std::memcpy(_ram, _raw_image.data(), _size);
+			std::memcpy(_flushing.data(), _raw_image.data(), _size);
+			Write_Slot(1);
+			_sequence = 1;
+		}
+
+		std::memcpy(_captured.data(), _ram, _size);
+		std::memcpy(_pending.data(), _ram, _size);
+		_raw_image.clear();
+		_raw_image.shrink_to_fit();
+	}
+
+	void Flush_Loop()
+	{
+		std::unique_lock<std::mutex> lock(_mutex);
+		while (true)
+		{
+			_wake.wait_for(lock, _interval, [this] { return _stopping; });
+			bool stopping = _stopping;
+			if (_dirty)
+			{
+				std::memcpy(_flushing.data(), _pending.data(), _size);
+				_dirty = false;
+				uint64_t sequence = _sequence + 1;
+
+				lock.unlock();
+				Write_Slot(sequence);
+				lock.lock();
+				_sequence = sequence;
+			}
+
+			if (stopping)
+			{
+				return;
+			}
+		}
+	}
+
+	// Data first, then the header that vouches for it.
+	void Write_Slot(uint64_t sequence)
+	{
+		uint32_t slot = static_cast<uint32_t>(sequence & 1);
+		uint8_t* data = Slot_Data(slot);
+		std::memcpy(data, _flushing.data(), _size);
+		Sync(data, _size);
+
+		Header header = { MAGIC, VERSION, sequence, static_cast<uint32_t>(_size), Checksum(data) };
+		std::memcpy(Slot_Header(slot), &header, sizeof(header));
+		Sync(_mapping, HEADER_AREA);
+	}
+
+	void Sync(void* address, std::size_t size)
+	{
+#ifdef _WIN32
+		FlushViewOfFile(address, size);
+#else
+		msync(address, size, MS_SYNC);
+#endif
+	}
+
+	Header* Slot_Header(uint32_t slot)
+	{
+		return reinterpret_cast<Header*>(_mapping) + slot;
+	}
+
+	uint8_t* Slot_Data(uint32_t slot)
+	{
+		return _mapping + HEADER_AREA + slot * _size;
+	}
+
+	// FNV-1a.
+	uint32_t Checksum(const uint8_t* data)
+	{
+		uint32_t hash = 2166136261u;
+		for (std::size_t i = 0; i < _size; i++)
+		{
+			hash = (hash ^ data[i]) * 16777619u;
+		}
+
+		return hash;
+	}
+
+	uint8_t* _ram;
+	std::size_t _size;
+	std::chrono::milliseconds _interval;
+
+	// Owned by the emulation thread, shared under the mutex, and owned by the flush thread respectively.
+	std::vector<uint8_t> _captured;
+	std::vector<uint8_t> _pending;
+	std::vector<uint8_t> _flushing;
+	std::vector<uint8_t> _raw_image;
+
+	std::mutex _mutex;
+	std::condition_variable _wake;
+	std::thread _flusher;
+	bool _dirty = false;
+	bool _stopping = false;
+	uint64_t _sequence = 0;
+
+#ifdef _WIN32
+	HANDLE _file = INVALID_HANDLE_VALUE;
+	HANDLE _section = nullptr;
+#else
+	int _file = -1;
+#endif
+	std::size_t _file_size = 0;
+	std::size_t _mapping_size = 0;
+	uint8_t* _mapping = nullptr;
+};
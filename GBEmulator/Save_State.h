@@ -0,0 +1,102 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <vector>
+
+// Save states are a flat little-endian dump of each component in a fixed order, with no per-field tags.
+// Every snapshot of a given emulator has the same size, which keeps rewind deltas a plain byte-wise XOR.
+const static uint32_t SAVE_STATE_MAGIC = 0x53534247; // "GBSS"
+const static uint32_t SAVE_STATE_VERSION = 4;
+
+class State_Writer
+{
+public:
+	// Appends to data, which is cleared first so a buffer can be reused between snapshots.
+	explicit State_Writer(std::vector<uint8_t>& data) : _data(data)
+	{
+		_data.clear();
+	}
+
+	template<typename T>
+	void Write(const T& value)
+	{
+		static_assert(std::is_trivially_copyable_v<T>);
+		Write_Bytes(&value, sizeof(T));
+	}
+
+	void Write_Bytes(const void* bytes, std::size_t size)
+	{
+		auto* first = static_cast<const uint8_t*>(bytes);
+		_data.insert(_data.end(), first, first + size);
+	}
+
+	template<typename Container>
+	void Write_Block(const Container& container)
+	{
+		Write_Bytes(container.data(), container.size() * sizeof(container[0]));
+	}
+
+private:
+	std::vector<uint8_t>& _data;
+};
+
+// Reads fail softly: once anything runs past the end every later read is skipped and Ok() turns false.
+class State_Reader
+{
+public:
+	State_Reader(const uint8_t* data, std::size_t size) : _data(data), _size(size) {}
+
+	template<typename T>
+	void Read(T& value)
+	{
+		static_assert(std::is_trivially_copyable_v<T>);
+		Read_Bytes(&value, sizeof(T));
+	}
+
+	template<typename T>
+	T Read()
+	{
+		T value{};
+		Read(value);
+		return value;
+	}
+
+	void Read_Bytes(void* bytes, std::size_t size)
+	{
+		if (const uint8_t* data = Take_Bytes(size))
+		{
+			std::memcpy(bytes, data, size);
+		}
+	}
+
+	// The next size bytes where they lie, for comparing before copying, or null like a failed read.
+	const uint8_t* Take_Bytes(std::size_t size)
+	{
+		if (!_ok || _size - _offset < size)
+		{
+			_ok = false;
+			return nullptr;
+		}
+
+		const uint8_t* data = _data + _offset;
+		_offset += size;
+		return data;
+	}
+
+	template<typename Container>
+	void Read_Block(Container& container)
+	{
+		Read_Bytes(container.data(), container.size() * sizeof(container[0]));
+	}
+
+	bool Ok() const { return _ok; }
+	bool At_End() const { return _offset == _size; }
+
+private:
+	const uint8_t* _data;
+	std::size_t _size;
+	std::size_t _offset = 0;
+	bool _ok = true;
+};
@@ -0,0 +1,181 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <vector>
+
+#include "Save_State.h"
+
+// Everything that happens at a known future cycle. Each type has at most one pending event.
+enum class Event_Type : uint8_t
+{
+	PPU,
+	Timer,
+	Count
+};
+
+// Min-heap of events keyed on the absolute cycle count. The CPU runs straight up to the next event
+// instead of polling every component after each instruction.
+class Scheduler
+{
+public:
+	using Clock = uint64_t (*)(const void* context);
+	using Handler = void (*)(void* context, uint64_t cycle);
+
+	const static uint64_t NEVER = std::numeric_limits<uint64_t>::max();
+
+	Scheduler(const void* clock_context, Clock clock) : _clock_context(clock_context), _clock(clock) {}
+
+	Scheduler(const Scheduler&) = delete;
+	Scheduler& operator=(const Scheduler&) = delete;
+
+	// The current cycle, exact even in the middle of a CPU slice.
+	uint64_t Now() const
+	{
+		return _clock(_clock_context);
+	}
+
+	// Handlers get the cycle the event was due at, which can be slightly before Now().
+	void Set_Handler(Event_Type type, void* context, Handler handler)
+	{
+		_handlers[static_cast<std::size_t>(type)] = { context, handler };
+	}
+
+	// Replaces any event of the same type that is already pending.
+	void Schedule(Event_Type type, uint64_t cycle)
+	{
+		auto& pending = _pending[static_cast<std::size_t>(type)];
+		pending.cycle = cycle;
+		pending.generation++;
+		pending.active = true;
+
+		_heap.push_back({ cycle, type, pending.generation });
+		std::push_heap(_heap.begin(), _heap.end(), std::greater<>());
+	}
+
+	void Cancel(Event_Type type)
+	{
+		auto& pending = _pending[static_cast<std::size_t>(type)];
+		pending.generation++;
+		pending.active = false;
+	}
+
+	// When the given event is due, or NEVER.
+	uint64_t When(Event_Type type) const
+	{
+		const auto& pending = _pending[static_cast<std::size_t>(type)];
+		return pending.active ? pending.cycle : NEVER;
+	}
+
+	uint64_t Next_Cycle()
+	{
+		Drop_Stale();
+		return _heap.empty() ? NEVER : _heap.front().cycle;
+	}
+
+	// Fires every event due at or before Now(), earliest first. Handlers may schedule more.
+	void Run_Due()
+	{
+		uint64_t now = Now();
+		while (Next_Cycle() <= now)
+		{
+			std::pop_heap(_heap.begin(), _heap.end(), std::greater<>());
+			auto entry = _heap.back();
+			_heap.pop_back();
+
+			auto index = static_cast<std::size_t>(entry.type);
+			_pending[index].active = false;
+			_handlers[index].handler(_handlers[index].context, entry.cycle);
+		}
+	}
+
+	void Save_State(State_Writer& writer)
+	{
+		for (const auto& pending : _pending)
+		{
+			writer.Write(pending.active);
+			writer.Write(pending.cycle);
+		}
+	}
+
+	void Load_State(State_Reader& reader)
+	{
+		_heap.clear();
+		for (std::size_t type = 0; type < _pending.size(); type++)
+		{
+			bool active = reader.Read<bool>();
+			uint64_t cycle = reader.Read<uint64_t>();
+			if (active)
+			{
+				Schedule(static_cast<Event_Type>(type), cycle);
+			}
+			else
+			{
+				// The cycle a cancelled event was due at means nothing, it is kept so states compare byte for byte.
+				Cancel(static_cast<Event_Type>(type));
+				_pending[type].cycle = cycle;
+			}
+		}
+	}
+
+	// What Save_State keeps, straight from another instance. The heap comes along with the generations it was built
+	// under, so it pops in the same order.
+	void Copy_State(const Scheduler& other)
+	{
+		_heap = other._heap;
+		_pending = other._pending;
+	}
+
+private:
+	struct Entry
+	{
+		uint64_t cycle;
+		Event_Type type;
+		uint32_t generation;
+
+		// Ties go to the lower type so the order never depends on heap layout.
+		bool operator>(const Entry& other) const
+		{
+			return cycle != other.cycle ? cycle > other.cycle : type > other.type;
+		}
+	};
+
+	struct Pending
+	{
+		uint64_t cycle = 0;
+		uint32_t generation = 0;
+		bool active = false;
+	};
+
+	struct Registered_Handler
+	{
+		void* context = nullptr;
+		Handler handler = nullptr;
+	};
+
+	// Rescheduled and cancelled events are left in the heap and skipped here.
+	void Drop_Stale()
+	{
+		while (!_heap.empty())
+		{
+			const auto& top = _heap.front();
+			const auto& pending = _pending[static_cast<std::size_t>(top.type)];
+			if (pending.active && pending.generation == top.generation)
+			{
+				return;
+			}
+
+			std::pop_heap(_heap.begin(), _heap.end(), std::greater<>());
+			_heap.pop_back();
+		}
+	}
+
+	const void* _clock_context;
+	Clock _clock;
+	std::vector<Entry> _heap;
+	std::array<Pending, static_cast<std::size_t>(Event_Type::Count)> _pending;
+	std::array<Registered_Handler, static_cast<std::size_t>(Event_Type::Count)> _handlers;
+};
@@ -0,0 +1,168 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Work-stealing pool: each worker owns a queue and takes from its back, idle workers steal from the front of others.
+class Thread_Pool
+{
+public:
+	explicit Thread_Pool(std::size_t thread_count = 0)
+	{
+		if (thread_count == 0)
+		{
+			thread_count = std::max(1u, std::thread::hardware_concurrency());
+		}
+
+		for (std::size_t i = 0; i < thread_count; i++)
+		{
+			_queues.push_back(std::make_unique<Worker_Queue>());
+		}
+
+		for (std::size_t i = 0; i < thread_count; i++)
+		{
+			_threads.emplace_back([this, i] { Worker_Loop(i); });
+		}
+	}
+
+	~Thread_Pool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(_wait_mutex);
+			_stopping = true;
+		}
+		_wake.notify_all();
+
+		for (auto& thread : _threads)
+		{
+			thread.join();
+		}
+	}
+
+	Thread_Pool(const Thread_Pool&) = delete;
+	Thread_Pool& operator=(const Thread_Pool&) = delete;
+
+	std::size_t Thread_Count() const { return _threads.size(); }
+
+	void Submit(std::function<void()> task)
+	{
+		// Tasks submitted from a worker stay local to it, everything else is spread round robin.
+		std::size_t index = _worker_index != NOT_A_WORKER && _worker_pool == this
+			? _worker_index
+			: _next_queue.fetch_add(1, std::memory_order_relaxed) % _queues.size();
+
+		_pending.fetch_add(1, std::memory_order_relaxed);
+		{
+			std::lock_guard<std::mutex> lock(_queues[index]->mutex);
+			_queues[index]->tasks.push_back(std::move(task));
+		}
+		_queued.fetch_add(1, std::memory_order_release);
+
+		{
+			std::lock_guard<std::mutex> lock(_wait_mutex);
+		}
+		_wake.notify_one();
+	}
+
+	// Blocks until every submitted task has finished.
+	void Wait()
+	{
+		std::unique_lock<std::mutex> lock(_wait_mutex);
+		_idle.wait(lock, [this] { return _pending.load(std::memory_order_acquire) == 0; });
+	}
+
+private:
+	struct Worker_Queue
+	{
+		std::mutex mutex;
+		std::deque<std::function<void()>> tasks;
+	};
+
+	const static std::size_t NOT_A_WORKER = ~std::size_t(0);
+
+	void Worker_Loop(std::size_t index)
+	{
+		_worker_index = index;
+		_worker_pool = this;
+
+		std::function<void()> task;
+		while (true)
+		{
+			if (Pop(index, task) || Steal(index, task))
+			{
+				_queued.fetch_sub(1, std::memory_order_relaxed);
+				task();
+				task = nullptr;
+
+				if (_pending.fetch_sub(1, std::memory_order_acq_rel) == 1)
+				{
+					std::lock_guard<std::mutex> lock(_wait_mutex);
+					_idle.notify_all();
+				}
+				continue;
+			}
+
+			std::unique_lock<std::mutex> lock(_wait_mutex);
+			_wake.wait(lock, [this] { return _stopping || _queued.load(std::memory_order_acquire) > 0; });
+			if (_stopping && _queued.load(std::memory_order_acquire) == 0)
+			{
+				return;
+			}
+		}
+	}
+
+	bool Pop(std::size_t index, std::function<void()>& task)
+	{
+		auto& queue = *_queues[index];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		if (queue.tasks.empty())
+		{
+			return false;
+		}
+
+		task = std::move(queue.tasks.back());
+		queue.tasks.pop_back();
+		return true;
+	}
+
+	bool Steal(std::size_t index, std::function<void()>& task)
+	{
+		for (std::size_t i = 1; i < _queues.size(); i++)
+		{
+			auto& queue = *_queues[(index + i) % _queues.size()];
+			std::unique_lock<std::mutex> lock(queue.mutex, std::try_to_lock);
+			if (!lock.owns_lock() || queue.tasks.empty())
+			{
+				continue;
+			}
+
+			task = std::move(queue.tasks.front());
+			queue.tasks.pop_front();
+			return true;
+		}
+
+		return false;
+	}
+
+	std::vector<std::unique_ptr<Worker_Queue>> _queues;
+	std::vector<std::thread> _threads;
+
+	std::mutex _wait_mutex;
+	std::condition_variable _wake;
+	std::condition_variable _idle;
+	std::atomic<std::size_t> _pending{ 0 };
+	std::atomic<std::size_t> _queued{ 0 };
+	std::atomic<std::size_t> _next_queue{ 0 };
+	bool _stopping = false;
+
+	static inline thread_local std::size_t _worker_index = NOT_A_WORKER;
+	static inline thread_local const Thread_Pool* _worker_pool = nullptr;
+};
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+
+#include "Memory.h"
+#include "Tile_Decoder.h"
+
+// The 384 tiles of VRAM decoded to one colour index per pixel, in both horizontal orientations.
+// Only tiles written since the last Update are decoded again.
+class Tile_Cache
+{
+public:
+	const static uint32_t TILE_COUNT = 384;
+
+	Tile_Cache(Memory& memory) : _memory(memory) {}
+
+	Tile_Cache(const Tile_Cache&) = delete;
+	Tile_Cache& operator=(const Tile_Cache&) = delete;
+
+	void Update()
+	{
+		_memory.Take_Dirty_Tiles([this](uint16_t tile) { Decode(tile); });
+	}
+
+	// Eight colour indices for one row of a tile, tile being its offset into VRAM divided by 16.
+	const uint8_t* Row(uint32_t tile, uint32_t row, bool flip_x = false) const
+	{
+		return (flip_x ? _flipped : _tiles)[tile].data() + row * 8;
+	}
+
+private:
+	void Decode(uint16_t tile)
+	{
+		Decode_Tile_Rows(_memory.VRAM() + tile * 16, 8, _tiles[tile].data());
+
+		for (uint32_t row = 0; row < 8; row++)
+		{
+			std::reverse_copy(_tiles[tile].begin() + row * 8, _tiles[tile].begin() + row * 8 + 8, _flipped[tile].begin() + row * 8);
+		}
+	}
+
+	Memory& _memory;
+	std::array<std::array<uint8_t, 64>, TILE_COUNT> _tiles;
+	std::array<std::array<uint8_t, 64>, TILE_COUNT> _flipped;
+};
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define GB_TILE_DECODER_AVX2 1
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define GB_TILE_DECODER_SSE2 1
+#endif
+
+// Turns 2bpp tile rows into one colour index (0-3) per pixel, leftmost pixel first.
+// rows holds count (low plane, high plane) byte pairs, out receives count * 8 bytes.
+inline void Decode_Tile_Rows_Scalar(const uint8_t* rows, std::size_t count, uint8_t* out)
+{
+	for (std::size_t row = 0; row < count; row++)
+	{
+		uint8_t lo = rows[row * 2];
+		uint8_t hi = rows[row * 2 + 1];
+		for (int pixel = 0; pixel < 8; pixel++)
+		{
+			int bit = 7 - pixel;
+			out[row * 8 + pixel] = ((lo >> bit) & 1) | (((hi >> bit) & 1) << 1);
+		}
+	}
+}
+
+#if defined(GB_TILE_DECODER_AVX2)
+
+// Four rows (32 pixels) per iteration: each plane byte is spread across its eight pixels and tested against the bit masks.
+inline void Decode_Tile_Rows(const uint8_t* rows, std::size_t count, uint8_t* out)
+{
+	// Both 128-bit lanes hold all four pairs, lane 0 expands rows 0 and 1, lane 1 rows 2 and 3.
+	const __m256i lo_spread = _mm256_setr_epi8(
+		0, 0, 0, 0, 0, 0, 0, 0, 2, 2, 2, 2, 2, 2, 2, 2,
+		4, 4, 4, 4, 4, 4, 4, 4, 6, 6, 6, 6, 6, 6, 6, 6);
+	const __m256i hi_spread = _mm256_add_epi8(lo_spread, _mm256_set1_epi8(1));
+	const __m256i bits = _mm256_set1_epi64x(0x0102040810204080ll);
+	const __m256i one = _mm256_set1_epi8(1);
+	const __m256i two = _mm256_set1_epi8(2);
+
+	std::size_t row = 0;
+	for (; row + 4 <= count; row += 4)
+	{
+		int64_t pairs;
+		std::memcpy(&pairs, rows + row * 2, sizeof(pairs));
+		__m256i source = _mm256_set1_epi64x(pairs);
+		__m256i lo = _mm256_shuffle_epi8(source, lo_spread);
+		__m256i hi = _mm256_shuffle_epi8(source, hi_spread);
+
+		__m256i lo_set = _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_and_si256(lo, bits), bits), one);
+		__m256i hi_set = _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_and_si256(hi, bits), bits), two);
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(out + row * 8), _mm256_or_si256(lo_set, hi_set));
+	}
+
+	Decode_Tile_Rows_Scalar(rows + row * 2, count - row, out + row * 8);
+}
+
+#elif defined(GB_TILE_DECODER_SSE2)
+
+// Two rows (16 pixels) per iteration, plain SSE2 has no byte shuffle so the planes are spread by unpacking.
+inline void Decode_Tile_Rows(const uint8_t* rows, std::size_t count, uint8_t* out)
+{
+	const __m128i bits = _mm_set1_epi64x(0x0102040810204080ll);
+	const __m128i one = _mm_set1_epi8(1);
+	const __m128i two = _mm_set1_epi8(2);
+
+	std::size_t row = 0;
+	for (; row + 2 <= count; row += 2)
+	{
+		uint32_t pairs;
+		std::memcpy(&pairs, rows + row * 2, sizeof(pairs));
+		__m128i source = _mm_cvtsi32_si128(static_cast<int>(pairs));
+		__m128i doubled = _mm_unpacklo_epi8(source, source);
+		__m128i quadrupled = _mm_unpacklo_epi16(doubled, doubled); // lo0 x4, hi0 x4, lo1 x4, hi1 x4
+		__m128i lo = _mm_shuffle_epi32(quadrupled, 0xA0);
+		__m128i hi = _mm_shuffle_epi32(quadrupled, 0xF5);
+
+		__m128i lo_set = _mm_and_si128(_mm_cmpeq_epi8(_mm_and_si128(lo, bits), bits), one);
+		__m128i hi_set = _mm_and_si128(_mm_cmpeq_epi8(_mm_and_si128(hi, bits), bits), two);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(out + row * 8), _mm_or_si128(lo_set, hi_set));
+	}
+
+	Decode_Tile_Rows_Scalar(rows + row * 2, count - row, out + row * 8);
+}
+
+#else
+
+inline void Decode_Tile_Rows(const uint8_t* rows, std::size_t count, uint8_t* out)
+{
+	Decode_Tile_Rows_Scalar(rows, count, out);
+}
+
+#endif
@@ -0,0 +1,174 @@
+#pragma once
+
+#include <cstdint>
+
+#include "Memory.h"
+#include "Scheduler.h"
+
+// DIV and TIMA are worked out from the cycle count when read, only a TIMA overflow is an actual event.
+class Timer
+{
+public:
+	Timer(Memory& memory, Scheduler& scheduler) : _memory(memory), _scheduler(scheduler)
+	{
+		_memory.Set_IO_Handler(DIV, this, &Timer::Read_DIV, &Timer::Write_DIV);
+		_memory.Set_IO_Handler(TIMA, this, &Timer::Read_TIMA, &Timer::Write_TIMA);
+		_memory.Set_IO_Handler(TMA, this, &Timer::Read_TMA, &Timer::Write_TMA, true);
+		_memory.Set_IO_Handler(TAC, this, &Timer::Read_TAC, &Timer::Write_TAC, true);
+		_scheduler.Set_Handler(Event_Type::Timer, this, &Timer::Overflow);
+	}
+
+	Timer(const Timer&) = delete;
+	Timer& operator=(const Timer&) = delete;
+
+	// The overflow event itself is saved with the scheduler.
+	void Save_State(State_Writer& writer)
+	{
+		writer.Write(_divider_start);
+		writer.Write(_tima_start);
+		writer.Write(_tima);
+		writer.Write(_tma);
+		writer.Write(_tac);
+	}
+
+	void Load_State(State_Reader& reader)
+	{
+		reader.Read(_divider_start);
+		reader.Read(_tima_start);
+		reader.Read(_tima);
+		reader.Read(_tma);
+		reader.Read(_tac);
+	}
+
+	// What Save_State keeps, straight from another instance.
+	void Copy_State(const Timer& other)
+	{
+		_divider_start = other._divider_start;
+		_tima_start = other._tima_start;
+		_tima = other._tima;
+		_tma = other._tma;
+		_tac = other._tac;
+	}
+
+private:
+	const static uint16_t DIV = 0xFF04;
+	const static uint16_t TIMA = 0xFF05;
+	const static uint16_t TMA = 0xFF06;
+	const static uint16_t TAC = 0xFF07;
+
+	const static uint8_t TIMER_INTERRUPT = 0x04;
+
+	bool Enabled() const
+	{
+		return _tac & 0x04;
+	}
+
+	// Cycles per TIMA increment for each TAC clock select.
+	uint64_t Period() const
+	{
+		const uint64_t periods[4] = { 1024, 16, 64, 256 };
+		return periods[_tac & 3];
+	}
+
+	// TIMA ticks whenever the selected bit of the divider counter falls, so count multiples of the period crossed.
+	uint64_t Ticks(uint64_t from, uint64_t to) const
+	{
+		return (to - _divider_start) / Period() - (from - _divider_start) / Period();
+	}
+
+	// Brings _tima up to date with the present cycle. An overflow in between is already handled by the event.
+	void Sync()
+	{
+		uint64_t now = _scheduler.Now();
+		if (Enabled())
+		{
+			_tima = static_cast<uint8_t>(_tima + Ticks(_tima_start, now));
+		}
+		_tima_start = now;
+	}
+
+	void Schedule_Overflow()
+	{
+		if (!Enabled())
+		{
+			_scheduler.Cancel(Event_Type::Timer);
+			return;
+		}
+
+		// The next falling edge after _tima_start, then one more per remaining count.
+		uint64_t period = Period();
+		uint64_t first_edge = ((_tima_start - _divider_start) / period + 1) * period + _divider_start;
+		_scheduler.Schedule(Event_Type::Timer, first_edge + (0xFF - _tima) * period);
+	}
+
+	static void Overflow(void* context, uint64_t cycle)
+	{
+		auto* timer = static_cast<Timer*>(context);
+		timer->_tima = timer->_tma;
+		timer->_tima_start = cycle;
+		timer->_memory.IO(Memory::IO_Type::IF) |= TIMER_INTERRUPT;
+		timer->Schedule_Overflow();
+	}
+
+	static uint8_t Read_DIV(void* context, uint16_t /*address*/)
+	{
+		auto* timer = static_cast<Timer*>(context);
+		return static_cast<uint8_t>((timer->_scheduler.Now() - timer->_divider_start) >> 8);
+	}
+
+	// Any write resets the whole divider counter.
+	static void Write_DIV(void* context, uint16_t /*address*/, uint8_t /*value*/)
+	{
+		auto* timer = static_cast<Timer*>(context);
+		timer->Sync();
+		timer->_divider_start = timer->_tima_start;
+		timer->Schedule_Overflow();
+	}
+
+	static uint8_t Read_TIMA(void* context, uint16_t /*address*/)
+	{
+		auto* timer = static_cast<Timer*>(context);
+		timer->Sync();
+		return timer->_tima;
+	}
+
+	static void Write_TIMA(void* context, uint16_t /*address*/, uint8_t value)
+	{
+		auto* timer = static_cast<Timer*>(context);
+		timer->Sync();
+		timer->_tima = value;
+		timer->Schedule_Overflow();
+	}
+
+	static uint8_t Read_TMA(void* context, uint16_t /*address*/)
+	{
+		return static_cast<Timer*>(context)->_tma;
+	}
+
+	static void Write_TMA(void* context, uint16_t /*address*/, uint8_t value)
+	{
+		static_cast<Timer*>(context)->_tma = value;
+	}
+
+	static uint8_t Read_TAC(void* context, uint16_t /*address*/)
+	{
+		return static_cast<Timer*>(context)->_tac | 0xF8;
+	}
+
+	static void Write_TAC(void* context, uint16_t /*address*/, uint8_t value)
+	{
+		auto* timer = static_cast<Timer*>(context);
+		timer->Sync();
+		timer->_tac = value & 0x07;
+		timer->Schedule_Overflow();
+	}
+
+	Memory& _memory;
+	Scheduler& _scheduler;
+
+	uint64_t _divider_start = 0;
+	uint64_t _tima_start = 0;
+	uint8_t _tima = 0;
+	uint8_t _tma = 0;
+	uint8_t _tac = 0;
+};
@@ -0,0 +1,227 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+// One executed instruction and the machine state just before it ran.
+struct Trace_Record
+{
+	uint64_t cycle;
+	uint16_t bank;
+	uint16_t pc;
+	uint16_t sp;
+	uint8_t opcode;
+	uint8_t operand; // The second byte of the instruction, which is the real opcode after 0xCB.
+	uint8_t a;
+	uint8_t f;
+	uint8_t b;
+	uint8_t c;
+	uint8_t d;
+	uint8_t e;
+	uint8_t h;
+	uint8_t l;
+};
+
+static_assert(sizeof(Trace_Record) == 24, "Trace files depend on the record layout");
+
+// Trace files are a small header followed by raw records in host byte order.
+struct Trace_Header
+{
+	const static uint32_t MAGIC = 0x52544247; // "GBTR"
+	const static uint32_t VERSION = 1;
+
+	uint32_t magic = MAGIC;
+	uint32_t version = VERSION;
+	uint32_t record_size = sizeof(Trace_Record);
+	uint32_t reserved = 0;
+};
+
+// Writes trace records to a file from a background thread. The emulation thread only copies each record into a
+// single producer, single consumer ring, it waits only if the disk falls a whole ring behind.
+class Trace_Writer
+{
+public:
+	// 24 MB, a few hundred milliseconds of emulation.
+	const static std::size_t DEFAULT_CAPACITY = 1 << 20;
+
+	~Trace_Writer()
+	{
+		_stopping.store(true, std::memory_order_release);
+		_writer.join();
+		std::fclose(_file);
+	}
+
+	Trace_Writer(const Trace_Writer&) = delete;
+	Trace_Writer& operator=(const Trace_Writer&) = delete;
+
+	// Null if the file can't be created. capacity is rounded up to a power of two.
+	static std::unique_ptr<Trace_Writer> Open(const std::string& path, std::size_t capacity = DEFAULT_CAPACITY)
+	{
+		std::FILE* file = std::fopen(path.c_str(), "wb");
+		if (!file)
+		{
+			return nullptr;
+		}
+
+		Trace_Header header;
+		std::fwrite(&header, sizeof(header), 1, file);
+		return std::unique_ptr<Trace_Writer>(new Trace_Writer(file, capacity));
+	}
+
+	void Record(const Trace_Record& record)
+	{
+		uint64_t head = _head.load(std::memory_order_relaxed);
+		if (head - _cached_tail == _ring.size())
+		{
+			_cached_tail = _tail.load(std::memory_order_acquire);
+			while (head - _cached_tail == _ring.size())
+			{
+				std::this_thread::yield();
+				_cached_tail = _tail.load(std::memory_order_acquire);
+			}
+		}
+
+		_ring[head & _mask] = record;
+		_head.store(head + 1, std::memory_order_release);
+	}
+
+	// Records handed to the writer so far.
+	uint64_t Count() const
+	{
+		return _head.load(std::memory_order_relaxed);
+	}
+
+	// False once a write to the file has failed, later records are dropped.
+	bool Ok() const
+	{
+		return !_failed.load(std::memory_order_relaxed);
+	}
+
+private:
+	Trace_Writer(std::FILE* file, std::size_t capacity) : _file(file)
+	{
+		std::size_t size = 1;
+		while (size < capacity)
+		{
+			size <<= 1;
+		}
+		_ring.resize(size);
+		_mask = size - 1;
+		_writer = std::thread(&Trace_Writer::Write_Loop, this);
+	}
+
+	void Write_Loop()
+	{
+		uint64_t tail = 0;
+		while (true)
+		{
+			bool stopping = _stopping.load(std::memory_order_acquire);
+			uint64_t head = _head.load(std::memory_order_acquire);
+			if (head == tail)
+			{
+				if (stopping)
+				{
+					std::fflush(_file);
+					return;
+				}
+
+				std::this_thread::sleep_for(std::chrono::milliseconds(1));
+				continue;
+			}
+
+			// Up to the end of the ring in one go, the wrapped part on the next pass.
+			std::size_t start = tail & _mask;
+			std::size_t count = static_cast<std::size_t>(std::min<uint64_t>(head - tail, _ring.size() - start));
+			if (!_failed.load(std::memory_order_relaxed) && std::fwrite(&_ring[start], sizeof(Trace_Record), count, _file) != count)
+			{
+				_failed.store(true, std::memory_order_relaxed);
+			}
+
+			tail += count;
+			_tail.store(tail, std::memory_order_release);
+		}
+	}
+
+	std::FILE* _file;
+	std::vector<Trace_Record> _ring;
+	std::size_t _mask = 0;
+
+	// Each index lives on its own cache line so the two threads don't fight over one.
+	alignas(64) std::atomic<uint64_t> _head = 0;
+	uint64_t _cached_tail = 0;
+	alignas(64) std::atomic<uint64_t> _tail = 0;
+	alignas(64) std::atomic<bool> _stopping = false;
+	std::atomic<bool> _failed = false;
+
+	std::thread _writer;
+};
+
+// Streams the records back out of a trace file, a block at a time.
+class Trace_Reader
+{
+public:
+	~Trace_Reader()
+	{
+		if (_file)
+		{
+			std::fclose(_file);
+		}
+	}
+
+	Trace_Reader(const Trace_Reader&) = delete;
+	Trace_Reader& operator=(const Trace_Reader&) = delete;
+
+	// Null if the file is missing or is not a trace of this version.
+	static std::unique_ptr<Trace_Reader> Open(const std::string& path)
+	{
+		std::FILE* file = std::fopen(path.c_str(), "rb");
+		if (!file)
+		{
+			return nullptr;
+		}
+
+		std::unique_ptr<Trace_Reader> reader(new Trace_Reader(file));
+		Trace_Header header;
+		if (std::fread(&header, sizeof(header), 1, file) != 1 || header.magic != Trace_Header::MAGIC
+			|| header.version != Trace_Header::VERSION || header.record_size != sizeof(Trace_Record))
+		{
+			return nullptr;
+		}
+
+		return reader;
+	}
+
+	// False at the end of the file.
+	bool Next(Trace_Record& record)
+	{
+		if (_position == _buffer.size())
+		{
+			_buffer.resize(BUFFER_RECORDS);
+			_buffer.resize(std::fread(_buffer.data(), sizeof(Trace_Record), BUFFER_RECORDS, _file));
+			_position = 0;
+			if (_buffer.empty())
+			{
+				return false;
+			}
+		}
+
+		record = _buffer[_position++];
+		return true;
+	}
+
+private:
+	const static std::size_t BUFFER_RECORDS = 1 << 16;
+
+	explicit Trace_Reader(std::FILE* file) : _file(file) {}
+
+	std::FILE* _file;
+	std::vector<Trace_Record> _buffer;
+	std::size_t _position = 0;
+};
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+// Lock-free hand-off of whole values from one producer thread to one consumer thread.
+// The producer always has a buffer to write into and the consumer always sees the newest complete one, neither ever waits.
+template<typename T>
+class Triple_Buffer
+{
+public:
+	Triple_Buffer() = default;
+	Triple_Buffer(const Triple_Buffer&) = delete;
+	Triple_Buffer& operator=(const Triple_Buffer&) = delete;
+
+	// Producer side: fill this buffer, then Publish it.
+	T& Write_Buffer()
+	{
+		return _buffers[_write];
+	}
+
+	void Publish()
+	{
+		uint8_t previous = _middle.exchange(_write | FRESH, std::memory_order_acq_rel);
+		_write = previous & INDEX_MASK;
+	}
+
+	// Consumer side: takes the newest published buffer, returning false when nothing new arrived since the last call.
+	bool Acquire()
+	{
+		if (!(_middle.load(std::memory_order_relaxed) & FRESH))
+		{
+			return false;
+		}
+
+		uint8_t previous = _middle.exchange(_read, std::memory_order_acq_rel);
+		_read = previous & INDEX_MASK;
+		return true;
+	}
+
+	const T& Read_Buffer() const
+	{
+		return _buffers[_read];
+	}
+
+private:
+	const static uint8_t INDEX_MASK = 0x03;
+	const static uint8_t FRESH = 0x04;
+
+	std::array<T, 3> _buffers = {};
+	uint8_t _write = 0;
+	uint8_t _read = 1;
+	std::atomic<uint8_t> _middle{ 2 };
+};
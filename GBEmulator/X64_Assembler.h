@@ -0,0 +1,273 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
+#include <vector>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define GB_JIT_SUPPORTED 1
+#endif
+
+#ifdef GB_JIT_SUPPORTED
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+// Bump allocator for generated code. Memory is never writable and executable at once: the pages a function is
+// copied into are made read/write for the copy and read/execute again before it can run. Chunks start small and
+// double as the code grows, so a CPU that compiles little holds little.
+class Executable_Memory
+{
+public:
+	Executable_Memory() = default;
+	Executable_Memory(const Executable_Memory&) = delete;
+	Executable_Memory& operator=(const Executable_Memory&) = delete;
+
+	~Executable_Memory()
+	{
+		for (const auto& chunk : _chunks)
+		{
+#ifdef _WIN32
+			VirtualFree(chunk.data, 0, MEM_RELEASE);
+#else
+			munmap(chunk.data, chunk.size);
+#endif
+		}
+	}
+
+	// Copies code in and returns where it can be run from, or null when no more memory could be had.
+	uint8_t* Copy(const uint8_t* code, std::size_t size)
+	{
+		if (_chunks.empty() || _chunks.back().size - _used < size)
+		{
+			std::size_t chunk_size = _chunks.empty() ? FIRST_CHUNK_SIZE : std::min(_chunks.back().size * 2, LARGEST_CHUNK_SIZE);
+			chunk_size = std::max(chunk_size, (size + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1));
+#ifdef _WIN32
+			void* data = VirtualAlloc(nullptr, chunk_size, MEM_COMMIT | MEM_RESERVE, PAGE_READONLY);
+#else
+			void* data = mmap(nullptr, chunk_size, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+			if (data == MAP_FAILED)
+			{
+				data = nullptr;
+			}
+#endif
+			if (!data)
+			{
+				return nullptr;
+			}
+
+			_chunks.push_back({ static_cast<uint8_t*>(data), chunk_size });
+			_used = 0;
+		}
+
+		uint8_t* result = _chunks.back().data + _used;
+		_used += (size + 15) & ~std::size_t(15);
+
+		// Earlier functions sharing the first page can't run meanwhile, only the thread that owns this memory runs them.
+		auto first = reinterpret_cast<uintptr_t>(result) & ~(PAGE_SIZE - 1);
+		auto* pages = reinterpret_cast<uint8_t*>(first);
+		std::size_t length = reinterpret_cast<uintptr_t>(result) + size - first;
+		if (!Protect(pages, length, false))
+		{
+			return nullptr;
+		}
+		std::memcpy(result, code, size);
+		if (!Protect(pages, length, true))
+		{
+			return nullptr;
+		}
+
+		return result;
+	}
+
+private:
+	const static std::size_t PAGE_SIZE = 4096;
+	const static std::size_t FIRST_CHUNK_SIZE = 16 * PAGE_SIZE;
+	const static std::size_t LARGEST_CHUNK_SIZE = 1 << 20;
+
+	struct Chunk
+	{
+		uint8_t* data;
+		std::size_t size;
+	};
+
+	static bool Protect(uint8_t* pages, std::size_t length, bool executable)
+	{
+#ifdef _WIN32
+		DWORD previous;
+		if (!VirtualProtect(pages, length, executable ? PAGE_EXECUTE_READ : PAGE_READWRITE, &previous))
+		{
+			return false;
+		}
+		return !executable || FlushInstructionCache(GetCurrentProcess(), pages, length);
+#else
+		return mprotect(pages, length, executable ? PROT_READ | PROT_EXEC : PROT_READ | PROT_WRITE) == 0;
+#endif
+	}
+
+	std::vector<Chunk> _chunks;
+	std::size_t _used = 0;
+};
+
+// Emits the handful of x86-64 instructions the recompiler needs.
+// Generated functions have the signature uint32_t (void* context, void* registers) and return the cycles they ran.
+// Inside them rbx holds the context, r12 the register file and r13d the running cycle count.
+class X64_Assembler
+{
+public:
+	using Function = uint32_t (*)(void* context, void* registers);
+
+	// Functions called from generated code take (context, argument) and return cycles.
+	// Setting the top bit of the result makes the generated code return straight away, with the bit still set.
+	using Thunk = uint32_t (*)(void* context, uint32_t argument);
+	const static uint32_t STOP_BIT = 0x80000000;
+
+	void Begin()
+	{
+		_code.clear();
+		_exits.clear();
+		_pending_cycles = 0;
+
+		Emit({ 0x53 });             // push rbx
+		Emit({ 0x41, 0x54 });       // push r12
+		Emit({ 0x41, 0x55 });       // push r13
+#ifdef _WIN32
+		Emit({ 0x48, 0x83, 0xEC, 0x20 }); // sub rsp, 32 (shadow space)
+		Emit({ 0x48, 0x89, 0xCB }); // mov rbx, rcx
+		Emit({ 0x49, 0x89, 0xD4 }); // mov r12, rdx
+#else
+		Emit({ 0x48, 0x89, 0xFB }); // mov rbx, rdi
+		Emit({ 0x49, 0x89, 0xF4 }); // mov r12, rsi
+#endif
+		Emit({ 0x45, 0x31, 0xED }); // xor r13d, r13d
+	}
+
+	// Cycles of inline instructions are summed and only emitted before calls and at the end.
+	void Add_Cycles(uint32_t cycles)
+	{
+		_pending_cycles += cycles;
+	}
+
+	void Move8(uint8_t destination, uint8_t source)
+	{
+		Emit_Register_Operand({ 0x41, 0x0F, 0xB6 }, 0, source);      // movzx eax, byte [r12 + source]
+		Emit_Register_Operand({ 0x41, 0x88 }, 0, destination);       // mov byte [r12 + destination], al
+	}
+
+	void Move16(uint8_t destination, uint8_t source)
+	{
+		Emit_Register_Operand({ 0x41, 0x0F, 0xB7 }, 0, source);      // movzx eax, word [r12 + source]
+		Emit_Register_Operand({ 0x66, 0x41, 0x89 }, 0, destination); // mov word [r12 + destination], ax
+	}
+
+	void Store8(uint8_t destination, uint8_t value)
+	{
+		Emit_Register_Operand({ 0x41, 0xC6 }, 0, destination);       // mov byte [r12 + destination], imm8
+		Emit({ value });
+	}
+
+	void Store16(uint8_t destination, uint16_t value)
+	{
+		Emit_Register_Operand({ 0x66, 0x41, 0xC7 }, 0, destination); // mov word [r12 + destination], imm16
+		Emit_Value(value, 2);
+	}
+
+	void Increment16(uint8_t destination)
+	{
+		Emit_Register_Operand({ 0x66, 0x41, 0xFF }, 0, destination); // inc word [r12 + destination]
+	}
+
+	void Decrement16(uint8_t destination)
+	{
+		Emit_Register_Operand({ 0x66, 0x41, 0xFF }, 1, destination); // dec word [r12 + destination]
+	}
+
+	// Calls thunk(context, argument), adds its cycles and leaves the function if it asked to stop.
+	void Call(Thunk thunk, uint32_t argument)
+	{
+		Flush_Cycles();
+#ifdef _WIN32
+		Emit({ 0x48, 0x89, 0xD9 });    // mov rcx, rbx
+		Emit({ 0xBA });                // mov edx, imm32
+#else
+		Emit({ 0x48, 0x89, 0xDF });    // mov rdi, rbx
+		Emit({ 0xBE });                // mov esi, imm32
+#endif
+		Emit_Value(argument, 4);
+		Emit({ 0x48, 0xB8 });          // mov rax, imm64
+		Emit_Value(reinterpret_cast<uint64_t>(thunk), 8);
+		Emit({ 0xFF, 0xD0 });          // call rax
+		Emit({ 0x41, 0x01, 0xC5 });    // add r13d, eax
+		Emit({ 0x0F, 0x88 });          // js exit
+		_exits.push_back(_code.size());
+		Emit_Value(0, 4);
+	}
+
+	// Copies the finished function into executable memory, or returns null when that memory ran out.
+	Function Finish(Executable_Memory& memory)
+	{
+		Flush_Cycles();
+
+		for (auto exit : _exits)
+		{
+			uint32_t displacement = static_cast<uint32_t>(_code.size() - (exit + 4));
+			std::memcpy(&_code[exit], &displacement, 4);
+		}
+
+		Emit({ 0x44, 0x89, 0xE8 });    // mov eax, r13d
+#ifdef _WIN32
+		Emit({ 0x48, 0x83, 0xC4, 0x20 }); // add rsp, 32
+#endif
+		Emit({ 0x41, 0x5D });          // pop r13
+		Emit({ 0x41, 0x5C });          // pop r12
+		Emit({ 0x5B });                // pop rbx
+		Emit({ 0xC3 });                // ret
+
+		return reinterpret_cast<Function>(memory.Copy(_code.data(), _code.size()));
+	}
+
+private:
+	void Emit(std::initializer_list<uint8_t> bytes)
+	{
+		_code.insert(_code.end(), bytes);
+	}
+
+	void Emit_Value(uint64_t value, int bytes)
+	{
+		for (int i = 0; i < bytes; i++)
+		{
+			_code.push_back(static_cast<uint8_t>(value >> (i * 8)));
+		}
+	}
+
+	// Opcode bytes followed by a [r12 + disp8] memory operand.
+	void Emit_Register_Operand(std::initializer_list<uint8_t> opcode, uint8_t reg, uint8_t displacement)
+	{
+		Emit(opcode);
+		Emit({ static_cast<uint8_t>(0x44 | (reg << 3)), 0x24, displacement });
+	}
+
+	void Flush_Cycles()
+	{
+		if (_pending_cycles)
+		{
+			Emit({ 0x41, 0x81, 0xC5 }); // add r13d, imm32
+			Emit_Value(_pending_cycles, 4);
+			_pending_cycles = 0;
+		}
+	}
+
+	std::vector<uint8_t> _code;
+	std::vector<std::size_t> _exits;
+	uint32_t _pending_cycles = 0;
+};
+
+#endif
@@ -0,0 +1,235 @@
+// GBTraceTool.cpp : Decodes and compares execution traces written by GBEmulator --trace, and disassembles cartridges.
+//
+
+#include "Command_Line.h"
+#include "Opcodes.h"
+#include "ROM_Analysis.h"
+#include "ROM_Image.h"
+#include "Trace.h"
+
+#include <cstdio>
+#include <deque>
+#include <iostream>
+#include <string>
+
+void Print_Record(uint64_t index, const Trace_Record& record)
+{
+    const char* mnemonic = record.opcode == 0xCB ? CB_OPCODES[record.operand].mnemonic : OPCODES[record.opcode].mnemonic;
+    std::printf("%10llu cycle=%-12llu %02x:%04x %-14s A=%02x F=%02x B=%02x C=%02x D=%02x E=%02x H=%02x L=%02x SP=%04x\n",
+        static_cast<unsigned long long>(index), static_cast<unsigned long long>(record.cycle), record.bank, record.pc, mnemonic,
+        record.a, record.f, record.b, record.c, record.d, record.e, record.h, record.l, record.sp);
+}
+
+bool Same(const Trace_Record& a, const Trace_Record& b)
+{
+    return a.cycle == b.cycle && a.bank == b.bank && a.pc == b.pc && a.sp == b.sp && a.opcode == b.opcode && a.operand == b.operand
+        && a.a == b.a && a.f == b.f && a.b == b.b && a.c == b.c && a.d == b.d && a.e == b.e && a.h == b.h && a.l == b.l;
+}
+
+// GBTraceTool dump trace [first] [count]
+int Dump(const std::string& path, uint64_t first, uint64_t count)
+{
+    auto reader = Trace_Reader::Open(path);
+    if (!reader)
+    {
+        std::cout << "Not a trace file: " << path << std::endl;
+        return 1;
+    }
+
+    Trace_Record record;
+    for (uint64_t index = 0; index < first + count && reader->Next(record); index++)
+    {
+        if (index >= first)
+        {
+            Print_Record(index, record);
+        }
+    }
+
+    return 0;
+}
+
+// GBTraceTool diff a b [context]
+// Stops at the first record that differs and prints the records leading up to it.
+int Diff(const std::string& path_a, const std::string& path_b, std::size_t context)
+{
+    auto a = Trace_Reader::Open(path_a);
+    auto b = Trace_Reader::Open(path_b);
+    if (!a || !b)
+    {
+        std::cout << "Not a trace file: " << (a ? path_b : path_a) << std::endl;
+        return 1;
+    }
+
+    std::deque<Trace_Record> history;
+    Trace_Record record_a;
+    Trace_Record record_b;
+    for (uint64_t index = 0; ; index++)
+    {
+        bool has_a = a->Next(record_a);
+        bool has_b = b->Next(record_b);
+        if (!has_a && !has_b)
+        {
+            std::cout << "Traces match for " << index << " instructions" << std::endl;
+            return 0;
+        }
+
+        if (has_a != has_b || !Same(record_a, record_b))
+        {
+            std::cout << "Traces diverge at instruction " << index << std::endl;
+            uint64_t history_index = index - history.size();
+            for (const auto& record : history)
+            {
+                Print_Record(history_index++, record);
+            }
+
+            std::cout << path_a << ":" << std::endl;
+            has_a ? Print_Record(index, record_a) : void(std::cout << "  (end of trace)" << std::endl);
+            std::cout << path_b << ":" << std::endl;
+            has_b ? Print_Record(index, record_b) : void(std::cout << "  (end of trace)" << std::endl);
+            return 2;
+        }
+
+        history.push_back(record_a);
+        if (history.size() > context)
+        {
+            history.pop_front();
+        }
+    }
+}
+
+// Spells out the operand in place of the u8, u16 or i8 the mnemonic has for it. Relative jumps show their target.
+std::string Format_Instruction(const uint8_t* bytes, uint16_t address)
+{
+    uint8_t opcode = bytes[0];
+    const Opcode_Info& info = opcode == 0xCB ? CB_OPCODES[bytes[1]] : OPCODES[opcode];
+    std::string text = info.mnemonic;
+    char operand[8] = "";
+    std::size_t at = std::string::npos;
+    if ((at = text.find("u16")) != std::string::npos)
+    {
+        std::snprintf(operand, sizeof(operand), "$%04x", bytes[1] | (bytes[2] << 8));
+        text.replace(at, 3, operand);
+    }
+    else if ((at = text.find("u8")) != std::string::npos)
+    {
+        std::snprintf(operand, sizeof(operand), "$%02x", bytes[1]);
+        text.replace(at, 2, operand);
+    }
+    else if ((at = text.find("i8")) != std::string::npos)
+    {
+        bool relative_jump = (opcode & 0xE7) == 0x20 || opcode == 0x18;
+        int offset = static_cast<int8_t>(bytes[1]);
+        relative_jump ? std::snprintf(operand, sizeof(operand), "$%04x", static_cast<uint16_t>(address + 2 + offset))
+            : std::snprintf(operand, sizeof(operand), "%d", offset);
+        text.replace(at, 2, operand);
+    }
+
+    return text;
+}
+
+// GBTraceTool disasm rom [cache] [bank]
+// Lists the code the ROM analysis found, read from or saved to the cache directory when one is given, so it includes
+// any banked code earlier batches reached. Bytes no instruction was found in are summarised as data.
+int Disassemble(const std::string& path, const std::string& cache, int only_bank)
+{
+    auto rom = ROM_Image::Open(path);
+    if (!rom)
+    {
+        std::cout << "Can't read ROM: " << path << std::endl;
+        return 1;
+    }
+
+    auto analysis = cache.empty() ? ROM_Analysis::Analyze(*rom) : ROM_Analysis::Open(cache, *rom);
+    for (uint32_t bank = 0; bank < rom->Bank_Count(); bank++)
+    {
+        if (only_bank >= 0 && bank != static_cast<uint32_t>(only_bank))
+        {
+            continue;
+        }
+
+        std::printf("; bank %02x\n", bank);
+        const uint8_t* data = rom->Data() + bank * ROM_Image::BANK_SIZE;
+        uint16_t base = bank ? ROM_Image::BANK_SIZE : 0;
+        uint32_t data_bytes = 0;
+        for (uint32_t offset = 0; offset <= ROM_Image::BANK_SIZE; )
+        {
+            uint16_t address = static_cast<uint16_t>(base + offset);
+            uint32_t location = (bank << 16) | address;
+            bool instruction = offset < ROM_Image::BANK_SIZE && analysis->Is_Instruction(location);
+            if (!instruction && offset < ROM_Image::BANK_SIZE)
+            {
+                data_bytes++;
+                offset++;
+                continue;
+            }
+
+            if (data_bytes)
+            {
+                std::printf("%02x:%04x  ; %u bytes of data\n", bank, address - data_bytes, data_bytes);
+                data_bytes = 0;
+            }
+            if (!instruction)
+            {
+                break;
+            }
+
+            if (analysis->Is_Leader(location))
+            {
+                std::printf("\n%02x:%04x:\n", bank, address);
+            }
+
+            const uint8_t* bytes = data + offset;
+            uint32_t length = bytes[0] == 0xCB ? 2 : OPCODES[bytes[0]].length;
+            char hex[16] = "";
+            for (uint32_t i = 0; i < length; i++)
+            {
+                std::snprintf(hex + i * 3, sizeof(hex) - i * 3, "%02x ", bytes[i]);
+            }
+            std::printf("%02x:%04x  %-9s %s\n", bank, address, hex, Format_Instruction(bytes, address).c_str());
+            offset += length;
+        }
+    }
+
+    return 0;
+}
+
+int main(int argc, char* argv[])
+{
+    std::string command = argc > 1 ? argv[1] : "";
+    if (command == "dump" && argc >= 3)
+    {
+        const char* usage = "GBTraceTool dump trace [first] [count]";
+        uint64_t first = 0;
+        uint64_t count = 100;
+        if ((argc > 3 && !Parse_Number("first", argv[3], first, usage)) || (argc > 4 && !Parse_Number("count", argv[4], count, usage)))
+        {
+            return 1;
+        }
+        return Dump(argv[2], first, count);
+    }
+    else if (command == "diff" && argc >= 4)
+    {
+        std::size_t context = 16;
+        if (argc > 4 && !Parse_Number("context", argv[4], context, "GBTraceTool diff trace_a trace_b [context]"))
+        {
+            return 1;
+        }
+        return Diff(argv[2], argv[3], context);
+    }
+    else if (command == "disasm" && argc >= 3)
+    {
+        // Every bank unless one is given.
+        uint16_t bank = 0;
+        if (argc > 4 && !Parse_Number("bank", argv[4], bank, "GBTraceTool disasm rom [cache] [bank]"))
+        {
+            return 1;
+        }
+        return Disassemble(argv[2], argc > 3 ? argv[3] : "", argc > 4 ? bank : -1);
+    }
+
+    std::cout << "Usage:" << std::endl
+        << "  GBTraceTool dump trace [first] [count]" << std::endl
+        << "  GBTraceTool diff trace_a trace_b [context]" << std::endl
+        << "  GBTraceTool disasm rom [cache] [bank]" << std::endl;
+    return 1;
+}